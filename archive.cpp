@@ -4,9 +4,88 @@
 #include <memory>
 #include <fstream>
 #include <cassert>
+#include <chrono>
 #include <filesystem>
 #include <iostream>
 #include <utility>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "misc/positional_io.h"
+#include "misc/solid_block.h"
+#include "misc/dedup_store.h"
+#include "misc/xxh3.h"
+#include "misc/directory_walker.h"
+
+
+namespace
+{
+    // Last write time in ns since 1970 (file_clock has its own epoch, which isn't the same everywhere), 0 if it's unknown
+    int64_t get_modification_time( const std::filesystem::path& path )
+    {
+        std::error_code error;
+        const auto time = std::filesystem::last_write_time( path, error );
+        if (error) return 0;
+        return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::file_clock::to_sys( time ).time_since_epoch() ).count();
+    }
+
+    // XXH3-64 of the whole file, 0 if it couldn't be read
+    uint64_t get_fast_hash( const std::filesystem::path& path, bool& aborting_var )
+    {
+        std::ifstream input( path, std::ios::binary );
+        if (!input.is_open()) return 0;
+
+        xxh3::XXH3_64_state state;
+        std::vector<uint8_t> buffer( 4u << 20 );
+        while (input and !aborting_var) {
+            input.read( (char*)buffer.data(), buffer.size() );
+            state.update( buffer.data(), input.gcount() );
+        }
+        return input.eof() and !aborting_var ? state.digest() : 0;
+    }
+
+    // "a/b/c" -> "a/b", "c" -> ""
+    std::string get_parent_path( const std::string& relative_path )
+    {
+        const size_t slash = relative_path.find_last_of( '/' );
+        return slash == std::string::npos ? "" : relative_path.substr( 0, slash );
+    }
+
+    // Folder of archive for a path relative to the folder at "" in folders, missing ones on the way are made by make_folder.
+    // nullptr if one of them couldn't be made.
+    template<typename MakeFolder>
+    Folder* get_folder_for( std::unordered_map<std::string, Folder*>& folders, const std::string& relative_path, MakeFolder& make_folder )
+    {
+        auto known = folders.find( relative_path );
+        if (known != folders.end()) return known->second;
+
+        Folder* parent = get_folder_for( folders, get_parent_path( relative_path ), make_folder );
+        Folder* folder = parent != nullptr ? make_folder( *parent, relative_path.substr( relative_path.find_last_of( '/' ) + 1 ) ) : nullptr;
+        folders[relative_path] = folder;
+        return folder;
+    }
+
+    // Stamps of files (see CentralDirectory) aren't in their headers, so a tree read from headers
+    // gets them from another model of the same archive, by paths. destination has to be parsed already.
+    void copy_stamps( Folder& source, Folder& destination )
+    {
+        std::vector<std::pair<Folder*, Folder*>> stack{ { &source, &destination } };
+        while (!stack.empty()) {
+            auto [from, to] = stack.back();
+            stack.pop_back();
+            for (File* file = to->child_file_ptr.get(); file != nullptr; file = file->sibling_ptr.get()) {
+                const File* stamped = from->find_file( file->name );
+                if (stamped == nullptr) continue;
+                file->modification_time = stamped->modification_time;
+                file->fast_hash = stamped->fast_hash;
+            }
+            for (Folder* folder = to->child_dir_ptr.get(); folder != nullptr; folder = folder->sibling_ptr.get()) {
+                Folder* found = from->find_folder( folder->name );
+                if (found != nullptr) stack.emplace_back( found, folder );
+            }
+        }
+    }
+}
 
 
 Archive::Archive() : root_folder(std::make_unique<Folder>()) {}
@@ -34,7 +113,87 @@ void Archive::save( const std::string& path_to_file, bool& aborting_var )
 
     char* buffer[1] = {nullptr};
     this->archive_file.write( (char*)buffer, 1 ); // making sure location at byte 0 in file is not valid
-    this->root_folder->write_to_archive( this->archive_file, aborting_var );
+    this->free_space.clear();
+
+    // Whole tree is known up front, so instead of writing entries one by one, and going back to patch
+    // locations of each next one, data of all files is written first, one after another,
+    // then all headers at once, and at the end the root header, which has to stay at byte 1.
+    std::vector<Folder*> folders;
+    std::vector<File*> files;
+    std::vector<Folder*> stack{ this->root_folder.get() };
+    while (!stack.empty()) {
+        Folder* folder = stack.back();
+        stack.pop_back();
+        for (; folder != nullptr; folder = folder->sibling_ptr.get()) {
+            folders.push_back( folder );
+            for (File* file = folder->child_file_ptr.get(); file != nullptr; file = file->sibling_ptr.get()) files.push_back( file );
+            if (folder->child_dir_ptr) stack.push_back( folder->child_dir_ptr.get() );
+        }
+    }
+
+    Folder* root = this->root_folder.get();
+    root->location = 1;
+    const uint32_t root_header_size = Folder::base_metadata_size + root->name_length;
+    std::vector<uint8_t> headers( root_header_size, 0 );
+    this->archive_file.write( (char*)headers.data(), root_header_size );    // place for root header
+
+    // small files with flag 6 go into solid blocks first, bigger ones are deduplicated, the others go after them
+    for (auto& group : solid::make_groups( files )) {
+        if (aborting_var) return;
+        if (solid::write_group( this->archive_file, group, aborting_var )) continue;
+        for (File* member : group) {
+            member->flags_value &= ~(1u << solid::flag);
+            member->data_location = 0;
+        }
+    }
+    DedupStore dedup_store;
+    dedup_store.write_files( this->archive_file, files, aborting_var );
+
+    for (File* file : files) {
+        if (aborting_var) return;
+        file->alreadySaved = true;
+        if (file->is_solid_member()) {
+            if (file->data_location != 0) continue;
+            file->flags_value &= ~(1u << solid::flag);     // it couldn't be put into a solid block
+        }
+        file->data_location = this->archive_file.tellp();
+        file->process_the_file( this->archive_file, "encoding has it's path in the file object", true, aborting_var, true, nullptr );
+    }
+    if (aborting_var) return;
+
+    // every header gets its location first, so pointers between them are complete when they're written
+    const uint64_t headers_location = this->archive_file.tellp();
+    uint64_t next_location = headers_location;
+    for (size_t i=1; i < folders.size(); ++i) {
+        folders[i]->location = next_location;
+        next_location += Folder::base_metadata_size + folders[i]->name_length;
+    }
+    for (File* file : files) {
+        file->location = next_location;
+        next_location += File::base_metadata_size + file->name_length;
+    }
+
+    headers.resize( next_location - headers_location );
+    uint8_t* header = headers.data();
+    for (size_t i=1; i < folders.size(); ++i) {
+        folders[i]->write_header( header );
+        folders[i]->alreadySaved = true;
+        header += Folder::base_metadata_size + folders[i]->name_length;
+    }
+    for (File* file : files) {
+        file->write_header( header );
+        header += File::base_metadata_size + file->name_length;
+    }
+    this->archive_file.write( (char*)headers.data(), headers.size() );
+
+    std::vector<uint8_t> root_header( root_header_size );
+    root->write_header( root_header.data() );
+    root->alreadySaved = true;
+    this->archive_file.seekp( 1 );
+    this->archive_file.write( (char*)root_header.data(), root_header_size );
+    this->archive_file.seekp( 0, std::ios_base::end );
+
+    CentralDirectory::write( this->archive_file, *root );
 }
 
 
@@ -45,10 +204,397 @@ void Archive::load(const std::string& path_to_file )
     this->archive_file.open( path_to_file, std::ios::binary | std::ios::in | std::ios::out );
     assert( this->archive_file.is_open() );
 
-    this->archive_file.seekg( 1 );
-    this->root_folder->parse( this->archive_file, 1, nullptr, this->root_folder );
-    this->root_folder->name = std::filesystem::path(path_to_file).filename();
-    this->root_folder->name_length = this->root_folder->name.length();
+    // adding files could have been interrupted in the middle of linking them into the tree
+    if (!AppendJournal::recover( this->archive_file, this->load_path )) std::cout << "unfinished append couldn't be finished" << std::endl;
+
+    // directory is kept, since folders are parsed when they're needed, not all at once
+    this->directory = std::make_unique<CentralDirectory>( this->archive_file );
+    solid::clear_cache();
+    this->free_space.clear();
+    if (!this->directory->load( &this->free_space )) std::cout << "No central directory, reading headers one by one" << std::endl;
+
+    // root keeps the name it was saved with (window shows file name instead), locations inside its header depend on name_length
+    this->root_folder->parse( *this->directory, 1, nullptr );
+}
+
+
+void Archive::remove_central_directory()
+{
+    if (!this->archive_file.is_open()) return;
+
+    // whole tree is needed to write directory again, and it's cheap to parse while the old one is still in memory
+    this->root_folder->parse_children( true );
+    CentralDirectory::remove( this->archive_file, this->load_path );
+    this->cut_free_tail();
+}
+
+
+void Archive::write_central_directory()
+{
+    if (this->archive_file.is_open()) CentralDirectory::write( this->archive_file, *this->root_folder, &this->free_space );
+}
+
+
+void Archive::cut_free_tail()
+{
+    this->archive_file.flush();
+    this->archive_file.seekp( 0, std::ios_base::end );
+    const uint64_t tail = this->free_space.tail( this->archive_file.tellp() );
+    if (tail == 0) return;
+
+    std::error_code error;
+    std::filesystem::resize_file( this->load_path, tail, error );
+    if (error) return;
+
+    this->free_space.trim( tail );
+    this->archive_file.seekg( 0, std::ios_base::end );
+    this->archive_file.seekp( 0, std::ios_base::end );
+}
+
+
+bool Archive::remove_entries()
+{
+    if (!this->archive_file.is_open()) return false;
+
+    // old directory would be valid again after the journal is cut off, so it goes first
+    this->remove_central_directory();
+
+    AppendJournal journal;
+    std::vector<std::pair<uint64_t, uint64_t>> freed;
+    std::unordered_set<uint64_t> solid_blocks;     // of removed members, freed only if no other member is left in them
+    std::vector<solid::Range> ranges;
+
+    auto free_data = [this, &freed, &solid_blocks, &ranges]( const File& file ) {
+        if (file.data_location == 0) return;
+        if (!file.is_solid_member()) {
+            freed.emplace_back( file.data_location, file.get_stored_data_size() );
+            return;
+        }
+
+        // chunk list belongs only to its file, chunks can be in many solid blocks
+        solid::SolidHeader header;
+        if (solid::read_header( this->archive_file, file.data_location, header ) and solid::is_chunk_list( header ))
+            freed.emplace_back( file.data_location, solid::get_stored_size( header ) );
+        if (solid::get_ranges( this->archive_file, file, ranges ))
+            for (const solid::Range& range : ranges) solid_blocks.insert( range.block_location );
+    };
+
+    // removed folder takes everything inside it along
+    auto free_folder = [&freed, &free_data]( Folder& removed_folder ) {
+        freed.emplace_back( removed_folder.location, Folder::base_metadata_size + removed_folder.name_length );
+        std::vector<Folder*> stack;
+        if (removed_folder.child_dir_ptr) stack.push_back( removed_folder.child_dir_ptr.get() );
+        for (File* file = removed_folder.child_file_ptr.get(); file != nullptr; file = file->sibling_ptr.get()) {
+            freed.emplace_back( file->location, File::base_metadata_size + file->name_length );
+            free_data( *file );
+        }
+        while (!stack.empty()) {
+            Folder* folder = stack.back();
+            stack.pop_back();
+            for (; folder != nullptr; folder = folder->sibling_ptr.get()) {
+                freed.emplace_back( folder->location, Folder::base_metadata_size + folder->name_length );
+                for (File* file = folder->child_file_ptr.get(); file != nullptr; file = file->sibling_ptr.get()) {
+                    freed.emplace_back( file->location, File::base_metadata_size + file->name_length );
+                    free_data( *file );
+                }
+                if (folder->child_dir_ptr) stack.push_back( folder->child_dir_ptr.get() );
+            }
+        }
+    };
+
+    // Lists of children are taken apart, and built again from what's left. Each link in archive
+    // (parent's first child, or sibling of the previous one) is changed only if it points somewhere else now.
+    std::vector<Folder*> stack{ this->root_folder.get() };
+    while (!stack.empty()) {
+        Folder* parent = stack.back();
+        stack.pop_back();
+
+        parent->names_indexed = false;
+        parent->folder_names.clear();
+        parent->file_names.clear();
+
+        std::unique_ptr<Folder> folder = std::move( parent->child_dir_ptr );
+        parent->last_child_dir = nullptr;
+        uint64_t link_position = parent->location + 1 + parent->name_length + 8;      // child_dir_location of parent
+        uint64_t linked_location = folder ? folder->location : 0;
+        while (folder) {
+            std::unique_ptr<Folder> next = std::move( folder->sibling_ptr );
+            if (folder->ptr_already_gotten) free_folder( *folder );
+            else {
+                if (folder->location != linked_location) journal.add( link_position, folder->location );
+                link_position = folder->location + 1 + folder->name_length + 16;    // sibling_location of this folder
+                linked_location = next ? next->location : 0;
+                stack.push_back( parent->append_folder( std::move(folder) ).get() );
+            }
+            folder = std::move( next );
+        }
+        if (linked_location != 0) journal.add( link_position, 0 );
+
+        std::unique_ptr<File> file = std::move( parent->child_file_ptr );
+        parent->last_child_file = nullptr;
+        link_position = parent->location + 1 + parent->name_length + 24;             // child_file_location of parent
+        linked_location = file ? file->location : 0;
+        while (file) {
+            std::unique_ptr<File> next = std::move( file->sibling_ptr );
+            if (file->ptr_already_gotten) {
+                freed.emplace_back( file->location, File::base_metadata_size + file->name_length );
+                free_data( *file );
+            }
+            else {
+                if (file->location != linked_location) journal.add( link_position, file->location );
+                link_position = file->location + 1 + file->name_length + 8;         // sibling_location of this file
+                linked_location = next ? next->location : 0;
+                parent->append_file( std::move(file) );
+            }
+            file = std::move( next );
+        }
+        if (linked_location != 0) journal.add( link_position, 0 );
+    }
+
+    // members of solid blocks can be anywhere in the tree (it's all parsed by remove_central_directory)
+    if (!solid_blocks.empty()) {
+        std::vector<Folder*> remaining_folders{ this->root_folder.get() };
+        for (size_t i=0; i < remaining_folders.size(); ++i) {
+            for (Folder* folder = remaining_folders[i]->child_dir_ptr.get(); folder != nullptr; folder = folder->sibling_ptr.get())
+                remaining_folders.push_back( folder );
+            for (File* file = remaining_folders[i]->child_file_ptr.get(); file != nullptr; file = file->sibling_ptr.get())
+                if (file->is_solid_member() and solid::get_ranges( this->archive_file, *file, ranges ))
+                    for (const solid::Range& range : ranges) solid_blocks.erase( range.block_location );
+        }
+        for (uint64_t location : solid_blocks) {
+            solid::SolidHeader header;
+            if (solid::read_header( this->archive_file, location, header )) freed.emplace_back( location, solid::get_stored_size( header ) );
+        }
+    }
+
+    if (!journal.commit( this->archive_file, this->load_path )) return false;
+    solid::clear_cache();
+
+    // space is given away only when nothing points at it anymore
+    for (auto& [location, size] : freed) this->free_space.release( location, size );
+    this->cut_free_tail();
+    this->write_central_directory();
+    return true;
+}
+
+
+bool Archive::append_files( const std::vector<File*>& files, bool& aborting_var, uint16_t* progress_var, const AppendProgress& progress )
+{
+    if (!this->archive_file.is_open()) return false;
+    if (files.empty()) return true;
+
+    this->archive_file.seekp( 0, std::ios_base::end );
+    const uint64_t original_size = this->archive_file.tellp();
+    AppendJournal journal;
+
+    for (auto& group : solid::make_groups( files )) {
+        if (aborting_var) break;
+        if (progress) progress( "solid block of " + std::to_string( group.size() ) + " files", nullptr );
+        this->archive_file.seekp( 0, std::ios_base::end );
+        if (solid::write_group( this->archive_file, group, aborting_var )) continue;
+        for (File* member : group) {
+            member->flags_value &= ~(1u << solid::flag);
+            member->data_location = 0;
+        }
+    }
+    // index of chunks is read only if some file is going to be chunked, it takes reading every chunk list in archive
+    if (!aborting_var and DedupStore::any_chunked( files )) {
+        if (progress) progress( "deduplication", nullptr );
+        DedupStore dedup_store;
+        dedup_store.load( this->archive_file, *this->root_folder );
+        this->archive_file.seekp( 0, std::ios_base::end );
+        dedup_store.write_files( this->archive_file, files, aborting_var );
+    }
+
+    bool successful = !aborting_var;
+    for (size_t i=0; i < files.size() and successful and !aborting_var; ++i) {
+        if (progress) progress( files[i]->path, files[i] );
+        successful = files[i]->append_to_archive( this->archive_file, aborting_var, false, progress_var, &journal, &this->free_space );
+    }
+
+    if (successful and !aborting_var and journal.commit( this->archive_file, this->load_path )) return true;
+
+    this->cut_off_appended( original_size );
+    return false;
+}
+
+
+bool Archive::append_folders( const std::vector<Folder*>& folders )
+{
+    if (!this->archive_file.is_open()) return false;
+    if (folders.empty()) return true;
+
+    this->archive_file.seekp( 0, std::ios_base::end );
+    const uint64_t original_size = this->archive_file.tellp();
+    AppendJournal journal;
+
+    bool successful = true;
+    for (size_t i=0; i < folders.size() and successful; ++i)
+        successful = folders[i]->append_to_archive( this->archive_file, &journal );
+
+    if (successful and journal.commit( this->archive_file, this->load_path )) return true;
+
+    this->cut_off_appended( original_size );
+    return false;
+}
+
+
+void Archive::cut_off_appended( uint64_t original_size )
+{
+    // nothing points at the new data yet, so it's simply cut off
+    this->archive_file.flush();
+    std::error_code error;
+    std::filesystem::resize_file( this->load_path, original_size, error );
+    this->archive_file.clear();
+    this->archive_file.seekg( 0, std::ios_base::end );
+    this->archive_file.seekp( 0, std::ios_base::end );
+}
+
+
+void Archive::reread_tree()
+{
+    // there's no directory now, headers are read one by one
+    std::unique_ptr<Folder> model = std::move( this->root_folder );
+    this->root_folder = std::make_unique<Folder>();
+    this->directory->load();
+    this->root_folder->parse( *this->directory, 1, nullptr );
+    this->root_folder->parse_children( true );
+    copy_stamps( *model, *this->root_folder );
+}
+
+
+bool Archive::update( const std::filesystem::path& source_path, uint16_t flags, bool compare_hashes, bool& aborting_var,
+                      const PathFilter& filter )
+{
+    if (!this->archive_file.is_open() or !this->directory or !std::filesystem::exists( source_path )) return false;
+
+    // the whole tree is parsed here, with stamps from the old directory
+    this->remove_central_directory();
+
+    std::vector<File*> new_files;       // new and changed ones
+    std::vector<Folder*> new_folders;
+    uint64_t unchanged_count = 0;
+    uint64_t changed_count = 0;
+
+    auto update_file = [&]( Folder& parent, const std::filesystem::path& path ) {
+        const std::string name = path.filename().string();
+        std::error_code error;
+        const uint64_t size = std::filesystem::file_size( path, error );
+        if (error or name.length() > 255) {
+            std::cout << "File " << path << " was skipped" << std::endl;
+            return;
+        }
+        const int64_t modification_time = get_modification_time( path );
+        uint64_t fast_hash = 0;
+
+        File* archived = parent.find_file( name );
+        if (archived != nullptr and archived->original_size == size) {
+            if (modification_time != 0 and archived->modification_time == modification_time) {
+                unchanged_count++;
+                return;
+            }
+            if (compare_hashes and archived->fast_hash != 0) {
+                fast_hash = get_fast_hash( path, aborting_var );
+                if (fast_hash == archived->fast_hash) {
+                    archived->modification_time = modification_time;    // it was only touched
+                    unchanged_count++;
+                    return;
+                }
+            }
+        }
+
+        // changed file is compressed the same way as its old version was
+        uint16_t file_flags = archived != nullptr ? archived->flags_value : flags;
+        File* new_file = add_file_to_archive_model( parent, path.string(), file_flags );
+        if (compare_hashes) new_file->fast_hash = fast_hash != 0 ? fast_hash : get_fast_hash( path, aborting_var );
+        new_files.push_back( new_file );
+        if (archived != nullptr) {
+            archived->ptr_already_gotten = true;    // removed once the new version is linked
+            changed_count++;
+        }
+    };
+
+    // new folders are written before files, while they're still empty, so only their headers go into archive
+    auto get_folder = [this, &new_folders]( Folder& parent, const std::string& name ) -> Folder* {
+        Folder* folder = parent.find_folder( name );
+        if (folder != nullptr or name.length() > 255) return folder;
+        folder = this->add_folder_to_model( &parent, name );
+        new_folders.push_back( folder );
+        return folder;
+    };
+
+    if (std::filesystem::is_directory( source_path )) {
+        std::unordered_map<std::string, Folder*> folders{ { "", this->root_folder.get() } };   // relative path -> folder in archive
+        for (const DirectoryWalker::Entry& entry : DirectoryWalker( filter ).walk( source_path )) {
+            if (aborting_var) break;
+            if (entry.is_folder and filter.has_includes()) continue;   // folders are made only for files in them then
+            Folder* folder = get_folder_for( folders, entry.is_folder ? entry.relative_path : get_parent_path( entry.relative_path ), get_folder );
+            if (folder != nullptr and !entry.is_folder) update_file( *folder, entry.path );
+        }
+    }
+    else update_file( *this->root_folder, source_path );
+
+    std::cout << unchanged_count << " unchanged files, " << changed_count << " changed, "
+              << new_files.size() - changed_count << " new" << std::endl;
+
+    if (aborting_var or !this->append_folders( new_folders ) or !this->append_files( new_files, aborting_var )) {
+        // nothing new is linked into archive, so the model is read again from it
+        this->reread_tree();
+        this->write_central_directory();
+        return false;
+    }
+
+    // old versions are unlinked only now, so there's always at least one of them in archive
+    if (changed_count != 0) return this->remove_entries();
+    this->write_central_directory();
+    return true;
+}
+
+
+bool Archive::compact()
+{
+    if (!this->archive_file.is_open()) return false;
+    this->root_folder->parse_children( true );
+
+    // new archive is built next to the old one, so renaming it is the only thing which changes the old one
+    std::filesystem::path compacted_path = this->load_path;
+    compacted_path += ".compact";
+    {
+        PathStream dst( compacted_path, std::ios::binary | std::ios::out | std::ios::trunc );
+        if (!dst.is_open()) return false;
+
+        dst.put(0);  // first byte is always 0x0, to make any location = 0 within the archive invalid
+        std::unordered_map<uint64_t, uint64_t> solid_blocks;
+        this->root_folder->copy_to_another_archive( this->archive_file, dst, 0, 0, 0, &solid_blocks );
+        if (!dst.good()) {
+            dst.close();
+            std::filesystem::remove( compacted_path );
+            return false;
+        }
+    }
+
+    // locations in the model are still the old ones, so directory of the copy is built from its own headers
+    {
+        Archive compacted_archive;
+        compacted_archive.load( compacted_path.string() );
+        compacted_archive.root_folder->parse_children( true );
+        copy_stamps( *this->root_folder, *compacted_archive.root_folder );
+        compacted_archive.write_central_directory();
+    }
+
+    PositionalFile compacted_file;
+    if (!compacted_file.open( compacted_path, true ) or !compacted_file.sync()) return false;
+    compacted_file.close();
+
+    this->close();
+    std::error_code error;
+    std::filesystem::rename( compacted_path, this->load_path, error );
+    if (error) std::cout << "compacted archive couldn't replace the old one: " << error.message() << std::endl;
+
+    this->archive_file.open( this->load_path, std::ios::binary | std::ios::in | std::ios::out );
+    this->free_space.clear();
+    solid::clear_cache();
+    return !error;
 }
 
 
@@ -69,6 +615,7 @@ void Archive::build_empty_archive( std::string archive_name )
 
 
 std::unique_ptr<File>* find_file_in_archive( Folder* parent, File* wanted_file ) {
+    parent->parse_children();
     if ( parent->child_file_ptr.get() == wanted_file ) return &(parent->child_file_ptr);
 
     std::unique_ptr<File>* tempfile_ptr = &(parent->child_file_ptr);
@@ -82,6 +629,7 @@ std::unique_ptr<File>* find_file_in_archive( Folder* parent, File* wanted_file )
 
 
 std::unique_ptr<Folder>* find_folder_in_archive( Folder* parent, Folder* wanted_folder ) {
+    parent->parse_children();
     if ( parent->child_dir_ptr.get() == wanted_folder ) return &(parent->child_dir_ptr);
 
     std::unique_ptr<Folder>* tempfolder_ptr = &(parent->child_dir_ptr);
@@ -106,85 +654,104 @@ void Archive::unpack_whole_archive( const std::string& path_to_directory, std::f
 }
 
 
-std::unique_ptr<Folder>* Archive::add_folder_to_model( std::unique_ptr<Folder> &parent_dir, const std::string& folder_name )
+bool Archive::extract_paths( const std::vector<std::string>& paths_in_archive, const PathFilter& filter,
+                             const std::filesystem::path& path_to_directory, bool& aborting_var )
 {
-    std::unique_ptr<Folder> *pointer_to_be_returned = nullptr;
-    if (parent_dir->child_dir_ptr == nullptr) {
-        parent_dir->child_dir_ptr = std::make_unique<Folder>( parent_dir, folder_name );
-        pointer_to_be_returned = &(parent_dir->child_dir_ptr);
-    }
-    else {
-        Folder* previous_folder = parent_dir->child_dir_ptr.get();
-        while( previous_folder->sibling_ptr != nullptr )
-        {
-            previous_folder = previous_folder->sibling_ptr.get();
+    if (!this->archive_file.is_open()) return false;
+    bool successful = true;
+
+    auto extract_file = [&]( File& file, const std::string& relative_path ) {
+        const std::filesystem::path target = path_to_directory / get_parent_path( relative_path );
+        std::error_code error;
+        std::filesystem::create_directories( target, error );
+        if (error or !file.unpack( target.string(), this->archive_file, aborting_var, false )) {
+            std::cout << relative_path << " couldn't be extracted" << std::endl;
+            successful = false;
+        }
+    };
+
+    for (std::string path : paths_in_archive) {
+        if (aborting_var) return false;
+        while (!path.empty() and path.front() == '/') path.erase( 0, 1 );
+        while (!path.empty() and path.back() == '/') path.pop_back();
+
+        // file given by its path is always extracted, filter is only for contents of folders
+        File* file = path.empty() ? nullptr : find_file( path );
+        if (file != nullptr) {
+            extract_file( *file, path );
+            continue;
+        }
+        Folder* selected = find_folder( path );
+        if (selected == nullptr) {
+            std::cout << "there's no " << path << " in archive" << std::endl;
+            successful = false;
+            continue;
         }
-        previous_folder->sibling_ptr = std::make_unique<Folder>( parent_dir, folder_name );
-        pointer_to_be_returned = &(previous_folder->sibling_ptr);
-    }
 
-    return pointer_to_be_returned;
+        std::vector<std::pair<Folder*, std::string>> stack{ { selected, path } };
+        while (!stack.empty() and !aborting_var) {
+            auto [folder, folder_path] = stack.back();
+            stack.pop_back();
+            folder->parse_children();
+            if (!filter.has_includes()) std::filesystem::create_directories( path_to_directory / folder_path );
+
+            const std::string prefix = folder_path.empty() ? "" : folder_path + '/';
+            for (File* child = folder->child_file_ptr.get(); child != nullptr and !aborting_var; child = child->sibling_ptr.get())
+                if (filter.accepts_file( prefix + child->name )) extract_file( *child, prefix + child->name );
+            for (Folder* child = folder->child_dir_ptr.get(); child != nullptr; child = child->sibling_ptr.get())
+                if (filter.accepts_folder( prefix + child->name )) stack.emplace_back( child, prefix + child->name );
+        }
+    }
+    return successful and !aborting_var;
 }
 
 
-Folder* Archive::add_folder_to_model( Folder* parent_dir, std::string folder_name )
+void Archive::add_directory_to_model( Folder& parent_dir, const std::filesystem::path& path_to_directory, const PathFilter& filter, uint16_t flags )
 {
-    std::unique_ptr<Folder> *pointer_to_be_returned = nullptr;
-    if (parent_dir->child_dir_ptr == nullptr) {
-        parent_dir->child_dir_ptr = std::make_unique<Folder>( parent_dir, folder_name );
-        pointer_to_be_returned = &(parent_dir->child_dir_ptr);
-    }
-    else {
-        Folder* previous_folder = parent_dir->child_dir_ptr.get();
-        while( previous_folder->sibling_ptr != nullptr )
-        {
-            previous_folder = previous_folder->sibling_ptr.get();
+    auto make_folder = [this]( Folder& parent, const std::string& name ) -> Folder* {
+        if (name.length() > 255) return nullptr;
+        Folder* folder = parent.find_folder( name );    // folders of many directories can be merged
+        return folder != nullptr ? folder : this->add_folder_to_model( &parent, name );
+    };
+
+    std::unordered_map<std::string, Folder*> folders{ { "", &parent_dir } };     // relative path -> folder in model
+    for (const DirectoryWalker::Entry& entry : DirectoryWalker( filter ).walk( path_to_directory )) {
+        if (entry.is_folder and filter.has_includes()) continue;   // folders are made only for files in them then
+        Folder* folder = get_folder_for( folders, entry.is_folder ? entry.relative_path : get_parent_path( entry.relative_path ), make_folder );
+        if (folder == nullptr or entry.is_folder) continue;
+        if (entry.path.filename().string().length() > 255) {
+            std::cout << "File " << entry.path << " was skipped, its name is too long" << std::endl;
+            continue;
         }
-        previous_folder->sibling_ptr = std::make_unique<Folder>( parent_dir, folder_name );
-        pointer_to_be_returned = &(previous_folder->sibling_ptr);
+        add_file_to_archive_model( *folder, entry.path.string(), flags );
     }
-
-    return pointer_to_be_returned->get();
 }
 
 
-void Archive::add_file_to_archive_model(std::unique_ptr<Folder>& parent_dir, const std::string& path_to_file, uint16_t& flags )
+std::unique_ptr<Folder>* Archive::add_folder_to_model( std::unique_ptr<Folder> &parent_dir, const std::string& folder_name )
 {
-    std::filesystem::path std_path( path_to_file );
-    std::unique_ptr<File> new_file = std::make_unique<File>();
-    File* ptr_new_file = new_file.get();
-    ptr_new_file->path = path_to_file;
-
-
-    ptr_new_file->name = std_path.filename().string();
-    ptr_new_file->name_length = ptr_new_file->name.length();
+    parent_dir->parse_children();   // otherwise new folder would replace the ones already in archive
+    return &parent_dir->append_folder( std::make_unique<Folder>( parent_dir, folder_name ) );
+}
 
-    ptr_new_file->parent_ptr = parent_dir.get();            // ptr to parent folder in memory
-    ptr_new_file->sibling_ptr=nullptr;                      // ptr to next sibling file in memory
 
-    if (parent_dir->child_file_ptr != nullptr)
-    {
-        File* file_ptr = parent_dir->child_file_ptr.get();  // file_ptr points to previous file
-        while( file_ptr->sibling_ptr != nullptr )
-        {
-            file_ptr = file_ptr->sibling_ptr.get();
-        }
-        file_ptr->sibling_ptr.swap(new_file);
-    }
-    else {
-        parent_dir->child_file_ptr.swap(new_file);
-    }
+Folder* Archive::add_folder_to_model( Folder* parent_dir, std::string folder_name )
+{
+    parent_dir->parse_children();   // otherwise new folder would replace the ones already in archive
+    return parent_dir->append_folder( std::make_unique<Folder>( parent_dir, folder_name ) ).get();
+}
 
-    ptr_new_file->flags_value = flags;              // 16 flags represented as 16-bit int
-    ptr_new_file->data_location = 0;                // location of data in archive (in bytes) will be added to model right before writing the data
-    ptr_new_file->compressed_size=0;                // will be determined after compression
-    ptr_new_file->original_size = std::filesystem::file_size( std_path );
 
+void Archive::add_file_to_archive_model(std::unique_ptr<Folder>& parent_dir, const std::string& path_to_file, uint16_t& flags )
+{
+    add_file_to_archive_model( *parent_dir, path_to_file, flags );
 }
 
 
 File* Archive::add_file_to_archive_model(Folder &parent_dir, const std::string& path_to_file, uint16_t& flags )
 {
+    parent_dir.parse_children();    // otherwise new file would replace the ones already in archive
+
     std::filesystem::path std_path( path_to_file );
     std::unique_ptr<File> new_file = std::make_unique<File>();
     File* ptr_new_file = new_file.get();
@@ -197,28 +764,38 @@ File* Archive::add_file_to_archive_model(Folder &parent_dir, const std::string&
     ptr_new_file->parent_ptr = &parent_dir;                 // ptr to parent folder in memory
     ptr_new_file->sibling_ptr = nullptr;                    // ptr to next sibling file in memory
 
-    if (parent_dir.child_file_ptr.get() != nullptr)
-    {
-        File* file_ptr = parent_dir.child_file_ptr.get();   // file_ptr points to previous file
-        while( file_ptr->sibling_ptr != nullptr )
-        {
-            file_ptr = file_ptr->sibling_ptr.get();
-        }
-        file_ptr->sibling_ptr.swap(new_file);
-    }
-    else {
-        parent_dir.child_file_ptr.swap(new_file);
-    }
-
-    ptr_new_file->flags_value = flags;                      // 16 flags represented as 16-bit int
+    ptr_new_file->flags_value = flags | (1u << 5u);         // 16 flags represented as 16-bit int, new files always get block index (flag 5)
     ptr_new_file->data_location = 0;                        // location of data in archive (in bytes) will be added to model right before writing the data
     ptr_new_file->compressed_size=0;                        // will be determined after compression
     ptr_new_file->original_size = std::filesystem::file_size( std_path );
+    ptr_new_file->modification_time = get_modification_time( std_path );   // kept in central directory, for update()
 
+    parent_dir.append_file( std::move(new_file) );
     return ptr_new_file;
 }
 
 
+Folder* Archive::find_folder( const std::string& path_in_archive )
+{
+    Folder* folder = root_folder.get();
+    for (const auto& part : std::filesystem::path( path_in_archive )) {
+        if (part.empty() or part == "/" or part == ".") continue;
+        folder = folder->find_folder( part.string() );
+        if (folder == nullptr) return nullptr;
+    }
+    return folder;
+}
+
+
+File* Archive::find_file( const std::string& path_in_archive )
+{
+    std::filesystem::path path( path_in_archive );
+    Folder* parent = find_folder( path.parent_path().string() );
+    if (parent == nullptr) return nullptr;
+    return parent->find_file( path.filename().string() );
+}
+
+
 void Archive::recursive_print() const {
     root_folder->recursive_print( std::cout );
     std::cout << std::endl;
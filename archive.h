@@ -1,7 +1,14 @@
 #ifndef ARCHIVE_H
 #define ARCHIVE_H
 
+#include <functional>
+
 #include "archive_structures.h"
+#include "misc/central_directory.h"
+#include "misc/append_journal.h"
+#include "misc/free_space.h"
+#include "misc/path_filter.h"
+#include "misc/positional_io.h"
 
 
 class Archive
@@ -23,7 +30,13 @@ public:
     std::unique_ptr<Folder> root_folder;
 
     // Stream for creating/loading archive
-    std::fstream archive_file;
+    PathStream archive_file;
+
+    // Headers of loaded archive, used by folders parsed later
+    std::unique_ptr<CentralDirectory> directory;
+
+    // Unused ranges of archive, left by removed entries, saved in central directory
+    FreeSpace free_space;
 
     // Closes archive_file if open
     void close();
@@ -31,9 +44,50 @@ public:
     // Saves archive to file
     void save( const std::string& path_to_file, bool& aborting_var );
 
-    // Loads archive from file
+    // Loads archive from file, headers are taken from central directory if there's a valid one
     void load( const std::string& path_to_file );
 
+    // Central directory (misc/central_directory.h) should be removed before appending to archive_file,
+    // and written again after that, so the next load doesn't have to read headers one by one
+    void remove_central_directory();
+    void write_central_directory();
+
+    // Removes folders and files marked with ptr_already_gotten (e.g. by get_ptrs) from archive in place.
+    // They're only unlinked from the tree (through AppendJournal), and their space is added to free_space
+    bool remove_entries();
+
+    // Tells what append_files() is doing: file is set right before it's compressed (its progress goes to progress_var),
+    // it's nullptr for solid blocks and deduplication, which go first
+    using AppendProgress = std::function<void( const std::string& label, File* file )>;
+
+    // Appends unsaved files (already in the model) at the end of archive: solid blocks, deduplicated chunks,
+    // then the others, filling unused ranges first. They're linked into the tree all at once, or cut off if any
+    // of them failed (then reread_tree() gives a model without them). Central directory has to be removed before,
+    // and written again after that.
+    bool append_files( const std::vector<File*>& files, bool& aborting_var, uint16_t* progress_var = nullptr,
+                       const AppendProgress& progress = nullptr );
+
+    // Appends headers of new, still empty folders (already in the model, parents before their children),
+    // and links them all at once, like append_files(). Central directory has to be removed before.
+    bool append_folders( const std::vector<Folder*>& folders );
+
+    // Reads the tree again from headers in archive_file (central directory has to be removed), e.g. after
+    // append_files() failed, and the model still has files which aren't in archive. Stamps are kept from the old model
+    void reread_tree();
+
+    // Brings archive up to date with a file, or with contents of a folder (they go into root of archive).
+    // File is unchanged if its size and modification time are the same as in archive. With compare_hashes,
+    // file with another modification time is read, and if its XXH3 is still the same, only the time is updated.
+    // New and changed files are appended (changed ones keep their flags, new ones get flags), and old versions
+    // are removed after that. Entries which aren't on disk anymore are kept. Archive has to be loaded.
+    // Only entries of the folder accepted by filter are compared (see misc/path_filter.h).
+    bool update( const std::filesystem::path& source_path, uint16_t flags, bool compare_hashes, bool& aborting_var,
+                 const PathFilter& filter = PathFilter() );
+
+    // Rewrites archive without unused ranges, into a new file which replaces the old one at the end.
+    // Archive has to be loaded again after that, since locations in the model are the old ones
+    bool compact();
+
     // Creates empty archive, needs to happen before adding files
     void build_empty_archive() const;                       // default archive name
     void build_empty_archive( std::string archive_name );   // custom archive name
@@ -47,9 +101,23 @@ public:
     // Unpacks whole archive to path_to_dir
     void unpack_whole_archive( const std::string& path_to_directory, std::fstream &os, bool& aborting_var );
 
+    // Extracts given files and folders (paths inside archive, "" is the root) into path_to_directory, where
+    // they keep their paths from the root of archive. Files in folders are extracted only if filter accepts them.
+    bool extract_paths( const std::vector<std::string>& paths_in_archive, const PathFilter& filter,
+                        const std::filesystem::path& path_to_directory, bool& aborting_var );
+
+    // Finds folder/file by its path inside archive (e.g. "photos/2020/img.png"), parsing only folders on the way
+    // Returns nullptr if there's no such thing
+    Folder* find_folder( const std::string& path_in_archive );
+    File* find_file( const std::string& path_in_archive );
+
     // Adds information about file to archive's model, needs to happen for compression to be possible
     static void add_file_to_archive_model(std::unique_ptr<Folder> &parent_dir, const std::string& path_to_file, uint16_t &flags );
-    File* add_file_to_archive_model(Folder& parent_dir, const std::string& path_to_file, uint16_t& flags );
+    static File* add_file_to_archive_model(Folder& parent_dir, const std::string& path_to_file, uint16_t& flags );
+
+    // Adds everything in a folder on disk, which filter accepts, into parent_dir in archive's model (folder itself isn't added).
+    // Folder is walked on many threads (see misc/directory_walker.h). With include patterns, only folders with files are added.
+    void add_directory_to_model( Folder& parent_dir, const std::filesystem::path& path_to_directory, const PathFilter& filter, uint16_t flags );
 
     // Adds folder to archive's model, and returns pointer to unique pointer to it for future use
     static std::unique_ptr<Folder>* add_folder_to_model( std::unique_ptr<Folder> &parent_dir, const std::string& folder_name );
@@ -57,6 +125,13 @@ public:
 
     // Prints whole archive's useful data onto console
     void recursive_print() const;
+
+private:
+    // Cuts off unused range at the end of archive, if there's one (central directory has to be removed before)
+    void cut_free_tail();
+
+    // Cuts off what was appended after original_size, when it isn't linked into the tree
+    void cut_off_appended( uint64_t original_size );
 };
 
 #endif // ARCHIVE_H
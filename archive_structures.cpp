@@ -1,11 +1,82 @@
 #include "archive_structures.h"
 
-#include <QApplication>
 #include <iostream>
 #include <bitset>
 
 
 #include "misc/multithreading.h"
+#include "misc/central_directory.h"
+#include "misc/append_journal.h"
+#include "misc/free_space.h"
+#include "misc/positional_io.h"
+#include "misc/solid_block.h"
+#include "misc/dedup_store.h"
+
+
+namespace
+{
+    uint64_t read_u64( const uint8_t* buffer )
+    {
+        return ((uint64_t)buffer[0]) | ((uint64_t)buffer[1]<<8u) | ((uint64_t)buffer[2]<<16u) | ((uint64_t)buffer[3]<<24u) | ((uint64_t)buffer[4]<<32u) | ((uint64_t)buffer[5]<<40u) | ((uint64_t)buffer[6]<<48u) | ((uint64_t)buffer[7]<<56u);
+    }
+
+    // Overwrites 8-byte location at given position in archive, put position stays where it was
+    void patch_u64( std::fstream& archive_file, uint64_t position, uint64_t value )
+    {
+        uint8_t buffer[8];
+        for (uint8_t i=0; i < 8; i++)
+            buffer[i] = (value >> (i*8u)) & 0xFFu;
+
+        uint64_t backup_p = archive_file.tellp();
+        archive_file.seekp( position );
+        archive_file.write( (char*)buffer, 8 );
+        archive_file.seekp( backup_p );
+    }
+
+    // Finds a loop in a list of headers without remembering all of them (Brent's algorithm):
+    // location saved at every power of two steps is found again, if the list goes round
+    struct LoopGuard
+    {
+        uint64_t saved_location = 0;
+        uint64_t power = 1;
+        uint64_t steps = 0;
+
+        bool seen( uint64_t location )
+        {
+            if (location == saved_location) return true;
+            if (++steps == power) {
+                saved_location = location;
+                power *= 2;
+                steps = 0;
+            }
+            return false;
+        }
+    };
+
+    // Data is written at the end of archive first, since its size isn't known before it's compressed.
+    // If it fits into some unused range, it's copied there, and the end of archive is cut off again.
+    // Returns new location of data, or the old one if it stays where it is.
+    uint64_t move_into_free_space( std::fstream& archive_file, FreeSpace& free_space, uint64_t data_location )
+    {
+        const uint64_t end_of_data = archive_file.tellp();
+        const uint64_t data_size = end_of_data - data_location;
+        const uint64_t free_location = free_space.allocate( data_size );
+        if (free_location == 0) return data_location;
+
+        archive_file.flush();
+        PositionalFile file;
+        const bool moved = file.attach( archive_file ) and copy_range( file, data_location, file, free_location, data_size );
+
+        // nothing points at either copy yet, so failing anywhere here loses nothing
+        if (!moved or !file.truncate( data_location )) {
+            free_space.release( free_location, data_size );
+            archive_file.seekp( end_of_data );
+            return data_location;
+        }
+        archive_file.seekp( data_location );
+        return free_location;
+    }
+}
 
 bool File::process_the_file(
     std::fstream &archive_stream,
@@ -33,6 +104,13 @@ bool File::process_the_file(
             progress_ptr,
             nullptr);
     }
+    else if (is_solid_member())
+    {
+        // member is decoded from blocks of its solid block(s), which are shared with other members
+        std::ofstream output( path_to_destination + '/' + this->name, std::ios::binary );
+        successful = solid::unpack( archive_stream, *this, output, aborting_var );
+        if (progress_ptr != nullptr) *progress_ptr += 1;
+    }
     else
     {
         archive_stream.seekg(this->data_location);
@@ -69,191 +147,168 @@ std::ostream& operator<<(std::ostream &os, const File &f)
     os << "Parent located at byte " << f.parent_ptr->location << ", ";
     if (f.sibling_ptr) os << "Sibling located at byte " << f.sibling_ptr->location << '\n';
     else os << "there's no sibling\n";
+    if (f.is_solid_member()) {
+        os << "It's in a solid block (at offset " << f.compressed_size << "), or in chunks listed there, with size of " << f.original_size << " bytes." << std::endl;
+        return os;
+    }
     os << "With compressed size of " << f.compressed_size << " bits, and uncompressed size of " << f.original_size << " bytes." << std::endl;
     return os;
 }
 
 
-void File::parse( std::fstream &os, uint64_t pos, Folder* parent ) {
-    uint8_t buffer[8];
-    os.seekg( pos );
+uint64_t File::parse( CentralDirectory& directory, uint64_t pos, Folder* parent ) {
+    std::vector<uint8_t> scratch;
+    const uint8_t* header = directory.get_header( pos, false, scratch );
 
     this->alreadySaved = true;
     this->location = pos;
-    this->name_length = (uint8_t)os.get();
-
-    this->name = std::string(name_length, ' '); // initialising space-filled name_length-long string
-    os.read( &this->name[0], name_length );
+    if (header == nullptr) {
+        std::cout << "File header at byte " << pos << " couldn't be read" << std::endl;
+        return 0;
+    }
 
+    this->name_length = header[0];
+    this->name = std::string( (const char*)header + 1, name_length );
+    header += 1 + name_length;
 
     // Getting location of parent folder in the archive
-    os.read( (char*)buffer, 8 );
-    uint64_t parent_location_test = ((uint64_t)buffer[0]) | ((uint64_t)buffer[1]<<8u) | ((uint64_t)buffer[2]<<16u) | ((uint64_t)buffer[3]<<24u) | ((uint64_t)buffer[4]<<32u) | ((uint64_t)buffer[5]<<40u) | ((uint64_t)buffer[6]<<48u) | ((uint64_t)buffer[7]<<56u);
-
-
+    uint64_t parent_location_test = read_u64( header );
     if (parent_location_test !=0) this->parent_ptr = parent;
 
-
     // Getting location of sibling file in the archive
-    os.read( (char*)buffer, 8 );
-    uint64_t sibling_location_pos = ((uint64_t)buffer[0]) | ((uint64_t)buffer[1]<<8u) | ((uint64_t)buffer[2]<<16u) | ((uint64_t)buffer[3]<<24u) | ((uint64_t)buffer[4]<<32u) | ((uint64_t)buffer[5]<<40u) | ((uint64_t)buffer[6]<<48u) | ((uint64_t)buffer[7]<<56u);
-
+    uint64_t sibling_location_pos = read_u64( header + 8 );
 
     // Getting flags for this file from the archive
-    os.read( (char*)buffer, 2 );
-    this->flags_value = ((uint64_t)buffer[0]) | ((uint64_t)buffer[1]<<8u);
+    this->flags_value = ((uint16_t)header[16]) | ((uint16_t)header[17]<<8u);
 
     // Getting location of compressed data for this file from the archive
-    os.read( (char*)buffer, 8 );
-    this->data_location = ((uint64_t)buffer[0]) | ((uint64_t)buffer[1]<<8u) | ((uint64_t)buffer[2]<<16u) | ((uint64_t)buffer[3]<<24u) | ((uint64_t)buffer[4]<<32u) | ((uint64_t)buffer[5]<<40u) | ((uint64_t)buffer[6]<<48u) | ((uint64_t)buffer[7]<<56u);
-
-
-    // Getting size of compressed data of this file from the archive (in   B I T S)
-    os.read( (char*)buffer, 8 );
-    this->compressed_size = ((uint64_t)buffer[0]) | ((uint64_t)buffer[1]<<8u) | ((uint64_t)buffer[2]<<16u) | ((uint64_t)buffer[3]<<24u) | ((uint64_t)buffer[4]<<32u) | ((uint64_t)buffer[5]<<40u) | ((uint64_t)buffer[6]<<48u) | ((uint64_t)buffer[7]<<56u);
+    this->data_location = read_u64( header + 18 );
 
+    // Getting size of compressed data of this file from the archive
+    this->compressed_size = read_u64( header + 26 );
 
     // Getting size of uncompressed data of this file from the archive
-    os.read( (char*)buffer, 8 );
-    this->original_size = ((uint64_t)buffer[0]) | ((uint64_t)buffer[1]<<8u) | ((uint64_t)buffer[2]<<16u) | ((uint64_t)buffer[3]<<24u) | ((uint64_t)buffer[4]<<32u) | ((uint64_t)buffer[5]<<40u) | ((uint64_t)buffer[6]<<48u) | ((uint64_t)buffer[7]<<56u);
+    this->original_size = read_u64( header + 34 );
 
+    // used by Archive::update() to skip unchanged files, there's no place for it in the header
+    directory.get_stamp( pos, this->modification_time, this->fast_hash );
 
-    if (sibling_location_pos != 0) {  // if there's another file in this dir, parse it too
-        this->sibling_ptr = std::make_unique<File>();
-        uint64_t backup_g = os.tellg();
-        this->sibling_ptr->parse(os, sibling_location_pos, parent);
-        os.seekg( backup_g );
-    }
+    return sibling_location_pos;    // next file in this dir is parsed by the caller, so long lists don't need deep recursion
 }
 
 
-bool File::write_to_archive(
-    std::fstream &archive_file,
-    bool& aborting_var,
-    bool write_siblings,
-    uint16_t* progress_var)
+void File::write_header( uint8_t* buffer ) const
 {
-    bool successful = false;
-    if (!this->alreadySaved and !aborting_var) {
-        this->alreadySaved = true;
-        location = archive_file.tellp();
+    uint32_t bi=0; //buffer index
 
-        if (parent_ptr != nullptr) // correcting current file's location in model, and in the file
-        {
-            if ( parent_ptr->child_file_ptr.get() == this ) {
+    buffer[bi] = name_length;   //writing name length to file
+    bi++;
 
-                uint64_t backup_p = archive_file.tellp();
+    for (uint16_t i=0; i < name_length; i++)    //writing name to file
+        buffer[bi+i] = name[i];
+    bi += name_length;
 
-                archive_file.seekp( parent_ptr->location + 1 + parent_ptr->name_length + 24 ); // seekp( start of child_file_location in archive file )
-                auto buffer = new uint8_t[8];
+    if (parent_ptr)
+        for (uint8_t i = 0; i < 8; i++)
+            buffer[bi + i] = (parent_ptr->location >> (i * 8u)) & 0xFFu;
+    else
+        for (uint8_t i = 0; i < 8; i++)
+            buffer[bi + i] = 0;
+    bi += 8;
 
-                for (uint8_t i=0; i < 8; i++)
-                    buffer[i] = ( location >> (i*8u)) & 0xFFu;
+    if (sibling_ptr)
+        for (uint8_t i=0; i < 8; i++)
+            buffer[bi+i] = (sibling_ptr->location >> (i * 8u)) & 0xFFu;
+    else
+        for (uint8_t i = 0; i < 8; i++)
+            buffer[bi + i] = 0;
+    bi+=8;
 
-                archive_file.write((char*)buffer, 8);
-                delete[] buffer;
+    for (uint8_t i=0; i < 2; i++)
+        buffer[bi+i] = ((unsigned)flags_value >> (i * 8u)) & 0xFFu;
+    bi+=2;
 
-                archive_file.seekp( backup_p );
+    for (uint8_t i=0; i < 8; i++)
+        buffer[bi+i] = (data_location >> (i * 8u)) & 0xFFu;
+    bi+=8;
 
-            }
-            else {
-                File* file_ptr = parent_ptr->child_file_ptr.get(); // location of previous file in the same dir
-                while( file_ptr->sibling_ptr != nullptr )
-                {
-                    if (this != file_ptr->sibling_ptr.get())
-                        file_ptr = file_ptr->sibling_ptr.get();
-                    else
-                        break;
-                }
-
-
-                uint64_t backup_p = archive_file.tellp();
-                archive_file.seekp( file_ptr->location + 1 + file_ptr->name_length + 8 ); // seekp( start of sibling_location in archive file )
-                auto buffer = new uint8_t[8];
-
-                for (uint8_t i=0; i < 8; i++)
-                    buffer[i] = ( location >> (i*8u)) & 0xFFu;
-
-                archive_file.write((char*)buffer, 8);
-                delete[] buffer;
-                archive_file.seekp( backup_p );
-            }
-        }
+    for (uint8_t i=0; i < 8; i++)
+        buffer[bi+i] = (compressed_size >> (i * 8u)) & 0xFFu;
+    bi+=8;
 
+    for (uint8_t i=0; i < 8; i++)
+        buffer[bi+i] = (original_size >> (i * 8u)) & 0xFFu;
+    bi+=8;
 
-        uint32_t buffer_size = base_metadata_size + name_length;
-        auto buffer = new uint8_t[buffer_size];
-        uint32_t bi=0; //buffer index
-
-        buffer[bi] = name_length;   //writing name length to file
-        bi++;
+    assert( bi == (uint32_t)base_metadata_size + name_length );
+}
 
-        for (uint16_t i=0; i < name_length; i++)    //writing name to file
-            buffer[bi+i] = name[i];
-        bi += name_length;
 
-        if (parent_ptr)
-            for (uint8_t i = 0; i < 8; i++)
-                buffer[bi + i] = (parent_ptr->location >> (i * 8u)) & 0xFFu;
-        else
-            for (uint8_t i = 0; i < 8; i++)
-                buffer[bi + i] = 0;
-        bi += 8;
+File::~File()
+{
+    // unique_ptr chain would be destroyed recursively, one stack frame per sibling
+    while (sibling_ptr) sibling_ptr = std::move(sibling_ptr->sibling_ptr);
+}
 
-        if (sibling_ptr)
-            for (uint8_t i=0; i < 8; i++)
-                buffer[bi+i] = (sibling_ptr->location >> (i * 8u)) & 0xFFu;
-        else
-            for (uint8_t i = 0; i < 8; i++)
-                buffer[bi + i] = 0;
-        bi+=8;
 
-        for (uint8_t i=0; i < 2; i++)
-            buffer[bi+i] = ((unsigned)flags_value >> (i * 8u)) & 0xFFu;
-        bi+=2;
+bool File::write_to_archive(
+    std::fstream &archive_file,
+    bool& aborting_var,
+    bool write_siblings,
+    uint16_t* progress_var,
+    AppendJournal* journal,
+    FreeSpace* free_space)
+{
+    bool successful = false;
+    if (!this->alreadySaved and !aborting_var) {
+        this->alreadySaved = true;
 
-        for (uint8_t i=0; i < 8; i++)
-            buffer[bi+i] = (data_location >> (i * 8u)) & 0xFFu;
-        bi+=8;
+        // data goes first, so header is written once, already knowing where the data is, and how big it is
+        // (members of solid blocks have it written already by solid::write_group)
+        if (is_solid_member() and data_location == 0) flags_value &= ~(1u << solid::flag);   // wasn't put into any solid block
+        if (is_solid_member()) successful = true;
+        else {
+            data_location = archive_file.tellp();
+            successful = process_the_file( archive_file, "encoding has it's path in the file object", true, aborting_var, true, progress_var );
+            if (aborting_var) return false;
 
-        for (uint8_t i=0; i < 8; i++)
-            buffer[bi+i] = (compressed_size >> (i * 8u)) & 0xFFu;
-        bi+=8;
+            if (free_space != nullptr) data_location = move_into_free_space( archive_file, *free_space, data_location );
+        }
 
-        for (uint8_t i=0; i < 8; i++)
-            buffer[bi+i] = (original_size >> (i * 8u)) & 0xFFu;
-        bi+=8;
+        uint32_t buffer_size = base_metadata_size + name_length;
+        location = free_space != nullptr ? free_space->allocate( buffer_size ) : 0;
 
-        assert( bi == buffer_size );
-        archive_file.write((char*)buffer, buffer_size);
+        auto buffer = new uint8_t[buffer_size];
+        write_header( buffer );
+        if (location != 0) {
+            archive_file.seekp( location );
+            archive_file.write((char*)buffer, buffer_size);
+            archive_file.seekp( 0, std::ios_base::end );
+        }
+        else {
+            location = archive_file.tellp();
+            archive_file.write((char*)buffer, buffer_size);
+        }
         delete[] buffer;
 
+        // file is linked into the tree only now, so archive never points at a half-written file
+        if (parent_ptr != nullptr)
+        {
+            uint64_t link_position;
+            if ( parent_ptr->child_file_ptr.get() == this ) {
+                link_position = parent_ptr->location + 1 + parent_ptr->name_length + 24;    // child_file_location of parent
+            }
+            else {
+                assert( previous_sibling != nullptr and previous_sibling->sibling_ptr.get() == this );
+                link_position = previous_sibling->location + 1 + previous_sibling->name_length + 8;    // sibling_location of previous file
+            }
 
-        auto backup_end_of_metadata = archive_file.tellp(); // position in file right after the end of metadata
-
-        data_location = backup_end_of_metadata;
-
-        // encoding
-        successful = process_the_file( archive_file, "encoding has it's path in the file object", true, aborting_var, true, progress_var );
-
-        auto backup_p = archive_file.tellp();
-
-        archive_file.seekp( data_location - 24 );
-
-        auto buffer2 = new uint8_t[16];
-
-        for (uint8_t i=0; i < 8; i++)
-            buffer2[i] = (data_location >> (i*8u)) & 0xFFu;
-        for (uint8_t i=0; i < 8; i++)
-            buffer2[i+8] = (compressed_size >> (i*8u)) & 0xFFu;
-
-        archive_file.write((char*)buffer2, 16);
-        delete[] buffer2;
-
-        archive_file.seekp( backup_p );
+            if (journal != nullptr) journal->add( link_position, location );
+            else patch_u64( archive_file, link_position, location );
+        }
     }
 
-    if (sibling_ptr and write_siblings and !aborting_var) sibling_ptr->write_to_archive( archive_file, aborting_var, write_siblings );
+    if (sibling_ptr and write_siblings and !aborting_var) sibling_ptr->write_to_archive( archive_file, aborting_var, write_siblings, nullptr, journal, free_space );
     return successful;
 }
 
@@ -282,7 +337,36 @@ bool File::unpack(
 }
 
 
+bool File::extract_range(
+    std::fstream &os,
+    uint64_t offset,
+    uint64_t length,
+    std::vector<uint8_t>& destination,
+    bool& aborting_var)
+{
+    if (is_solid_member()) return solid::extract( os, *this, offset, length, destination, aborting_var );
+    return multithreading::decode_range( os, this->data_location, this->flags_value, this->original_size,
+                                         this->compressed_size, offset, length, destination, aborting_var );
+}
+
+
+bool File::is_solid_member() const
+{
+    return solid::is_member( this->flags_value );
+}
+
+
+uint64_t File::get_stored_data_size() const
+{
+    if (is_solid_member()) return 0;    // data is in a solid block, together with other files
+    return this->compressed_size
+         + get_checksum_length( get_checksum_type_from_flags(this->flags_value) )
+         + multithreading::get_block_index_size( this->flags_value, this->original_size );
+}
+
+
 std::string File::get_compressed_filesize_str(bool scaled) {
+    if (is_solid_member()) return "solid";  // compressed_size is an offset in solid block then
     std::string units[5] = {"B","KB","MB","GB","TB"};
 
     float filesize = this->compressed_size;
@@ -358,9 +442,10 @@ std::string File::get_uncompressed_filesize_str(bool scaled) {
 }
 
 
-bool File::append_to_archive( std::fstream& archive_file, bool& aborting_var, bool write_siblings, uint16_t* progress_var ) {
+bool File::append_to_archive( std::fstream& archive_file, bool& aborting_var, bool write_siblings, uint16_t* progress_var,
+                              AppendJournal* journal, FreeSpace* free_space ) {
     archive_file.seekp(0, std::ios_base::end);
-    return this->write_to_archive( archive_file, aborting_var, write_siblings, progress_var );
+    return this->write_to_archive( archive_file, aborting_var, write_siblings, progress_var, journal, free_space );
 }
 
 
@@ -381,7 +466,22 @@ void File::set_path( std::filesystem::path extraction_path, bool set_all_paths )
 }
 
 
-void File::copy_to_another_archive( std::fstream& src, std::fstream& dst, uint64_t parent_location, uint64_t previous_sibling_location, uint16_t previous_name_length )
+void File::copy_to_another_archive( std::fstream& src, std::fstream& dst, uint64_t parent_location, uint64_t previous_sibling_location, uint16_t previous_name_length,
+                                    std::unordered_map<uint64_t, uint64_t>* solid_blocks )
+{
+    // siblings are copied in a loop, since recursion would take one stack frame per file of a folder
+    for (File* file = this; file != nullptr; file = file->sibling_ptr.get())
+    {
+        const uint64_t dst_location = file->copy_one_to_another_archive( src, dst, parent_location, previous_sibling_location, previous_name_length, solid_blocks );
+        if (dst_location == 0) continue;
+        previous_sibling_location = dst_location;
+        previous_name_length = file->name_length;
+    }
+}
+
+
+uint64_t File::copy_one_to_another_archive( std::fstream& src, std::fstream& dst, uint64_t parent_location, uint64_t previous_sibling_location, uint16_t previous_name_length,
+                                            std::unordered_map<uint64_t, uint64_t>* solid_blocks )
 {
     if (!this->ptr_already_gotten) {    // if ptr_already_gotten, don't copy this
 
@@ -408,6 +508,26 @@ void File::copy_to_another_archive( std::fstream& src, std::fstream& dst, uint64
         dst.seekp(0, std::ios_base::end);
 
         uint32_t buffer_size = base_metadata_size+name_length;
+        uint64_t total_data_size = this->get_stored_data_size();
+
+        // solid block is copied right after its first member, the others only point at the copy
+        // (chunk list is copied after the header, and solid blocks of its chunks after it)
+        uint64_t copied_solid_block = 0;
+        bool chunk_list = false;
+        if (is_solid_member()) {
+            solid::SolidHeader solid_header;
+            if (!solid::read_header( src, this->data_location, solid_header )) dst.setstate( std::ios::failbit );
+            else if (solid::is_chunk_list( solid_header )) chunk_list = true;
+            else if (solid_blocks != nullptr and solid_blocks->count( this->data_location ) != 0)
+                copied_solid_block = solid_blocks->at( this->data_location );
+            else total_data_size = solid::get_stored_size( solid_header );
+        }
+
+        // big data keeps its offset within a 4 KiB block, so file systems with reflinks can share its blocks (see copy_range)
+        uint64_t padding = 0;
+        if (total_data_size >= (1u << 20))
+            padding = (this->data_location % 4096 + 4096 - (dst_location + buffer_size) % 4096) % 4096;
+
         auto buffer = new uint8_t[buffer_size];
         uint32_t bi=0; //buffer index
 
@@ -436,8 +556,9 @@ void File::copy_to_another_archive( std::fstream& src, std::fstream& dst, uint64
         bi+=2;
 
         // (location of data)
+        const uint64_t dst_data_location = copied_solid_block != 0 ? copied_solid_block : dst_location + buffer_size + padding;
         for (uint8_t i=0; i < 8; i++)
-            buffer[bi+i] = ( (dst_location - this->location + this->data_location) >> (i * 8u)) & 0xFFu;    // potentially broken
+            buffer[bi+i] = (dst_data_location >> (i * 8u)) & 0xFFu;    // in the copy, data goes right after the header (and padding)
         bi+=8;
 
         // (compressed size)
@@ -455,45 +576,32 @@ void File::copy_to_another_archive( std::fstream& src, std::fstream& dst, uint64
         dst.write((char*)buffer, buffer_size);
         delete[] buffer;
 
-        assert( dst.tellp() == dst_location - this->location + this->data_location );
+        assert( (uint64_t)dst.tellp() == dst_location + buffer_size );
 
         assert(this->data_location != 0);
-        src.seekg(this->data_location);
-
-        // copying encoded data + checksum
-
-        uint64_t total_data_size = this->compressed_size;
-        if ((this->flags_value & (1<<15))>>15) // if it's got SHA-1 appended
-        {
-            total_data_size += 40;  // length of SHA-1 in my file (bytes)
+        if (padding != 0) {
+            std::vector<char> zeros( padding, 0 );
+            dst.write( zeros.data(), padding );
         }
-        else if ((this->flags_value & (1<<14))>>14) // if it's got CRC-32 appended
-        {
-            total_data_size += 10;  // length of CRC-32 in my file (bytes)
-        }
-
-        uint32_t output_buffer_size = 4*8*1024;
-        auto output_buffer = new uint8_t[output_buffer_size];
 
-        while ( total_data_size > output_buffer_size )
-        {
-            src.read( (char*)output_buffer, output_buffer_size );
-            total_data_size -= output_buffer_size;
-            dst.write( (char*)output_buffer, output_buffer_size );
+        // copying encoded data + checksum + block index, in the kernel if possible
+        dst.flush();
+        PositionalFile source, destination;
+        if (!source.attach( src ) or !destination.attach( dst )
+            or !copy_range( source, this->data_location, destination, dst_location + buffer_size + padding, total_data_size ))
+            dst.setstate( std::ios::failbit );
+        dst.seekp( dst_location + buffer_size + padding + total_data_size );
+        if (chunk_list) {
+            std::unordered_map<uint64_t, uint64_t> copied_blocks;
+            if (DedupStore::copy_chunk_list( src, dst, this->data_location, solid_blocks != nullptr ? *solid_blocks : copied_blocks ) != dst_data_location)
+                dst.setstate( std::ios::failbit );
         }
+        else if (is_solid_member() and copied_solid_block == 0 and solid_blocks != nullptr)
+            solid_blocks->emplace( this->data_location, dst_data_location );
 
-        src.read( (char*)output_buffer, total_data_size );
-        dst.write( (char*)output_buffer, total_data_size );
-
-        delete[] output_buffer;
-
-
-        if (sibling_ptr) sibling_ptr->copy_to_another_archive(src, dst, parent_location, dst_location, this->name_length);
-    }
-    else if (sibling_ptr){
-        assert(previous_sibling_location < UINT32_MAX);
-        sibling_ptr->copy_to_another_archive(src, dst, parent_location, previous_sibling_location, previous_name_length);
+        return dst_location;
     }
+    return 0;
 }
 
 // Folder methods below
@@ -511,6 +619,13 @@ Folder::Folder( Folder* parent, std::string folder_name ) :
     parent_ptr(parent) {}
 
 
+Folder::~Folder()
+{
+    // unique_ptr chain would be destroyed recursively, one stack frame per sibling
+    while (sibling_ptr) sibling_ptr = std::move(sibling_ptr->sibling_ptr);
+}
+
+
 void Folder::recursive_print(std::ostream &os) const {
     os << *this << '\n';
     if (child_file_ptr) child_file_ptr->recursive_print( os );
@@ -531,180 +646,230 @@ std::ostream& operator<<(std::ostream& os, const Folder& f){
     else os << "There's no child folder, ";
     if (f.child_file_ptr) os << "child file located at byte " << f.child_file_ptr->location << std::endl;
     else os << "there's no child file." << std::endl;
+    if (!f.children_parsed) os << "Children weren't parsed yet." << std::endl;
 
     return os;
 }
 
 
-void Folder::parse( std::fstream &os, uint64_t pos, Folder* parent, std::unique_ptr<Folder> &shared_this  )
+uint64_t Folder::parse( CentralDirectory& directory, uint64_t pos, Folder* parent )
 {
-    uint8_t buffer[8];
-    os.seekg( pos );
+    std::vector<uint8_t> scratch;
+    const uint8_t* header = directory.get_header( pos, true, scratch );
 
     this->alreadySaved = true;
     this->location = pos;
-    this->name_length = (uint8_t)os.get();
-
-    this->name = std::string(name_length, ' '); // initialising empty string name_length-long
-    os.read( &this->name[0], name_length );
+    if (header == nullptr) {
+        std::cout << "Folder header at byte " << pos << " couldn't be read" << std::endl;
+        return 0;
+    }
 
-    os.read( (char*)buffer, 8 );
-    uint64_t parent_pos_in_file = ((uint64_t)buffer[0]) | ((uint64_t)buffer[1]<<8u) | ((uint64_t)buffer[2]<<16u) | ((uint64_t)buffer[3]<<24u) | ((uint64_t)buffer[4]<<32u) | ((uint64_t)buffer[5]<<40u) | ((uint64_t)buffer[6]<<48u) | ((uint64_t)buffer[7]<<56u);
+    this->name_length = header[0];
+    this->name = std::string( (const char*)header + 1, name_length );
+    header += 1 + name_length;
 
+    uint64_t parent_pos_in_file = read_u64( header );
     if (parent_pos_in_file !=0) this->parent_ptr = parent;
 
+    this->child_dir_location = read_u64( header + 8 );
+    uint64_t sibling_pos_in_file = read_u64( header + 16 );
+    this->child_file_location = read_u64( header + 24 );
 
-    os.read( (char*)buffer, 8 );
-    uint64_t child_dir_pos_in_file = ((uint64_t)buffer[0]) | ((uint64_t)buffer[1]<<8u) | ((uint64_t)buffer[2]<<16u) | ((uint64_t)buffer[3]<<24u) | ((uint64_t)buffer[4]<<32u) | ((uint64_t)buffer[5]<<40u) | ((uint64_t)buffer[6]<<48u) | ((uint64_t)buffer[7]<<56u);
+    // children are parsed later, only if something needs them (e.g. folder is expanded in GUI)
+    this->header_source = &directory;
+    this->children_parsed = child_dir_location == 0 and child_file_location == 0;
+
+    return sibling_pos_in_file;
+}
 
 
+void Folder::parse_children( bool recursively )
+{
+    if (!this->children_parsed) {
+        this->children_parsed = true;
+        assert(header_source != nullptr);
+
+        // siblings are parsed in a loop, one folder can have millions of files
+        // headers put into free space can point backwards, but a list which loops means the archive is corrupted
+        uint64_t next_location = child_dir_location;
+        LoopGuard folder_guard;
+        while (next_location != 0) {
+            Folder* new_folder = this->append_folder( std::make_unique<Folder>() ).get();
+            next_location = new_folder->parse( *header_source, next_location, this );
+            if (next_location != 0 and folder_guard.seen( next_location )) {
+                std::cout << "Folder " << new_folder->name << " points to a previous header, archive is corrupted" << std::endl;
+                break;
+            }
+        }
 
-    if (child_dir_pos_in_file !=0) {
-        this->child_dir_ptr = std::make_unique<Folder>();
-        uint64_t backup_g = os.tellg();
-        this->child_dir_ptr->parse(os, child_dir_pos_in_file, shared_this.get(), child_dir_ptr );
-        os.seekg( backup_g );
+        next_location = child_file_location;
+        LoopGuard file_guard;
+        while (next_location != 0) {
+            File* new_file = this->append_file( std::make_unique<File>() ).get();
+            next_location = new_file->parse( *header_source, next_location, this );
+            if (next_location != 0 and file_guard.seen( next_location )) {
+                std::cout << "File " << new_file->name << " points to a previous header, archive is corrupted" << std::endl;
+                break;
+            }
+        }
     }
 
+    if (recursively)
+        for (Folder* child = child_dir_ptr.get(); child != nullptr; child = child->sibling_ptr.get())
+            child->parse_children( true );
+}
 
-    os.read( (char*)buffer, 8 );
-    uint64_t sibling_pos_in_file = ((uint64_t)buffer[0]) | ((uint64_t)buffer[1]<<8u) | ((uint64_t)buffer[2]<<16u) | ((uint64_t)buffer[3]<<24u) | ((uint64_t)buffer[4]<<32u) | ((uint64_t)buffer[5]<<40u) | ((uint64_t)buffer[6]<<48u) | ((uint64_t)buffer[7]<<56u);
 
-    if (sibling_pos_in_file != 0) {
-        this->sibling_ptr = std::make_unique<Folder>();
-        uint64_t backup_g = os.tellg();
-        this->sibling_ptr->parse(os, sibling_pos_in_file, parent, sibling_ptr);
-        os.seekg( backup_g );
-    }
+std::unique_ptr<Folder>& Folder::append_folder( std::unique_ptr<Folder> new_folder )
+{
+    if (names_indexed) folder_names.emplace( new_folder->name, new_folder.get() );
+
+    std::unique_ptr<Folder>& owner = last_child_dir != nullptr ? last_child_dir->sibling_ptr : child_dir_ptr;
+    assert(owner == nullptr);
+    new_folder->previous_sibling = last_child_dir;
+    owner = std::move(new_folder);
+    last_child_dir = owner.get();
+    return owner;
+}
 
 
-    os.read( (char*)buffer, 8 );
-    uint64_t child_file_pos_in_file = ((uint64_t)buffer[0]) | ((uint64_t)buffer[1]<<8u) | ((uint64_t)buffer[2]<<16u) | ((uint64_t)buffer[3]<<24u) | ((uint64_t)buffer[4]<<32u) | ((uint64_t)buffer[5]<<40u) | ((uint64_t)buffer[6]<<48u) | ((uint64_t)buffer[7]<<56u);
+std::unique_ptr<File>& Folder::append_file( std::unique_ptr<File> new_file )
+{
+    if (names_indexed) file_names.emplace( new_file->name, new_file.get() );
+
+    std::unique_ptr<File>& owner = last_child_file != nullptr ? last_child_file->sibling_ptr : child_file_ptr;
+    assert(owner == nullptr);
+    new_file->previous_sibling = last_child_file;
+    owner = std::move(new_file);
+    last_child_file = owner.get();
+    return owner;
+}
 
 
-    if (child_file_pos_in_file != 0) {
-        this->child_file_ptr = std::make_unique<File>();
-        uint64_t backup_g = os.tellg();
-        this->child_file_ptr->parse(os, child_file_pos_in_file, shared_this.get() ); // Seemingly implemented
-        os.seekg( backup_g );
-    }
+void Folder::index_names()
+{
+    if (names_indexed) return;
+    this->parse_children();
+
+    folder_names.clear();
+    file_names.clear();
+    for (Folder* folder = child_dir_ptr.get(); folder != nullptr; folder = folder->sibling_ptr.get())
+        folder_names.emplace( folder->name, folder );   // with duplicate names, the first one is found
+    for (File* file = child_file_ptr.get(); file != nullptr; file = file->sibling_ptr.get())
+        file_names.emplace( file->name, file );
+    names_indexed = true;
 }
 
 
-void Folder::append_to_archive( std::fstream& archive_file, bool& aborting_var ) {
-    archive_file.seekp(0, std::ios_base::end);
-    this->write_to_archive( archive_file, aborting_var );
+Folder* Folder::find_folder( const std::string& folder_name )
+{
+    index_names();
+    auto found = folder_names.find( folder_name );
+    return found != folder_names.end() ? found->second : nullptr;
 }
 
 
-void Folder::write_to_archive( std::fstream &archive_file, bool& aborting_var ) {
-
-    if (!this->alreadySaved) {
-        this->alreadySaved = true;
-        location = archive_file.tellp();
+File* Folder::find_file( const std::string& file_name )
+{
+    index_names();
+    auto found = file_names.find( file_name );
+    return found != file_names.end() ? found->second : nullptr;
+}
 
-        if (parent_ptr != nullptr) { // correcting current dir's location in model, and in file
-            if ( parent_ptr->child_dir_ptr.get() == this ) {
-                // updating parent's knowledge of it's firstborn's location in file
-                uint64_t backup_p = archive_file.tellp();
 
-                archive_file.seekp( parent_ptr->location + 1 + parent_ptr->name_length + 8 ); // seekp( start of child_dir_location in archive file )
-                auto buffer = new uint8_t[8];
+void Folder::rename_file( File* file, const std::string& new_name )
+{
+    if (names_indexed) {
+        auto found = file_names.find( file->name );
+        if (found != file_names.end() and found->second == file) file_names.erase( found );
+        file_names.emplace( new_name, file );
+    }
+    file->name = new_name;
+    file->name_length = new_name.length();
+}
 
-                for (uint8_t i=0; i < 8; i++)
-                    buffer[i] = ( location >> (i*8u)) & 0xFFu;
 
-                archive_file.write((char*)buffer, 8);
-                delete[] buffer;
+void Folder::write_header( uint8_t* buffer ) const
+{
+    uint32_t bi=0; //buffer index
 
-                archive_file.seekp( backup_p );
-            }
-            else {
-                Folder* previous_folder = parent_ptr->child_dir_ptr.get();
-                while( previous_folder->sibling_ptr != nullptr )
-                {
-                    if (this != previous_folder->sibling_ptr.get())
-                        previous_folder = previous_folder->sibling_ptr.get();
-                    else
-                        break;
-                }
-
-                uint64_t backup_p = archive_file.tellp();
-                archive_file.seekp( previous_folder->location + 1 + previous_folder->name_length + 16 ); // seekp( start of sibling_location in archive file )
-                auto buffer = new uint8_t[8];
-
-                for (uint8_t i=0; i < 8; i++)
-                    buffer[i] = ( location >> (i*8u)) & 0xFFu;
-
-                archive_file.write((char*)buffer, 8);
-                delete[] buffer;
-
-                archive_file.seekp( backup_p );
-            }
-        }
+    buffer[bi] = name_length;   //writing name length to file
+    bi++;
 
-        uint32_t buffer_size = base_metadata_size+name_length;
-        auto buffer = new uint8_t[buffer_size];
-        uint32_t bi=0; //buffer index
+    for (uint16_t i=0; i < name_length; i++)    //writing name to file
+        buffer[bi+i] = name[i];
+    bi += name_length;
 
-        buffer[bi] = name_length;   //writing name length to file
-        bi++;
+    if (parent_ptr)
+        for (uint8_t i = 0; i < 8; i++)
+            buffer[bi + i] = (parent_ptr->location >> (i * 8u)) & 0xFFu;
+    else
+        for (uint8_t i = 0; i < 8; i++)
+            buffer[bi + i] = 0;
+    bi += 8;
 
-        for (uint16_t i=0; i < name_length; i++)    //writing name to file
-            buffer[bi+i] = name[i];
-        bi += name_length;
+    // children which weren't parsed are only known by their locations
+    uint64_t first_dir_location = children_parsed ? 0 : child_dir_location;
+    if (child_dir_ptr) first_dir_location = child_dir_ptr->location;
+    for (uint8_t i=0; i < 8; i++)
+        buffer[bi+i] = (first_dir_location >> (i*8u)) & 0xFFu;
+    bi+=8;
 
-        if (parent_ptr)
-            for (uint8_t i = 0; i < 8; i++)
-                buffer[bi + i] = (parent_ptr->location >> (i * 8u)) & 0xFFu;
-        else
-            for (uint8_t i = 0; i < 8; i++)
-                buffer[bi + i] = 0;
+    if (sibling_ptr) {
+        for (uint8_t i = 0; i < 8; i++)
+            buffer[bi + i] = (sibling_ptr->location >> (i * 8u)) & 0xFFu;
         bi += 8;
+    } else {
+        for (uint8_t i = 0; i < 8; i++)
+            buffer[bi + i] = 0;
+        bi += 8;
+    }
 
-        if (child_dir_ptr)
-            for (uint8_t i=0; i < 8; i++)
-                buffer[bi+i] = (child_dir_ptr->location >> (i*8u)) & 0xFFu;
-        else
-            for (uint8_t i = 0; i < 8; i++)
-                buffer[bi + i] = 0;
-        bi+=8;
+    uint64_t first_file_location = children_parsed ? 0 : child_file_location;
+    if (child_file_ptr) first_file_location = child_file_ptr->location;
+    for (uint8_t i=0; i < 8; i++)
+        buffer[bi+i] = (first_file_location >> (i*8u)) & 0xFFu;
+    bi+=8;
 
-        if (sibling_ptr) {
-            for (uint8_t i = 0; i < 8; i++)
-                buffer[bi + i] = (sibling_ptr->location >> (i * 8u)) & 0xFFu;
-            bi += 8;
-        } else {
-            for (uint8_t i = 0; i < 8; i++)
-                buffer[bi + i] = 0;
-            bi += 8;
-        }
+    assert( bi == (uint32_t)base_metadata_size + name_length );
+}
 
-        if (child_file_ptr)
-            for (uint8_t i=0; i < 8; i++)
-                buffer[bi+i] = (child_file_ptr->location >> (i*8u)) & 0xFFu;
-        else
-            for (uint8_t i=0; i < 8; i++)
-                buffer[bi+i] = 0;
 
-        assert( bi+8 == buffer_size );
-        archive_file.write((char*)buffer, buffer_size);
-        delete[] buffer;
-    }
+bool Folder::append_to_archive( std::fstream& archive_file, AppendJournal* journal ) {
+    if (this->alreadySaved) return true;
 
-    if (sibling_ptr)
-        sibling_ptr->write_to_archive( archive_file, aborting_var );
-
-    if (child_file_ptr)
-        child_file_ptr->write_to_archive( archive_file, aborting_var );
+    archive_file.seekp(0, std::ios_base::end);
+    location = archive_file.tellp();
+
+    uint32_t buffer_size = base_metadata_size + name_length;
+    auto buffer = new uint8_t[buffer_size];
+    write_header( buffer );
+    archive_file.write((char*)buffer, buffer_size);
+    delete[] buffer;
+    if (!archive_file.good()) return false;
+    this->alreadySaved = true;
 
-    if (child_dir_ptr)
-        child_dir_ptr->write_to_archive( archive_file, aborting_var );
+    // folder is linked into the tree only now, so archive never points at a half-written header
+    if (parent_ptr != nullptr)
+    {
+        uint64_t link_position;
+        if (previous_sibling == nullptr) {
+            assert( parent_ptr->child_dir_ptr.get() == this );
+            link_position = parent_ptr->location + 1 + parent_ptr->name_length + 8;    // child_dir_location of parent
+        }
+        else {
+            assert( previous_sibling->sibling_ptr.get() == this );
+            link_position = previous_sibling->location + 1 + previous_sibling->name_length + 16;    // sibling_location of previous folder
+        }
 
+        if (journal != nullptr) journal->add( link_position, location );
+        else patch_u64( archive_file, link_position, location );
+    }
+    return true;
 }
 
 
-void Folder::unpack( const std::filesystem::path& target_path, std::fstream &os, bool& aborting_var, bool unpack_all ) const
+void Folder::unpack( const std::filesystem::path& target_path, std::fstream &os, bool& aborting_var, bool unpack_all )
 {
     std::string temp_name;
     if (this->parent_ptr == nullptr) temp_name = std::filesystem::path(this->name).stem();
@@ -715,6 +880,7 @@ void Folder::unpack( const std::filesystem::path& target_path, std::fstream &os,
         std::filesystem::create_directories( path_with_this_folder );
 
     if (unpack_all) {
+        this->parse_children();
         if( sibling_ptr != nullptr )
             sibling_ptr->unpack(target_path, os, aborting_var, unpack_all);
         if( child_dir_ptr != nullptr )
@@ -727,6 +893,7 @@ void Folder::unpack( const std::filesystem::path& target_path, std::fstream &os,
 
 
 void Folder::get_ptrs( std::vector<Folder*>& folders, std::vector<File*>& files ) {
+    this->parse_children();
     if ( !this->ptr_already_gotten ) {
         folders.emplace_back( this );
         this->ptr_already_gotten = true;
@@ -739,6 +906,7 @@ void Folder::get_ptrs( std::vector<Folder*>& folders, std::vector<File*>& files
 
 
 void Folder::set_path( std::filesystem::path extraction_path, bool set_all_paths ) {
+    if (set_all_paths) this->parse_children();
     auto folder_path = extraction_path;
 
     if ( this->ptr_already_gotten ) {
@@ -758,55 +926,38 @@ void Folder::set_path( std::filesystem::path extraction_path, bool set_all_paths
 }
 
 
-void Folder::copy_to_another_archive( std::fstream& src, std::fstream& dst, uint64_t parent_location, uint64_t previous_sibling_location )
+void Folder::copy_to_another_archive( std::fstream& src, std::fstream& dst, uint64_t parent_location, uint64_t previous_sibling_location,
+                                      uint16_t previous_name_length, std::unordered_map<uint64_t, uint64_t>* solid_blocks )
+{
+    // siblings are copied in a loop, like in File::copy_to_another_archive, only nesting of folders takes stack frames
+    for (Folder* folder = this; folder != nullptr; folder = folder->sibling_ptr.get())
+    {
+        const uint64_t dst_location = folder->copy_one_to_another_archive( src, dst, parent_location, previous_sibling_location, previous_name_length, solid_blocks );
+        if (dst_location == 0) continue;
+        previous_sibling_location = dst_location;
+        previous_name_length = folder->name_length;
+    }
+}
+
+
+uint64_t Folder::copy_one_to_another_archive( std::fstream& src, std::fstream& dst, uint64_t parent_location, uint64_t previous_sibling_location,
+                                              uint16_t previous_name_length, std::unordered_map<uint64_t, uint64_t>* solid_blocks )
 {
     if (!this->ptr_already_gotten) {    // if ptr_already_gotten, don't copy this
+        this->parse_children();
         src.seekg(this->location);
         uint64_t dst_location = dst.tellp();
 
         if (parent_location != 0)
         {
-            if ( parent_ptr->child_dir_ptr.get() == this ) {
-                assert(previous_sibling_location == 0);
-
+            if ( previous_sibling_location == 0 ) {
                 // update parent's knowledge of it's firstborn's location in file
-
-                uint64_t backup_p = dst.tellp();
-
-                dst.seekp( parent_location + 1 + parent_ptr->name_length + 8 ); // seekp( start of child_dir_location in the new archive )
-                auto buffer = new uint8_t[8];
-
-                for (uint8_t i=0; i < 8; i++)
-                    buffer[i] = ( dst_location >> (i*8u)) & 0xFFu;
-
-                dst.write((char*)buffer, 8);
-                delete[] buffer;
-
-                dst.seekp( backup_p );
+                patch_u64( dst, parent_location + 1 + parent_ptr->name_length + 8, dst_location );    // child_dir_location in the new archive
             }
             else {
-                assert(previous_sibling_location != 0);
+                assert(previous_name_length != 0 and previous_name_length < 256);
                 // update previous sibling's knowledge of it's next sibling's location
-                Folder* previous_folder = parent_ptr->child_dir_ptr.get();
-                while( previous_folder->sibling_ptr != nullptr )
-                {
-                    if (this != previous_folder->sibling_ptr.get())
-                        previous_folder = previous_folder->sibling_ptr.get();
-                    else
-                        break;
-                }
-
-                uint64_t backup_p = dst.tellp();
-                dst.seekp( previous_sibling_location + 1 + previous_folder->name_length + 16 ); // seekp( start of sibling_location in archive file )
-                auto buffer = new uint8_t[8];
-
-                for (uint8_t i=0; i < 8; i++)
-                    buffer[i] = ( dst_location >> (i*8u)) & 0xFFu;
-
-                dst.write((char*)buffer, 8);
-                delete[] buffer;
-
-                dst.seekp( backup_p );
+                patch_u64( dst, previous_sibling_location + 1 + previous_name_length + 16, dst_location );    // sibling_location in the new archive
             }
         }
 
@@ -851,12 +1002,9 @@ void Folder::copy_to_another_archive( std::fstream& src, std::fstream& dst, uint
         dst.write((char*)buffer, buffer_size);
         delete[] buffer;
 
-        if (sibling_ptr) sibling_ptr->copy_to_another_archive(src, dst, parent_location, dst_location);
-        if (child_file_ptr) child_file_ptr->copy_to_another_archive(src, dst, dst_location, 0, 0);
-        if (child_dir_ptr) child_dir_ptr->copy_to_another_archive(src, dst, dst_location, 0);
-    }
-    else
-    {
-        if (sibling_ptr) sibling_ptr->copy_to_another_archive(src, dst, parent_location, previous_sibling_location);
+        if (child_file_ptr) child_file_ptr->copy_to_another_archive(src, dst, dst_location, 0, 0, solid_blocks);
+        if (child_dir_ptr) child_dir_ptr->copy_to_another_archive(src, dst, dst_location, 0, 0, solid_blocks);
+        return dst_location;
     }
+    return 0;
 }
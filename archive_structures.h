@@ -6,6 +6,7 @@
 #include <filesystem>
 #include <thread>
 #include <vector>
+#include <unordered_map>
 
 #include "compression.h"
 #include "integrity_validation.h"
@@ -13,6 +14,9 @@
 
 
 struct File;
+class CentralDirectory;
+class AppendJournal;
+class FreeSpace;
 
 struct Folder
 {
@@ -35,22 +39,61 @@ struct Folder
 
     std::unique_ptr<File> child_file_ptr=nullptr;   // ptr to first file in memory
 
+    Folder* last_child_dir = nullptr;               // last subfolder and last file, so appending doesn't walk the whole list
+    File* last_child_file = nullptr;
+    Folder* previous_sibling = nullptr;             // set by append_folder, so linking the folder doesn't walk the whole list
+
+    bool names_indexed = false;                     // true - maps below are built (by find_folder/find_file), and kept up to date
+    std::unordered_map<std::string, Folder*> folder_names;
+    std::unordered_map<std::string, File*> file_names;
+
+    bool children_parsed = true;                    // false - folder was loaded from archive, but its children weren't needed yet
+    uint64_t child_dir_location = 0;                // location of first subfolder in archive, until children are parsed
+    uint64_t child_file_location = 0;               // location of first file in archive, until children are parsed
+    CentralDirectory* header_source = nullptr;      // where headers of children are read from, until they're parsed
+
     Folder( std::unique_ptr<Folder> &parent, std::string folder_name );
     Folder( Folder* parent, std::string folder_name );
+    ~Folder();
 
     void recursive_print(std::ostream &os) const;
 
     friend std::ostream& operator<<(std::ostream& os, const Folder& f);
 
-    void parse( std::fstream &os, uint64_t pos, Folder* parent, std::unique_ptr<Folder> &shared_this  );
+    uint64_t parse( CentralDirectory& directory, uint64_t pos, Folder* parent );
+    // parses only this folder, returns location of its next sibling (0 if there's none)
+    // children are parsed by parse_children(), when they're needed
+
+    void parse_children( bool recursively = false );
+
+    bool may_have_children() const { return !children_parsed or child_dir_ptr or child_file_ptr; }
+
+    // Adds child at the end of the list, in O(1), returns unique_ptr which owns it now
+    std::unique_ptr<Folder>& append_folder( std::unique_ptr<Folder> new_folder );
+    std::unique_ptr<File>& append_file( std::unique_ptr<File> new_file );
+
+    // Finds direct child by name with a hash map (built on first call), nullptr if there's none
+    Folder* find_folder( const std::string& folder_name );
+    File* find_file( const std::string& file_name );
+    void rename_file( File* file, const std::string& new_name );   // keeps the map up to date
+    void index_names();
+
+    void write_header( uint8_t* buffer ) const;     // base_metadata_size + name_length bytes, as saved in archive
 
-    void append_to_archive( std::fstream& archive_file, bool& aborting_var );
+    // Writes header of this folder at the end of archive, and only then links it to its parent or previous sibling,
+    // through journal if it's given. Folder is appended while it's empty, its children link themselves later.
+    bool append_to_archive( std::fstream& archive_file, AppendJournal* journal = nullptr );
 
-    void write_to_archive( std::fstream& archive_file, bool& aborting_var );
+    void unpack( const std::filesystem::path& target_path, std::fstream &os, bool& aborting_var, bool unpack_all );
 
-    void unpack( const std::filesystem::path& target_path, std::fstream &os, bool& aborting_var, bool unpack_all ) const;
+    void copy_to_another_archive( std::fstream& source, std::fstream& destination, uint64_t parent_location, uint64_t previous_sibling_location,
+                                  uint16_t previous_name_length, std::unordered_map<uint64_t, uint64_t>* solid_blocks = nullptr );
+    // copies this folder and its siblings (with their children), which weren't gotten by get_ptrs
+    // solid_blocks - old location -> location in destination, of solid blocks already copied (each is copied only once)
 
-    void copy_to_another_archive( std::fstream& source, std::fstream& destination, uint64_t parent_location, uint64_t previous_sibling_location );
+    uint64_t copy_one_to_another_archive( std::fstream& source, std::fstream& destination, uint64_t parent_location, uint64_t previous_sibling_location,
+                                          uint16_t previous_name_length, std::unordered_map<uint64_t, uint64_t>* solid_blocks );
+    // the same without siblings, returns location of the copy (0 if it was skipped)
 
     void get_ptrs( std::vector<Folder*>& folders, std::vector<File*>& files );
 
@@ -75,13 +118,19 @@ struct File
     bool ptr_already_gotten = false;                // true - method get_ptrs was already used on it, so it's in the vector
 
     std::unique_ptr<File> sibling_ptr=nullptr;      // ptr to next sibling file in memory
+    File* previous_sibling = nullptr;               // set by Folder::append_file, so linking the file doesn't walk the whole list
 
     uint16_t flags_value=0;                         // 16 flags represented as 16-bit int
 
     uint64_t data_location=0;                       // location of data in archive (in bytes)
-    uint64_t compressed_size=0;                     // size of compressed data (in bytes)
+    uint64_t compressed_size=0;                     // size of compressed data (in bytes), or offset in solid block (flag 6)
     uint64_t original_size=0;                       // size of data before compression (in bytes)
 
+    int64_t modification_time=0;                    // last write time of source file (ns since 1970), 0 - unknown
+    uint64_t fast_hash=0;                           // XXH3-64 of source file, 0 - unknown (both are kept in central directory)
+
+    ~File();
+
     bool process_the_file(std::fstream &archive_stream, const std::string& path_to_destination, bool decode, bool& aborting_var,
                          bool validate_integrity = true, uint16_t* progress_ptr = nullptr );
 
@@ -89,20 +138,40 @@ struct File
 
     friend std::ostream& operator<<(std::ostream &os, const File &f);
 
-    void parse( std::fstream &os, uint64_t pos, Folder* parent );
+    uint64_t parse( CentralDirectory& directory, uint64_t pos, Folder* parent );
+    // returns location of the next file in the same folder (0 if there's none)
 
-    bool append_to_archive( std::fstream& archive_file, bool& aborting_var, bool write_siblings = true, uint16_t* progress_var = nullptr );
+    void write_header( uint8_t* buffer ) const;     // base_metadata_size + name_length bytes, as saved in archive
 
-    bool write_to_archive( std::fstream& archive_file, bool& aborting_var, bool write_siblings = true, uint16_t* progress_var = nullptr );
+    bool append_to_archive( std::fstream& archive_file, bool& aborting_var, bool write_siblings = true, uint16_t* progress_var = nullptr,
+                            AppendJournal* journal = nullptr, FreeSpace* free_space = nullptr );
+
+    bool write_to_archive( std::fstream& archive_file, bool& aborting_var, bool write_siblings = true, uint16_t* progress_var = nullptr,
+                           AppendJournal* journal = nullptr, FreeSpace* free_space = nullptr );
+    // with journal, file isn't linked into the tree until the journal is committed
+    // with free_space, data and header are moved into unused ranges of archive, if they fit somewhere
 
     bool unpack( const std::string& path, std::fstream &os, bool& aborting_var, bool unpack_all, bool validate_integrity = true, uint16_t* progress_var = nullptr );
     // returns bool which indicates whether decompression was successful
 
+    bool extract_range( std::fstream &os, uint64_t offset, uint64_t length, std::vector<uint8_t>& destination, bool& aborting_var );
+    // decodes only blocks needed for given range of the file (fast with block index, flag 5)
+
+    bool is_solid_member() const;                   // flag 6, data is in a solid block shared with other files (see misc/solid_block.h)
+
+    uint64_t get_stored_data_size() const;          // compressed data + checksum + block index (in bytes), 0 for members of solid blocks
+
     std::string get_compressed_filesize_str(bool scaled);
 
     std::string get_uncompressed_filesize_str(bool scaled);
 
-    void copy_to_another_archive( std::fstream& source, std::fstream& destination, uint64_t parent_location, uint64_t previous_sibling_location, uint16_t previous_name_length );
+    void copy_to_another_archive( std::fstream& source, std::fstream& destination, uint64_t parent_location, uint64_t previous_sibling_location, uint16_t previous_name_length,
+                                  std::unordered_map<uint64_t, uint64_t>* solid_blocks = nullptr );
+    // copies this file and its siblings, which weren't gotten by get_ptrs
+
+    uint64_t copy_one_to_another_archive( std::fstream& source, std::fstream& destination, uint64_t parent_location, uint64_t previous_sibling_location, uint16_t previous_name_length,
+                                          std::unordered_map<uint64_t, uint64_t>* solid_blocks );
+    // the same without siblings, returns location of the copy (0 if it was skipped)
 
     void get_ptrs( std::vector<File*>& files, bool get_siblings_too = false );
 
@@ -23,6 +23,10 @@ ArchiveWindow::ArchiveWindow(QWidget *parent)
 
     QAction *settingsAction = ui->menubar->addAction("Settings");
     connect( settingsAction,            &QAction::triggered,    this, &ArchiveWindow::open_settings_dialog );
+    QAction *compactAction = ui->menuFiles->addAction("Compact");
+    connect( compactAction,             &QAction::triggered,    this, &ArchiveWindow::compact_archive_triggered );
+    QAction *updateAction = ui->menuFiles->addAction("Update from folder...");
+    connect( updateAction,              &QAction::triggered,    this, &ArchiveWindow::update_archive_triggered );
     connect( ui->buttonRemoveSelected,  &QPushButton::clicked,  this, &ArchiveWindow::remove_selected_clicked );
     connect( ui->actionNewArchive,      &QAction::triggered,    this, &ArchiveWindow::new_archive_triggered );
     connect( ui->actionOpenArchive,     &QAction::triggered,    this, &ArchiveWindow::open_archive_triggered );
@@ -30,6 +34,7 @@ ArchiveWindow::ArchiveWindow(QWidget *parent)
     connect( ui->buttonExtractAll,      &QPushButton::clicked,  this, &ArchiveWindow::extract_all_clicked );
     connect( ui->buttonAddNewFile,      &QPushButton::clicked,  this, &ArchiveWindow::add_new_file_clicked );
     connect( ui->buttonAddNewFolder,    &QPushButton::clicked,  this, &ArchiveWindow::add_new_folder_clicked );
+    connect( ui->archiveWidget,         &QTreeWidget::itemExpanded, this, &ArchiveWindow::archive_item_expanded );
 
     // loading stylesheets (if they exist)
     QFile style_file_dark(":/dark.qss");
@@ -73,26 +78,29 @@ void ArchiveWindow::load_archive( std::string path_to_archive ) {
 
     ui->archiveWidget->addTopLevelItem( new TreeWidgetFolder( ui->archiveWidget->invisibleRootItem(), archive_ptr->root_folder.get(), archive_ptr, config_ptr->get_filesize_scaling() ) );
     ui->archiveWidget->topLevelItem(0)->setText(0, QString::fromStdString(std::filesystem::path(path_to_archive).filename()));
-    this->ui->archiveWidget->expandAll();
+    // only the first level, deeper folders are parsed when they're expanded
+    static_cast<TreeWidgetFolder*>(ui->archiveWidget->topLevelItem(0))->add_children();
+    ui->archiveWidget->topLevelItem(0)->setExpanded(true);
 
     this->ui->archiveWidget->sortByColumn(0, Qt::SortOrder::AscendingOrder);
 }
 
 
-void ArchiveWindow::reload_archive() {
-    this->new_archive_model();
-    this->load_archive( current_archive_path );
+void ArchiveWindow::archive_item_expanded( QTreeWidgetItem* item ) {
+    if (item->type() == 1001) static_cast<TreeWidgetFolder*>(item)->add_children();   // 1001 == TreeWidgetFolder
 }
 
 
-void ArchiveWindow::write_file_to_current_archive( File* file_ptr, bool& aborting_var )
-{
-    file_ptr->append_to_archive( this->archive_ptr->archive_file, aborting_var );
+void ArchiveWindow::reload_archive() {
+    this->new_archive_model();
+    this->load_archive( current_archive_path );
 }
 
 
-void ArchiveWindow::write_folder_to_current_archive( Folder* folder_model, bool& aborting_var ) {
-    folder_model->append_to_archive( this->archive_ptr->archive_file, aborting_var );
+void ArchiveWindow::write_folder_to_current_archive( Folder* folder_model ) {
+    this->archive_ptr->remove_central_directory();
+    if (!this->archive_ptr->append_folders( { folder_model } )) this->archive_ptr->reread_tree();
+    this->archive_ptr->write_central_directory();
     this->reload_archive();
 }
 
@@ -244,24 +252,10 @@ void ArchiveWindow::remove_selected_clicked()
                 }
             }
 
-            for (auto single_folder : folders) single_folder->get_ptrs( folders, files );
-            for (auto single_file   : files  ) single_file->get_ptrs( files );
-
-
-            std::fstream dst(temp_path, std::ios::binary | std::ios::out);
-            assert(dst.is_open());
-
-            dst.put(0);  // first bit is always 0x0, to make any location = 0 within the archive invalid, like nullptr or sth
-
+            // marked entries are unlinked in place, and their space is reused by files added later
             assert(archive_ptr->archive_file.is_open());
-
-            this->archive_ptr->root_folder->copy_to_another_archive(this->archive_ptr->archive_file, dst, 0, 0);
-
-            if (this->archive_ptr->archive_file.is_open()) this->archive_ptr->archive_file.close();
-            if (dst.is_open()) dst.close();
-
-            std::filesystem::copy_file(temp_path, archive_ptr->load_path, std::filesystem::copy_options::overwrite_existing);
-            std::filesystem::remove(temp_path);
+            if (!this->archive_ptr->remove_entries())
+                QMessageBox::warning(this, QString("Error"), QString("Selected items couldn't be removed."));
 
             this->reload_archive();
         }
@@ -269,6 +263,54 @@ void ArchiveWindow::remove_selected_clicked()
 }
 
 
+void ArchiveWindow::compact_archive_triggered()
+{
+    if (!this->archive_ptr->archive_file.is_open()) return;
+
+    // whole archive is rewritten, so it's done in the background, with the window disabled until it's finished
+    this->setDisabled(true);
+    QThread* compaction = QThread::create( [archive = this->archive_ptr]() { archive->compact(); } );
+    connect( compaction, &QThread::finished, this, [this, compaction]() {
+        compaction->deleteLater();
+        this->setDisabled(false);
+        this->reload_archive();
+    } );
+    compaction->start();
+}
+
+
+void ArchiveWindow::update_archive_triggered()
+{
+    if (!this->archive_ptr->archive_file.is_open()) return;
+
+    QString Qfolder_path = QFileDialog::getExistingDirectory( this, "Select folder to update archive from", QDir::homePath() );
+    if (Qfolder_path.isEmpty()) return;
+
+    // new files get the default settings of compression dialog, changed ones keep their own
+    std::bitset<16> flags(0);
+    flags[7] = true;    // BWT (divsufsort)
+    flags[1] = true;    // Move-to-front
+    flags[2] = true;    // Run-length encoding
+    flags[4] = true;    // Arithmetic coding (better model)
+    flags |= get_flags_from_checksum_type(ChecksumType::SHA256);
+
+    // only new and changed files are compressed, but reading the whole folder can still take a while
+    this->setDisabled(true);
+    auto successful = std::make_shared<bool>(false);
+    QThread* update = QThread::create( [archive = this->archive_ptr, path = Qfolder_path.toStdString(), flags, successful]() {
+        bool aborting_var = false;
+        *successful = archive->update( path, (uint16_t)flags.to_ulong(), false, aborting_var );
+    } );
+    connect( update, &QThread::finished, this, [this, update, successful]() {
+        update->deleteLater();
+        this->setDisabled(false);
+        this->reload_archive();
+        if (!*successful) QMessageBox::warning(this, QString("Error"), QString("Archive couldn't be updated."));
+    } );
+    update->start();
+}
+
+
 void ArchiveWindow::create_empty_archive()
 {
     new_archive_model();
@@ -296,8 +338,6 @@ void ArchiveWindow::create_empty_archive()
 
 void ArchiveWindow::add_new_folder_clicked()
 {
-    bool aborting_var = false;
-
     if (!ui->archiveWidget->selectedItems().empty()) {
         auto itm = ui->archiveWidget->selectedItems()[0];
 
@@ -313,12 +353,12 @@ void ArchiveWindow::add_new_folder_clicked()
 
                     Folder* new_folder_ptr = twfolder->archive_ptr->add_folder_to_model( twfolder->folder_ptr, folder_name.toStdString() );
 
-                    this->write_folder_to_current_archive( new_folder_ptr, aborting_var );
+                    this->write_folder_to_current_archive( new_folder_ptr );
                 }
                 else {
                     folder_name = "new folder";
                     Folder* new_folder_ptr = twfolder->archive_ptr->add_folder_to_model(twfolder->folder_ptr, folder_name.toStdString());
-                    this->write_folder_to_current_archive( new_folder_ptr, aborting_var );
+                    this->write_folder_to_current_archive( new_folder_ptr );
                 }
                 // If file is selected, add new folder as it's parent's child
             } else if (itm->type() == 1002) {   //TreeWidgetFile
@@ -327,12 +367,12 @@ void ArchiveWindow::add_new_folder_clicked()
                 if (!folder_name.isEmpty()) {
 
                     Folder* new_folder_ptr = twfile->archive_ptr->add_folder_to_model(twfile->file_ptr->parent_ptr, folder_name.toStdString());
-                    this->write_folder_to_current_archive( new_folder_ptr, aborting_var );
+                    this->write_folder_to_current_archive( new_folder_ptr );
                 }
                 else {
                     folder_name = "new folder";
                     Folder* new_folder_ptr = twfile->archive_ptr->add_folder_to_model(twfile->file_ptr->parent_ptr, folder_name.toStdString());
-                    this->write_folder_to_current_archive( new_folder_ptr, aborting_var );
+                    this->write_folder_to_current_archive( new_folder_ptr );
                 }
             }
         }
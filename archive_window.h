@@ -7,6 +7,7 @@
 #include <QFileDialog>
 #include <QAbstractItemView>
 #include <QInputDialog>
+#include <QThread>
 #include <memory>
 
 #include "archive.h"
@@ -34,8 +35,7 @@ public:
     void create_empty_archive();
     void load_archive( std::string path_to_archive );
     void reload_archive();
-    void write_file_to_current_archive( File* file_model, bool& aborting_var );
-    void write_folder_to_current_archive( Folder* folder_model, bool& aborting_var );
+    void write_folder_to_current_archive( Folder* folder_model );
     bool ask_for_password_and_unlock(TreeWidgetFile* item);
 
     Archive* archive_ptr = nullptr;
@@ -45,13 +45,15 @@ public:
     QString style_dark = "";
     QString style_light = "";
 
-    std::filesystem::path temp_path = std::filesystem::temp_directory_path().append( "tk2k_archive.tmp" );
-
 private slots:
     void new_archive_triggered();
 
     void open_archive_triggered();
 
+    void compact_archive_triggered();
+
+    void update_archive_triggered();
+
     void extract_selected_clicked();
 
     void extract_all_clicked();
@@ -65,6 +67,8 @@ private slots:
     void remove_selected_clicked();
 
     void on_archiveWidget_itemSelectionChanged();
+
+    void archive_item_expanded( QTreeWidgetItem* item );
 };
 
 #endif // MAINWINDOW_H
@@ -1,6 +1,8 @@
 #include "cli.hpp"
 #include "archive.h"
 #include "misc/multithreading.h"
+#include "misc/stream_codec.h"
+#include "misc/path_filter.h"
 
 #include <bitset>
 #include <string>
@@ -11,6 +13,7 @@
 #include <exception>
 #include <algorithm>
 #include <optional>
+#include <filesystem>
 
 using Args = std::vector<std::string>;
 extern std::vector<AlgorithmFlag> compressionOrder;
@@ -26,7 +29,13 @@ std::vector<ArgType> options =
         ArgType::archive,
         ArgType::output,
         ArgType::fileToAdd,
-        ArgType::blockSize
+        ArgType::blockSize,
+        ArgType::rangeOffset,
+        ArgType::rangeLength,
+        ArgType::compare,
+        ArgType::include,
+        ArgType::exclude,
+        ArgType::path
     };
 
 std::vector<std::string> enumToString =
@@ -36,7 +45,13 @@ std::vector<std::string> enumToString =
         "archive",
         "output",
         "fileToAdd",
-        "blockSize"
+        "blockSize",
+        "rangeOffset",
+        "rangeLength",
+        "compare",
+        "include",
+        "exclude",
+        "path"
     }; 
 
 std::map<std::string, ArgType> strToEnum =
@@ -47,6 +62,12 @@ std::map<std::string, ArgType> strToEnum =
         {"output", ArgType::output},
         {"fileToAdd", ArgType::fileToAdd},
         {"blockSize", ArgType::blockSize},
+        {"rangeOffset", ArgType::rangeOffset},
+        {"rangeLength", ArgType::rangeLength},
+        {"compare", ArgType::compare},
+        {"include", ArgType::include},
+        {"exclude", ArgType::exclude},
+        {"path", ArgType::path},
     }; 
 
 std::string strToParam(std::string text)
@@ -111,6 +132,29 @@ std::optional<std::string> parseOptionalString(args::ArgType argType, Args args)
     return argVal;
 }
 
+// all values of an argument which can be given many times, e.g. --exclude=*.tmp --exclude=.git
+std::vector<std::string> parseRepeatedString(args::ArgType argType, Args args)
+{
+    std::string paramSubstr = args::enumToParam(argType);
+    std::vector<std::string> values{};
+    for (const auto& arg : args)
+    {
+        if (arg.rfind(paramSubstr, 0) == 0 and arg.length() > paramSubstr.length())
+        {
+            values.push_back(arg.substr(paramSubstr.length()));
+        }
+    }
+    return values;
+}
+
+PathFilter parsePathFilter(Args args)
+{
+    PathFilter filter;
+    for (const auto& pattern : parseRepeatedString(args::ArgType::include, args)) filter.include(pattern);
+    for (const auto& pattern : parseRepeatedString(args::ArgType::exclude, args)) filter.exclude(pattern);
+    return filter;
+}
+
 multithreading::mode parseOperationMode(Args args)
 {
     std::string argVal = parseMandatoryString(args::ArgType::mode, args);
@@ -125,6 +169,21 @@ multithreading::mode parseOperationMode(Args args)
     throw std::runtime_error("Error: unknown operation mode");
 }
 
+bool isUpdateMode(Args args)
+{
+    // --mode=update, or just --update
+    if (std::find(args.begin(), args.end(), "--update") != args.end()) return true;
+    return parseOptionalString(args::ArgType::mode, args) == "update";
+}
+
+bool parseCompareHashes(Args args)
+{
+    std::optional<std::string> argOpt = parseOptionalString(args::ArgType::compare, args);
+    if (argOpt == std::nullopt or argOpt.value() == "mtime") return false;
+    if (argOpt.value() == "hash") return true;
+    throw std::runtime_error("Error: unknown compare method, mtime or hash expected");
+}
+
 std::vector<std::string> splitString(std::string str, char delimiter)
 {
     std::vector<std::string> result{};
@@ -265,12 +324,17 @@ std::string parseFileToAddPath(Args args)
 }
 
 
-void createArchiveWithSingleCompressedFile(const std::bitset<16>& flags, std::string fileToAddPath, std::string archivePath)
+void createArchive(const std::bitset<16>& flags, const std::vector<std::string>& pathsToAdd, const PathFilter& filter, std::string archivePath)
 {
     Archive archive;
     std::cout << "bitset:" << flags << std::endl;
     uint16_t flags_num = (uint16_t) flags.to_ulong();
-    archive.add_file_to_archive_model(std::ref(archive.root_folder), fileToAddPath, flags_num);
+    for (const auto& pathToAdd : pathsToAdd)
+    {
+        // contents of folders go into the root of archive, the same way as with --update
+        if (std::filesystem::is_directory(pathToAdd)) archive.add_directory_to_model(*archive.root_folder, pathToAdd, filter, flags_num);
+        else archive.add_file_to_archive_model(std::ref(archive.root_folder), pathToAdd, flags_num);
+    }
     bool fakeAbortingVar = false;
     archive.save(archivePath, fakeAbortingVar);
     archive.close();
@@ -287,8 +351,139 @@ void unpackArchiveWithSingleCompressedFile(std::string unpackedPath, std::string
 }
 
 
+void extractPathsFromArchive(std::string outputPath, std::string archivePath, const std::vector<std::string>& pathsInArchive, const PathFilter& filter)
+{
+    Archive archive;
+    archive.load(archivePath);
+    bool fakeAbortingVar = false;
+    bool successful = archive.extract_paths(pathsInArchive.empty() ? std::vector<std::string>{""} : pathsInArchive, filter, outputPath, fakeAbortingVar);
+    archive.close();
+    if (!successful) throw std::runtime_error("Error: some of the files couldn't be extracted");
+}
+
+
+void extractRangeOfSingleCompressedFile(std::string outputPath, std::string archivePath, int64_t offset, std::optional<uint64_t> length)
+{
+    Archive archive;
+    archive.load(archivePath);
+    archive.root_folder->parse_children();
+    File* file = archive.root_folder->child_file_ptr.get();
+    if (file == nullptr) throw std::runtime_error("Error: archive has no files");
+
+    // negative offset counts from the end of file, e.g. --rangeOffset=-1048576 gives the last MiB
+    uint64_t start = offset;
+    if (offset < 0) start = (uint64_t)(-offset) < file->original_size ? file->original_size + offset : 0;
+    if (start > file->original_size) throw std::runtime_error("Error: range starts after the end of file");
+
+    std::vector<uint8_t> range;
+    bool fakeAbortingVar = false;
+    if (!file->extract_range(archive.archive_file, start, length.value_or(file->original_size - start), range, fakeAbortingVar))
+    {
+        archive.close();
+        throw std::runtime_error("Error: range couldn't be extracted");
+    }
+    archive.close();
+
+    std::ofstream output(outputPath, std::ios::binary);
+    output.write((char*)range.data(), range.size());
+}
+
+
+void updateArchive(const std::bitset<16>& flags, std::string sourcePath, std::string archivePath, bool compareHashes, const PathFilter& filter)
+{
+    bool fakeAbortingVar = false;
+    if (!std::filesystem::exists(archivePath))
+    {
+        // empty archive is made first, everything is then added to it as new files
+        Archive emptyArchive;
+        emptyArchive.build_empty_archive(std::filesystem::path(archivePath).filename().string());
+        emptyArchive.save(archivePath, fakeAbortingVar);
+        emptyArchive.close();
+    }
+
+    Archive archive;
+    archive.load(archivePath);
+    bool successful = archive.update(sourcePath, (uint16_t) flags.to_ulong(), compareHashes, fakeAbortingVar, filter);
+    archive.close();
+    if (!successful) throw std::runtime_error("Error: archive couldn't be updated");
+}
+
+
+bool isStreamMode(Args args)
+{
+    // "-" instead of archive: stream (misc/stream_codec.h) is written to stdout, or read from stdin
+    return parseOptionalString(args::ArgType::archive, args) == "-";
+}
+
+
+void streamData(Args args)
+{
+    // stdout carries only the stream, so everything printed on the way goes to stderr
+    std::ostream stdoutStream(std::cout.rdbuf(std::cerr.rdbuf()));
+    struct RestoreCout
+    {
+        std::streambuf* buffer;
+        ~RestoreCout() { std::cout.rdbuf(buffer); }
+    } restoreCout{stdoutStream.rdbuf()};
+
+    multithreading::mode opMode = parseOperationMode(args);
+    bool fakeAbortingVar = false;
+    bool successful = false;
+    std::string error;
+    if (opMode == multithreading::mode::compress)
+    {
+        std::bitset<16> flags = parseAlgorithmFlags(args) | parseBlockSizeFlags(args);
+        std::optional<std::string> inputPath = parseOptionalString(args::ArgType::fileToAdd, args);
+        if (not inputPath.has_value() or inputPath.value() == "-")
+            successful = stream_codec::compress(std::cin, stdoutStream, (uint16_t) flags.to_ulong(), fakeAbortingVar, &error);
+        else
+        {
+            std::ifstream input(inputPath.value(), std::ios::binary);
+            if (not input.is_open()) throw std::runtime_error("Error: " + inputPath.value() + " couldn't be opened");
+            successful = stream_codec::compress(input, stdoutStream, (uint16_t) flags.to_ulong(), fakeAbortingVar, &error);
+        }
+    }
+    else
+    {
+        try
+        {
+            parseAlgorithmFlags(args);
+        }
+        catch(std::exception&) {}
+        std::optional<std::string> outputPath = parseOptionalString(args::ArgType::output, args);
+        if (not outputPath.has_value() or outputPath.value() == "-")
+            successful = stream_codec::decompress(std::cin, stdoutStream, fakeAbortingVar, &error);
+        else
+        {
+            std::ofstream output(outputPath.value(), std::ios::binary);
+            if (not output.is_open()) throw std::runtime_error("Error: " + outputPath.value() + " couldn't be created");
+            successful = stream_codec::decompress(std::cin, output, fakeAbortingVar, &error);
+        }
+    }
+    if (!successful) throw std::runtime_error("Error: " + (error.empty() ? std::string("stream couldn't be processed") : error));
+}
+
+
 void parseArgs(Args args)
 {
+    if (isStreamMode(args))
+    {
+        // e.g. "pg_dump | tk2k --mode=compress --archive=- | ssh ...", nothing is staged in temporary files
+        streamData(args);
+        return;
+    }
+
+    if (isUpdateMode(args))
+    {
+        // only new and changed files from fileToAdd (a file, or a folder) are compressed
+        std::string archivePath = parseArchivePath(args);
+        std::bitset<16> algoFlags = parseAlgorithmFlags(args);
+        std::bitset<16> blockSizeflags = parseBlockSizeFlags(args);
+        std::string sourcePath = parseFileToAddPath(args);
+        updateArchive(algoFlags | blockSizeflags, sourcePath, archivePath, parseCompareHashes(args), parsePathFilter(args));
+        return;
+    }
+
     multithreading::mode opMode = parseOperationMode(args);
     std::string archivePath = parseArchivePath(args);
 
@@ -296,8 +491,9 @@ void parseArgs(Args args)
     {
         std::bitset<16> algoFlags = parseAlgorithmFlags(args);
         std::bitset<16> blockSizeflags = parseBlockSizeFlags(args);
-        std::string fileToAddPath = parseFileToAddPath(args);
-        createArchiveWithSingleCompressedFile(algoFlags | blockSizeflags, fileToAddPath, archivePath);
+        // --fileToAdd can be given many times, each one a file or a folder
+        parseFileToAddPath(args);   // throws if there's none
+        createArchive(algoFlags | blockSizeflags, parseRepeatedString(args::ArgType::fileToAdd, args), parsePathFilter(args), archivePath);
     }
     else
     {
@@ -307,7 +503,23 @@ void parseArgs(Args args)
         }
         catch(std::exception&) {}
         std::string outputPath = parseOutputPath(args);
-        unpackArchiveWithSingleCompressedFile(outputPath, archivePath);
+
+        std::optional<std::string> rangeOffset = parseOptionalString(args::ArgType::rangeOffset, args);
+        std::optional<std::string> rangeLength = parseOptionalString(args::ArgType::rangeLength, args);
+        if (rangeOffset.has_value() or rangeLength.has_value())
+        {
+            // only part of the file is decoded, and written into outputPath
+            std::optional<uint64_t> length;
+            if (rangeLength.has_value()) length = std::stoull(rangeLength.value());
+            extractRangeOfSingleCompressedFile(outputPath, archivePath, std::stoll(rangeOffset.value_or("0")), length);
+            return;
+        }
+
+        // --path (can be given many times) selects files and folders inside archive, --include/--exclude filter their contents
+        std::vector<std::string> pathsInArchive = parseRepeatedString(args::ArgType::path, args);
+        PathFilter filter = parsePathFilter(args);
+        if (!pathsInArchive.empty() or !filter.empty()) extractPathsFromArchive(outputPath, archivePath, pathsInArchive, filter);
+        else unpackArchiveWithSingleCompressedFile(outputPath, archivePath);
     }
 }
 
@@ -13,7 +13,13 @@ enum ArgType
     archive,
     output,
     fileToAdd,
-    blockSize
+    blockSize,
+    rangeOffset,
+    rangeLength,
+    compare,
+    include,
+    exclude,
+    path
 };
 } // namespace args
 
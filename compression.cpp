@@ -6,12 +6,14 @@
 #include <cassert>
 #include <vector>
 #include <bitset>
+#include <cstring>
 
 #include <divsufsort.h> // external library
 
 #include "misc/bitbuffer.h"
 #include "misc/model.h"
 #include "misc/dc3.h"
+#include "misc/positional_io.h"
 
 Compression::Compression( bool& aborting_variable ) :
         aborting_var(&aborting_variable)
@@ -20,7 +22,7 @@ Compression::Compression( bool& aborting_variable ) :
 
 
 Compression::~Compression() {
-    delete[] text;
+    free_text();
 }
 
 
@@ -28,7 +30,7 @@ void Compression::load_text(std::fstream &input, uint64_t text_size)
 {
     if (*aborting_var) return;
 
-    delete[] this->text;
+    free_text();
     this->size = text_size;
     this->text = new uint8_t [this->size];
     input.read( (char*)this->text, this->size );
@@ -38,27 +40,85 @@ void Compression::load_text(std::fstream &input, uint64_t text_size)
 void Compression::load_part(std::fstream &input, uint64_t text_size, uint32_t part_num, uint32_t block_size) {
     if (*aborting_var) return;
 
-    delete[] this->text;
-    assert( block_size * part_num <= text_size ); // part_size * part_num == starting position
+    free_text();
+    const uint64_t part_start = (uint64_t)block_size * part_num;
+    assert( part_start <= text_size );
 
-    if (block_size * (part_num+1) < text_size ) this->size = block_size;
-    else this->size = text_size - (block_size * part_num);
+    if (part_start + block_size < text_size ) this->size = block_size;
+    else this->size = text_size - part_start;
 
     assert( this->size <= block_size );
 
     this->text = new uint8_t [this->size];
 
     assert( input.is_open() );
-    input.seekg(block_size * part_num);
+    input.seekg(part_start);
     input.read( (char*)this->text, this->size );
 }
 
 
+void Compression::load_view(const uint8_t* mapped_data, uint64_t text_size, uint32_t part_num, uint32_t block_size) {
+    if (*aborting_var) return;
+
+    free_text();
+    const uint64_t part_start = (uint64_t)block_size * part_num;
+    assert( part_start <= text_size );
+
+    if (part_start + block_size < text_size ) this->size = block_size;
+    else this->size = text_size - part_start;
+
+    // the first stage of compression allocates its output, so the view itself is never written to
+    this->text = const_cast<uint8_t*>(mapped_data + part_start);
+    this->text_owned = false;
+}
+
+
+void Compression::free_text() {
+    if (text_owned) delete[] this->text;
+    this->text = nullptr;
+    this->text_owned = true;
+}
+
+
+void Compression::replace_text(uint8_t* new_text) {
+    free_text();
+    this->text = new_text;
+}
+
+
 void Compression::save_text(std::fstream &output) {
     if (!*aborting_var) output.write((char*)(this->text), this->size);
 }
 
 
+bool Compression::load_text(PositionalFile &input, uint64_t offset, uint64_t text_size)
+{
+    if (*aborting_var) return false;
+
+    free_text();
+    this->size = text_size;
+    this->text = new uint8_t [this->size];
+    return input.read_at(this->text, this->size, offset);
+}
+
+
+bool Compression::load_part(PositionalFile &input, uint64_t text_size, uint32_t part_num, uint32_t block_size) {
+    if (*aborting_var) return false;
+
+    const uint64_t part_start = (uint64_t)block_size * part_num;
+    assert( part_start <= text_size );
+
+    if (part_start + block_size < text_size ) return load_text(input, part_start, block_size);
+    else return load_text(input, part_start, text_size - part_start);
+}
+
+
+bool Compression::save_text(PositionalFile &output, uint64_t offset) {
+    if (*aborting_var) return false;
+    return output.write_at(this->text, this->size, offset);
+}
+
+
 void Compression::BWT_make()    // DC3
 {
     if (*aborting_var) return;
@@ -101,8 +161,7 @@ void Compression::BWT_make()    // DC3
         encoded[n+1+index] = ( original_message_index >> (index*8u)) & 0xFFu;
 
     // replacing this->text with encoded text
-    std::swap(this->text, encoded);
-    delete[] encoded;
+    replace_text(encoded);
     this->size = n+5;
 }
 
@@ -174,8 +233,7 @@ void Compression::BWT_reverse()
     }
 
     // replacing encoded text with decoded
-    std::swap(this->text, decoded);
-    delete[] decoded;
+    replace_text(decoded);
     this->size = decoded_length;
 }
 
@@ -252,8 +310,7 @@ void Compression::BWT_make2()   // divsufsort
 
     // replacing this->text with encoded text
     this->size = n+4;
-    std::swap(text, encoded);
-    delete[] encoded;
+    replace_text(encoded);
     this->size = n+4;
 }
 
@@ -312,9 +369,8 @@ void Compression::BWT_reverse2()
         return;
     }
 
-    std::swap(this->text, decoded);
+    replace_text(decoded);
     this->size = encoded_length;
-    delete[] decoded;
 }
 
 
@@ -393,9 +449,8 @@ void Compression::MTF_make()
         return;
     }
 
-    std::swap(text, output);
+    replace_text(output);
     this->size = textlength+32;
-    delete[] output;
 }
 
 
@@ -440,17 +495,15 @@ void Compression::MTF_reverse()
         return;
     }
 
-    std::swap(text, output);
+    replace_text(output);
     this->size = textlength;
 
-    delete[] output;
 }
 
 
 void Compression::RLE_make()
 {
     if (*aborting_var) return;
-    uint32_t textlength = 1 + size; // first byte encodes whether or not RLE was used
 
     std::string output;
     output.reserve(size);
@@ -459,7 +512,7 @@ void Compression::RLE_make()
     bool RLE_used = true;
 
     uint8_t counter = 0;
-    for (uint32_t i=1; i < textlength and !*aborting_var; ++i) {
+    for (uint32_t i=1; i < size and !*aborting_var; ++i) {
         counter++;
         if (text[i-1] != text[i] or counter == 255) {
             output += text[i-1];
@@ -467,6 +520,11 @@ void Compression::RLE_make()
             counter = 0;
         }
     }
+    // the last run ends with the text (text[size] isn't read, since text may be a view of mapped file)
+    if (size != 0) {
+        output += text[size-1];
+        output += (uint8_t)(counter+1);
+    }
 
     if (*aborting_var) return;
 
@@ -475,12 +533,7 @@ void Compression::RLE_make()
     }
 
     if( RLE_used ) {
-        if (counter != 0) {
-            output += text[textlength-1];
-            output += counter;
-        }
-
-        delete[] text;
+        free_text();
         text = new uint8_t [output.length()];
         for (uint32_t i=0; i < output.length() and !*aborting_var; ++i) {
             text[i] = output[i];
@@ -494,8 +547,7 @@ void Compression::RLE_make()
         for (uint32_t i=0; i < size and !*aborting_var; ++i) {
             temp[i+1] = text[i];
         }
-        std::swap(text, temp);
-        delete[] temp;
+        replace_text(temp);
         size++;
     }
 }
@@ -516,7 +568,7 @@ void Compression::RLE_reverse()
 
         if (*aborting_var) return;
 
-        delete[] text;
+        free_text();
         text = new uint8_t [output.length()];
         for (uint32_t i=0; i<output.length() and !*aborting_var; ++i)
             text[i] = output[i];
@@ -534,9 +586,8 @@ void Compression::RLE_reverse()
             return;
         }
 
-        std::swap(temp, text);
+        replace_text(temp);
 
-        delete[] temp;
         size--;
 
     }
@@ -548,8 +599,6 @@ void Compression::RLE_makeV2()
 {
     if (*aborting_var) return;
 
-    uint32_t textlength = 1 + size; // first byte encodes whether or not RLE was used
-
     std::string output_run_length;
     output_run_length.reserve(size);
 
@@ -560,7 +609,7 @@ void Compression::RLE_makeV2()
     bool RLE_used = true;
 
     uint8_t counter = 0;
-    for (uint32_t i=1; i<textlength; ++i) {
+    for (uint32_t i=1; i<size; ++i) {
         counter++;
         if (text[i-1] != text[i] or counter == 255) {
             output_chars += text[i-1];
@@ -569,18 +618,18 @@ void Compression::RLE_makeV2()
             if (*aborting_var) return;
         }
     }
+    // the last run ends with the text (text[size] isn't read, since text may be a view of mapped file)
+    if (size != 0) {
+        output_chars += text[size-1];
+        output_run_length += (uint8_t)(counter+1);
+    }
 
     if ( (output_chars.length() + output_run_length.length())*3 > size*2 ) {    // if RLE improves compression by less than 1/3 this-size bytes, then:
         RLE_used = false;
     }
 
     if( RLE_used ) {
-        if (counter != 0) {
-            output_chars += text[textlength-1];
-            output_run_length += counter;
-        }
-
-        delete[] text;
+        free_text();
         text = new uint8_t [output_run_length.length() + output_chars.length()];
         for (uint32_t i=0; i<output_run_length.length(); ++i) {
             text[i] = output_run_length[i];
@@ -603,10 +652,9 @@ void Compression::RLE_makeV2()
 
         if (*aborting_var) return;
 
-        std::swap(temp, text);
+        replace_text(temp);
 
         size++;
-        delete[] temp;
     }
 }
 
@@ -626,7 +674,7 @@ void Compression::RLE_reverseV2()
 
         if (*aborting_var) return;
 
-        delete[] text;
+        free_text();
         text = new uint8_t [output.length()];
         for (uint32_t i=0; i < output.length(); ++i) {
             text[i] = output[i];
@@ -642,9 +690,8 @@ void Compression::RLE_reverseV2()
 
         if (*aborting_var) return;
 
-        std::swap(text, temp);
+        replace_text(temp);
 
-        delete[] temp;
         size--;
     }
     else throw std::invalid_argument("RLE was neither used nor not used, apparently");
@@ -770,7 +817,7 @@ void Compression::AC_make()
     *(uint32_t*)(output.c_str()) = bitout.get_output_size();
 
     size = output.length();
-    delete[] text;
+    free_text();
 
     text = new uint8_t [size];
     for (uint32_t i=0; i < size; ++i) {
@@ -795,11 +842,14 @@ void Compression::AC_reverse()
 
     std::string alphabet;
 
-    uint32_t compressed_size = *(uint32_t *)(text);
-    uint32_t original_size = *(uint32_t *)(text + 4);
+    // text can be a view into any buffer, so nothing in it is aligned
+    uint32_t compressed_size, original_size;
+    memcpy(&compressed_size, text, 4);
+    memcpy(&original_size, text + 4, 4);
 
     uint16_t PMF_size = 256;
-    auto* PMF = (uint32_t *)(text + 8);
+    uint32_t PMF[256];
+    memcpy(PMF, text + 8, sizeof(PMF));
     for ( uint16_t i=0; i < PMF_size; ++i)
     {
         if (PMF[i] != 0) {
@@ -903,7 +953,7 @@ void Compression::AC_reverse()
 
     if (*aborting_var) return;
     size = output.length();
-    delete[] text;
+    free_text();
 
     text = new uint8_t [size];
     for (uint32_t j=0; j < size; ++j) {
@@ -1030,7 +1080,7 @@ void Compression::AC2_make()
     *(uint32_t*)(output.c_str()) = bitout.get_output_size();
 
     size = output.length();
-    delete[] text;
+    free_text();
 
     text = new uint8_t[size];
     for (uint32_t i = 0; i < size; ++i) {
@@ -1054,8 +1104,9 @@ void Compression::AC2_reverse()
     std::vector<std::vector<uint64_t>> upper_bound(256);
     std::vector<std::string> alphabet(256);
 
-    uint32_t compressed_size = *(uint32_t *)(text);
-    uint32_t original_size = *(uint32_t *)(text + 4);
+    uint32_t compressed_size, original_size;
+    memcpy(&compressed_size, text, 4);
+    memcpy(&original_size, text + 4, 4);
 
     for (uint16_t r = 0; r < r_size; ++r) {
         std::vector<uint64_t> temp_c(1,0);
@@ -1070,7 +1121,9 @@ void Compression::AC2_reverse()
 
         // calculating cumulative mass functions from these probabilities
         for (uint16_t i = 0; i < r_size; i++) {
-            uint64_t rn = *(uint32_t*)(r_buffer+i*4);   // rn = PMF[i]
+            uint32_t rn_32b;
+            memcpy(&rn_32b, r_buffer + i*4, 4);
+            uint64_t rn = rn_32b;   // rn = PMF[i]
 
             if (rn != 0) {
                 alphabet[r] += char(i);
@@ -1189,7 +1242,7 @@ void Compression::AC2_reverse()
     if (*aborting_var) return;
 
     size = output.length();
-    delete[] text;
+    free_text();
 
     text = new uint8_t [size];
     for (uint32_t j=0; j < size; ++j) {
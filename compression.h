@@ -4,20 +4,32 @@
 #include <fstream>
 #include <random>
 
+class PositionalFile;
+
 class Compression {
 public:
     bool* aborting_var;
     uint8_t* text;
+    bool text_owned = true;     // false if text is a read-only view of memory mapped file (see load_view)
     uint32_t size;
     uint32_t part_id=0;
+    uint32_t block_checksum=0;  // CRC-32C of uncompressed block, if flag 8 is set
 
     Compression( bool& aborting_variable );
     ~Compression();
 
     void load_text( std::fstream &input, uint64_t text_size );
     void load_part( std::fstream &input, uint64_t text_size, uint32_t part_num, uint32_t block_size );
+    void load_view( const uint8_t* mapped_data, uint64_t text_size, uint32_t part_num, uint32_t block_size );  // no copy
+    void free_text();                       // deletes text, unless it's a view
+    void replace_text( uint8_t* new_text ); // frees current text and takes ownership of new_text
     void save_text( std::fstream &output );
 
+    // positional variants, which can be used by many threads sharing one file
+    bool load_text( PositionalFile &input, uint64_t offset, uint64_t text_size );
+    bool load_part( PositionalFile &input, uint64_t text_size, uint32_t part_num, uint32_t block_size );
+    bool save_text( PositionalFile &output, uint64_t offset );
+
     void BWT_make();    // Burrows-Wheeler transform (DC3)
     void BWT_reverse();
 
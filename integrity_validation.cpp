@@ -1,4 +1,7 @@
 #include "integrity_validation.h"
+#include "misc/crc32.h"
+#include "misc/sha.h"
+#include "misc/xxh3.h"
 
 #include <fstream>
 #include <sstream>
@@ -7,10 +10,13 @@
 #include <filesystem>
 #include <bit>
 #include <cmath>
+#include <iomanip>
+#include <cstring>
+#include <algorithm>
+
 
 IntegrityValidation::IntegrityValidation()
 : SHA1_num(nullptr), SHA256_num(nullptr), CRC32_num(nullptr) {
-    generate_CRC32_lookup_table();
 }
 
 IntegrityValidation::~IntegrityValidation() {
@@ -20,914 +26,384 @@ IntegrityValidation::~IntegrityValidation() {
 }
 
 
-std::string IntegrityValidation::get_SHA1_from_file(const std::string &path_to_file, bool &aborting_var) {
-    // implemented using pseudocode from: https://en.wikipedia.org/wiki/SHA-1#SHA-1_pseudocode
-
-    if (!aborting_var) {
-        uint32_t h0 = 0x67452301;
-        uint32_t h1 = 0xEFCDAB89;
-        uint32_t h2 = 0x98BADCFE;
-        uint32_t h3 = 0x10325476;
-        uint32_t h4 = 0xC3D2E1F0;
-
-        std::ifstream target_file( path_to_file );
-        assert( target_file.is_open() );
-
+namespace
+{
+// Calculates checksum of the whole stream, from its beginning, and restores stream's position afterwards
+std::string get_checksum_of_whole_stream( ChecksumType type, std::fstream& source, bool& aborting_var )
+{
+    assert( source.is_open() );
+    uint64_t backup_pos = source.tellg();
 
-        uint32_t a = 0;
-        uint32_t b = 0;
-        uint32_t c = 0;
-        uint32_t d = 0;
-        uint32_t e = 0;
+    source.seekg(0);
+    std::string checksum = get_checksum_from_stream(type, source, aborting_var);
 
-        uint32_t f = 0;
-        uint32_t k = 0;
+    source.clear();
+    source.seekg(backup_pos);
+    return checksum;
+}
+}
 
-        uint8_t buffer[64];
-        uint8_t leftover_buffer[64];
-        uint32_t chunk[80] = {};
 
-        uint64_t byte_counter = 0;
+std::string IntegrityValidation::get_SHA1_from_file(const std::string &path_to_file, bool &aborting_var) {
+    this->SHA1 = get_checksum_from_file(ChecksumType::SHA1, path_to_file, aborting_var);
+    return this->SHA1;
+}
 
-        bool leftover = false;
 
-        while ( target_file.good() or leftover )
-        {
-            if (!leftover) {
-                target_file.read((char *) &buffer, sizeof(buffer));
-                byte_counter += target_file.gcount();
+std::string IntegrityValidation::get_SHA1_from_stream(std::fstream &target_file, uint64_t file_size, bool &aborting_var) {
+    this->SHA1 = get_checksum_of_whole_stream(ChecksumType::SHA1, target_file, aborting_var);
+    return this->SHA1;
+}
 
-                if (target_file.gcount() < 64) {
-                    uint64_t read_counter = target_file.gcount();
-                    buffer[read_counter] = 0x80;
-                    read_counter++;
-                    for (uint32_t i = read_counter; i < 64; ++i) buffer[i] = 0;
 
-                    if (64 - read_counter < 8) {
-                        leftover = true;
+std::string IntegrityValidation::get_SHA256_from_file(const std::string &path_to_file, bool &aborting_var) {
+    this->SHA256 = get_checksum_from_file(ChecksumType::SHA256, path_to_file, aborting_var);
+    return this->SHA256;
+}
 
-                        for (uint32_t i = 0; i < 64; ++i) {
-                            leftover_buffer[i] = 0;
-                        }
 
-                        for (int i = 0; i<8; ++i) {
-                            leftover_buffer[56 + 7 - i] = (byte_counter * 8 >> i * 8) & 0xFF;
-                        }
+std::string IntegrityValidation::get_SHA256_from_stream(std::fstream &target_file, bool &aborting_var) {
+    this->SHA256 = get_checksum_of_whole_stream(ChecksumType::SHA256, target_file, aborting_var);
+    return this->SHA256;
+}
 
-                    } else for (int i = 0; i<8 ; ++i) buffer[56 + 7 - i] = (byte_counter * 8 >> i * 8) & 0xFF;
-                }
-            }
-            else {
-                leftover = false;
-                for (uint32_t i=0; i < 64; ++i) buffer[i] = leftover_buffer[i];
-            }
 
-            for (uint8_t i = 0; i < 16; i++) // making 16 32-bit words from 64 8-bit words
-            {
-                uint64_t word = 0;
-                for (uint8_t j = 0; j < 4; j++) // making single 32-bit word
-                {
-                    word = (word << 8);
-                    word += buffer[ i*4 + j ];
-                }
-                chunk[i] = word;
-            }
+std::string IntegrityValidation::get_SHA256_from_text( uint8_t text[], uint64_t text_size, bool& aborting_var ) {
+    this->SHA256 = get_checksum_from_memory(ChecksumType::SHA256, text, text_size, aborting_var);
+    return this->SHA256;
+}
 
-            for (uint8_t id=16; id < 80; id++)
-            {
-                chunk[id] =  std::rotl(chunk[id-3] ^ chunk[id-8] ^ chunk[id-14] ^ chunk[id-16], 1);
-            }
 
-            a = h0;
-            b = h1;
-            c = h2;
-            d = h3;
-            e = h4;
+std::string IntegrityValidation::get_CRC32_from_text(uint8_t *text, uint64_t text_size, bool& aborting_var) {
+    this->CRC32 = get_checksum_from_memory(ChecksumType::CRC32, text, text_size, aborting_var);
+    return this->CRC32;
+}
 
 
-            uint32_t temp = 0;
-            for ( uint8_t i = 0; i < 80; i++)
-            {
-                if ( (0 <= i) and (i <= 19) )
-                {
-                    f = ( b & c ) | ((~b) & d);
-                    k = 0x5A827999;
-                }
-                else if ((20 <= i) and (i <= 39))
-                {
-                    f = b ^ c ^ d;
-                    k = 0x6ED9EBA1;
-                }
-                else if ((40 <= i) and (i <= 59)) {
-                    f = (b & c) | (b & d) | (c & d);
-                    k = 0x8F1BBCDC;
-                }
-                else if ((60 <= i) and (i <= 79)) {
-                    f = b ^ c ^ d;
-                    k = 0xCA62C1D6;
-                }
-                temp = std::rotl(a, 5) + f + e + k + chunk[i];
-                e = d;
-                d = c;
-                c = std::rotl(b, 30);
-                b = a;
-                a = temp;
+std::string IntegrityValidation::get_CRC32_from_file( std::string path, bool& aborting_var ) {
+    this->CRC32 = get_checksum_from_file(ChecksumType::CRC32, path, aborting_var);
+    return this->CRC32;
+}
 
-            }
-            h0 += a;
-            h1 += b;
-            h2 += c;
-            h3 += d;
-            h4 += e;
 
-        }
+std::string IntegrityValidation::get_CRC32_from_stream(std::fstream &source, bool &aborting_var) {
+    this->CRC32 = get_checksum_of_whole_stream(ChecksumType::CRC32, source, aborting_var);
+    return this->CRC32;
+}
 
-        target_file.close();
-        if (aborting_var) return "";
 
-        std::stringstream stream;
-        stream << std::hex << std::setw(8) << std::setfill('0') << h0 <<std::setw(8) << std::setfill('0') << h1 << std::setw(8) << std::setfill('0') << h2 << std::setw(8) << std::setfill('0') << h3 << std::setw(8) << std::setfill('0') << h4;
-        std::string sha1hex = stream.str();
-        this->SHA1 = sha1hex;
-        return sha1hex;
+ChecksumType get_checksum_type_from_flags( uint16_t flags )
+{
+    // bits 13-15 are read as one number, so new checksums don't need new flags
+    // (1, 2 and 4 are the single-bit values used by older archives)
+    switch ((flags >> 13) & 0b111)
+    {
+    case 1: return ChecksumType::SHA256;
+    case 2: return ChecksumType::CRC32;
+    case 3: return ChecksumType::CRC32C;
+    case 4: return ChecksumType::SHA1;
+    case 5: return ChecksumType::XXH3;
     }
-    return "";
+    return ChecksumType::none;
 }
 
 
-std::string IntegrityValidation::get_SHA1_from_stream(std::fstream &target_file, uint64_t file_size, bool &aborting_var) {
-    // implemented using pseudocode from: https://en.wikipedia.org/wiki/SHA-1#SHA-1_pseudocode
-
-    if (!aborting_var) {
-
-        uint64_t backup_pos = target_file.tellg();
-
-        target_file.seekg(0);
-
-        uint32_t h0 = 0x67452301;
-        uint32_t h1 = 0xEFCDAB89;
-        uint32_t h2 = 0x98BADCFE;
-        uint32_t h3 = 0x10325476;
-        uint32_t h4 = 0xC3D2E1F0;
-
-        assert( target_file.is_open() );
-
-
-        uint32_t a = 0;
-        uint32_t b = 0;
-        uint32_t c = 0;
-        uint32_t d = 0;
-        uint32_t e = 0;
-
-        uint32_t f = 0;
-        uint32_t k = 0;
-
-        uint8_t buffer[64];
-
-        std::vector<uint32_t> chunk(80, 0);
-        chunk.reserve(80);
-
-        uint64_t byte_counter = 0;
-
-        bool leftover = false;
-        uint8_t leftover_buffer[64];
-
-        while ( target_file.good() or leftover )
-        {
-            if (!leftover) {
-                target_file.read((char *) &buffer, sizeof(buffer));
-                byte_counter += target_file.gcount();
-
-                if (target_file.gcount() < 64) {
-                    uint64_t read_counter = target_file.gcount();
-                    buffer[read_counter] = 0x80;
-                    read_counter++;
-                    for (uint32_t i = read_counter; i < 64; ++i) buffer[i] = 0;
-
-                    if (64 - read_counter < 8) {
-                        leftover = true;
-                        for (uint32_t i = 0; i < 64; ++i) leftover_buffer[i] = 0;
-                        for (int i = 0; i<8; ++i) leftover_buffer[56 + 7-i] = (byte_counter * 8 >> i * 8) & 0xFF;
-                    } else for (int i = 0; i<8 ; ++i) buffer[56 + 7-i] = (byte_counter * 8 >> i * 8) & 0xFF;
-                }
-            }
-            else {
-                leftover = false;
-                for (uint32_t i=0; i < 64; ++i) buffer[i] = leftover_buffer[i];
-            }
-
-            chunk = std::vector<uint32_t>();
-            chunk.reserve(80);
-
-            for (uint8_t i = 0; i < 16; i++) // making 16 32-bit words from 64 8-bit words
-            {
-                chunk.push_back(0);
-                uint64_t word = 0;
-                for (uint8_t j = 0; j < 4; j++) // making single 32-bit word
-                {
-                    word = (word << 8);
-                    word += buffer[ i*4 + j ];
-                }
-                chunk[i] = word;
-            }
-            for (uint8_t id =16; id < 80; id++)
-            {
-                chunk.push_back(0);
-                chunk[id] =  std::rotl(chunk[id-3] ^ chunk[id-8] ^ chunk[id-14] ^ chunk[id-16], 1);
-            }
+uint16_t get_flags_from_checksum_type( ChecksumType type )
+{
+    switch (type)
+    {
+    case ChecksumType::none:   return 0;
+    case ChecksumType::SHA256: return 1 << 13;
+    case ChecksumType::CRC32:  return 2 << 13;
+    case ChecksumType::CRC32C: return 3 << 13;
+    case ChecksumType::SHA1:   return 4 << 13;
+    case ChecksumType::XXH3:   return 5 << 13;
+    }
+    return 0;
+}
 
 
-            a = h0;
-            b = h1;
-            c = h2;
-            d = h3;
-            e = h4;
+uint32_t get_checksum_length( ChecksumType type )
+{
+    switch (type)
+    {
+    case ChecksumType::none:   return 0;
+    case ChecksumType::CRC32:  return 10;   // "0x" + 8 hex chars
+    case ChecksumType::CRC32C: return 10;
+    case ChecksumType::XXH3:   return 16;   // 16 hex chars, as in xxhsum
+    case ChecksumType::SHA1:   return 40;
+    case ChecksumType::SHA256: return 64;
+    }
+    return 0;
+}
 
 
-            uint32_t temp = 0;
-            for ( uint8_t i = 0; i < 80; i++)
-            {
-                if ( (0 <= i) and (i <= 19) )
-                {
-                    f = ( b & c ) | ((~b) & d);
-                    k = 0x5A827999;
-                }
-                else if ((20 <= i) and (i <= 39))
-                {
-                    f = b ^ c ^ d;
-                    k = 0x6ED9EBA1;
-                }
-                else if ((40 <= i) and (i <= 59)) {
-                    f = (b & c) | (b & d) | (c & d);
-                    k = 0x8F1BBCDC;
-                }
-                else if ((60 <= i) and (i <= 79)) {
-                    f = b ^ c ^ d;
-                    k = 0xCA62C1D6;
-                }
-                temp = std::rotl(a, 5) + f + e + k + chunk[i];
-                e = d;
-                d = c;
-                c = std::rotl(b, 30);
-                b = a;
-                a = temp;
+namespace
+{
+// Appends SHA padding (0x80, zeros, and message length in bits) to last, incomplete chunk
+// Returns number of 64-byte chunks (1 or 2) written to padding
+uint32_t SHA_padding( uint8_t padding[128], const uint8_t* chunk_buffer, uint32_t chunk_buffer_size, uint64_t byte_counter )
+{
+    if (chunk_buffer_size != 0) std::memcpy( padding, chunk_buffer, chunk_buffer_size );
+    padding[chunk_buffer_size++] = 0x80;
+    uint32_t padding_size = chunk_buffer_size > 56 ? 128 : 64;     // 2 chunks if there's no space left for message length
+    std::memset( padding + chunk_buffer_size, 0, padding_size - chunk_buffer_size );
+    for (int i = 0; i < 8; ++i) padding[padding_size - 1 - i] = (byte_counter * 8 >> i * 8) & 0xFF;
+    return padding_size / 64;
+}
 
-            }
-            h0 += a;
-            h1 += b;
-            h2 += c;
-            h3 += d;
-            h4 += e;
-        }
 
-        target_file.seekg(backup_pos);
+// Appends SHA padding (0x80, zeros, and message length in bits) to last, incomplete chunk
+template<typename ProcessChunks>
+void SHA_finish( const uint8_t chunk_buffer[64], uint32_t chunk_buffer_size, uint64_t byte_counter, ProcessChunks process_chunks )
+{
+    uint8_t padding[128];
+    process_chunks( padding, SHA_padding(padding, chunk_buffer, chunk_buffer_size, byte_counter) );
+}
 
-        if (aborting_var) return "";
 
-        std::stringstream stream;
-        stream << std::hex << std::setw(8) << std::setfill('0') << h0 <<std::setw(8) << std::setfill('0') << h1 << std::setw(8) << std::setfill('0') << h2 << std::setw(8) << std::setfill('0') << h3 << std::setw(8) << std::setfill('0') << h4;
-        std::string sha1hex = stream.str();
-        this->SHA1 = sha1hex;
-        return sha1hex;
+// Splits data into 64-byte chunks, keeping the incomplete remainder in chunk_buffer
+// All complete chunks are given to process_chunks at once, so SHA-NI kernels don't have to reload the state
+template<typename ProcessChunks>
+void SHA_update( uint8_t chunk_buffer[64], uint32_t& chunk_buffer_size, const uint8_t* data, uint64_t data_size, ProcessChunks process_chunks )
+{
+    if (chunk_buffer_size != 0) {
+        uint64_t copied = std::min<uint64_t>(64 - chunk_buffer_size, data_size);
+        std::memcpy( chunk_buffer + chunk_buffer_size, data, copied );
+        chunk_buffer_size += copied;
+        data += copied;
+        data_size -= copied;
+        if (chunk_buffer_size < 64) return;
+        process_chunks( chunk_buffer, 1 );
+        chunk_buffer_size = 0;
     }
-    return "";
+    process_chunks( data, data_size / 64 );
+    std::memcpy( chunk_buffer, data + data_size / 64 * 64, data_size % 64 );
+    chunk_buffer_size = data_size % 64;
 }
 
 
-std::string IntegrityValidation::get_SHA256_from_file(const std::string &path_to_file, bool &aborting_var) {
-    // based on: https://qvault.io/cryptography/how-sha-2-works-step-by-step-sha-256/
-
-    if (!aborting_var) {
-        uint32_t h0 = 0x6A09E667;
-        uint32_t h1 = 0xBB67AE85;
-        uint32_t h2 = 0x3C6EF372;
-        uint32_t h3 = 0xA54FF53A;
-        uint32_t h4 = 0x510E527F;
-        uint32_t h5 = 0x9B05688C;
-        uint32_t h6 = 0x1F83d9AB;
-        uint32_t h7 = 0x5BE0CD19;
-
-        uint32_t a;
-        uint32_t b;
-        uint32_t c;
-        uint32_t d;
-        uint32_t e;
-        uint32_t f;
-        uint32_t g;
-        uint32_t h;
-
-        uint32_t round_constants[64] = {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
-                                        0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
-                                        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
-                                        0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-                                        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
-                                        0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
-                                        0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
-                                        0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-                                        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
-                                        0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
-                                        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
-
-        std::ifstream target_file( path_to_file );
-        assert( target_file.is_open() );
-
-
-        uint32_t buffer_size = 64;
-        uint8_t buffer[buffer_size];
-        uint8_t leftover_buffer[buffer_size];
-
-        uint32_t chunks_size = 64;
-        uint32_t chunks[chunks_size];
-        for (uint32_t i=0; i < chunks_size; ++i) chunks[i] = 0;
-
-        uint64_t byte_counter = 0;
-
-
-
-        bool leftover = false;
-
-        while ( target_file.good() or leftover )
-        {
-            // loading data
-            if (!leftover) {
-                target_file.read((char *) &buffer, sizeof(buffer));
-                byte_counter += target_file.gcount();
-
-                if (target_file.gcount() < buffer_size) {
-                    uint64_t read_counter = target_file.gcount();
-                    buffer[read_counter] = 0x80;
-                    read_counter++;
-                    for (uint32_t i = read_counter; i < buffer_size; ++i) buffer[i] = 0;
-
-                    if (buffer_size - read_counter < 8) {
-                        leftover = true;
-                        for (uint32_t i = 0; i < buffer_size; ++i) leftover_buffer[i] = 0;
-                        for (int i = 0; i<8; ++i) leftover_buffer[56 + 7-i] = (byte_counter * 8 >> i * 8) & 0xFF;
-                    } else for (int i = 0; i<8 ; ++i) buffer[56 + 7-i] = (byte_counter * 8 >> i * 8) & 0xFF;
-                }
-            }
-            else {
-                leftover = false;
-                for (uint32_t i=0; i < buffer_size; ++i) buffer[i] = leftover_buffer[i];
-            }
-
-            for (uint8_t i = 0; i < 16; i++) // making 16 32-bit words from 64 8-bit words
-            {
-                uint64_t word = 0;
-                for (uint8_t j = 0; j < 4; j++) // making single 32-bit word
-                {
-                    word = (word << 8);
-                    word += buffer[i*4 + j];
-                }
-                chunks[i] = word;
-            }
+template<uint32_t word_count>
+std::string SHA_to_hex( const uint32_t h[word_count] )
+{
+    std::stringstream stream;
+    stream << std::hex;
+    for (uint32_t i=0; i < word_count; ++i) stream << std::setw(8) << std::setfill('0') << h[i];
+    return stream.str();
+}
+}
 
-            uint32_t S0, S1;
 
-            for (uint32_t i=16; i < chunks_size; i++)
-            {
-                S0 = std::rotr(chunks[i-15], 7) ^ std::rotr(chunks[i-15], 18) ^ (chunks[i-15] >> 3);
-                S1 = std::rotr(chunks[i-2], 17) ^ std::rotr(chunks[i-2], 19)  ^ (chunks[i-2] >> 10);
-                chunks[i] = chunks[i - 16] + S0 + chunks[i - 7] + S1;
-            }
+uint32_t calculate_CRC32C( const uint8_t* data, uint64_t data_size, uint32_t previous_crc )
+{
+    return crc::CRC32C(previous_crc, data, data_size);
+}
 
-            a = h0;
-            b = h1;
-            c = h2;
-            d = h3;
-            e = h4;
-            f = h5;
-            g = h6;
-            h = h7;
 
+std::string get_checksum_from_stream( ChecksumType type, std::istream& source, bool& aborting_var )
+{
+    std::unique_ptr<IncrementalChecksum> checksum_calculator = IncrementalChecksum::create(type);
+    if (checksum_calculator == nullptr) return "";
 
-            for ( uint32_t i = 0; i < buffer_size; i++)
-            {
-                S1 = std::rotr(e, 6) ^ std::rotr(e, 11) ^ std::rotr(e, 25);
-                uint32_t ch = (e & f) ^ ((~e) & g);
-                uint32_t temp1 = h + S1 + ch + round_constants[i] + chunks[i];
-                S0 = std::rotr(a, 2) ^ std::rotr(a, 13) ^ std::rotr(a, 22);
-                uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
-                uint32_t temp2 = S0 + maj;
-
-                h = g;
-                g = f;
-                f = e;
-                e = d+temp1;
-                d = c;
-                c = b;
-                b = a;
-                a = temp1 + temp2;
-            }
-            h0 += a;
-            h1 += b;
-            h2 += c;
-            h3 += d;
-            h4 += e;
-            h5 += f;
-            h6 += g;
-            h7 += h;
-        }
-        target_file.close();
-        if (aborting_var) return "";
-
-        std::stringstream stream;
-        stream << std::hex;
-        stream << std::setw(8) << std::setfill('0') << h0;
-        stream << std::setw(8) << std::setfill('0') << h1;
-        stream << std::setw(8) << std::setfill('0') << h2;
-        stream << std::setw(8) << std::setfill('0') << h3;
-        stream << std::setw(8) << std::setfill('0') << h4;
-        stream << std::setw(8) << std::setfill('0') << h5;
-        stream << std::setw(8) << std::setfill('0') << h6;
-        stream << std::setw(8) << std::setfill('0') << h7;
-
-        std::string sha256hex = stream.str();
-        this->SHA256 = sha256hex;
-
-        delete[] SHA256_num;
-        SHA256_num = new uint8_t [8*4]();
-        uint32_t copied_ctr = 0;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h0 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h1 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h2 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h3 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h4 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h5 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h6 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h7 >> (24 - i * 8)) & 0xFF;
-
-        return sha256hex;
+    std::vector<uint8_t> buffer(1024*1024);
+    while (source.good() and !aborting_var)
+    {
+        source.read((char*)buffer.data(), buffer.size());
+        checksum_calculator->update(buffer.data(), source.gcount());
     }
-    return "";
-}
 
+    if (aborting_var) return "";
+    return checksum_calculator->get_checksum();
+}
 
-std::string IntegrityValidation::get_SHA256_from_stream(std::fstream &target_file, bool &aborting_var) {
-    // based on: https://qvault.io/cryptography/how-sha-2-works-step-by-step-sha-256/
-
-    if (!aborting_var) {
-        // saving current location in the file, so we could return here after this algorithm
-        std::streamoff backup_pos = target_file.tellg();
-        target_file.seekg(0);
 
-        uint32_t h0 = 0x6A09E667;
-        uint32_t h1 = 0xBB67AE85;
-        uint32_t h2 = 0x3C6EF372;
-        uint32_t h3 = 0xA54FF53A;
-        uint32_t h4 = 0x510E527F;
-        uint32_t h5 = 0x9B05688C;
-        uint32_t h6 = 0x1F83d9AB;
-        uint32_t h7 = 0x5BE0CD19;
+std::string get_checksum_from_memory( ChecksumType type, const uint8_t* data, uint64_t data_size, bool& aborting_var )
+{
+    std::unique_ptr<IncrementalChecksum> checksum_calculator = IncrementalChecksum::create(type);
+    if (checksum_calculator == nullptr) return "";
 
-        uint32_t a;
-        uint32_t b;
-        uint32_t c;
-        uint32_t d;
-        uint32_t e;
-        uint32_t f;
-        uint32_t g;
-        uint32_t h;
+    // fed in 1 MiB parts, so aborting doesn't have to wait for the whole file
+    const uint64_t part_size = 1024*1024;
+    for (uint64_t i=0; i < data_size and !aborting_var; i += part_size)
+        checksum_calculator->update(data + i, std::min(part_size, data_size - i));
 
-        uint32_t round_constants[64] = {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
-                                        0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
-                                        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
-                                        0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-                                        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
-                                        0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
-                                        0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
-                                        0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-                                        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
-                                        0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
-                                        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+    if (aborting_var) return "";
+    return checksum_calculator->get_checksum();
+}
 
-        assert( target_file.is_open() );
 
+std::string get_checksum_from_file( ChecksumType type, const std::filesystem::path& path, bool& aborting_var )
+{
+    std::ifstream source(path, std::ios::binary);
+    return get_checksum_from_stream(type, source, aborting_var);
+}
 
-        uint32_t buffer_size = 64;
-        uint8_t buffer[buffer_size];
-        uint8_t leftover_buffer[buffer_size];
 
-        uint32_t chunks_size = 64;
-        uint32_t chunks[chunks_size];
-        for (uint32_t i=0; i < chunks_size; ++i) chunks[i] = 0;
+std::vector<std::string> get_SHA256_of_buffers( const std::vector<std::pair<const uint8_t*, uint64_t>>& buffers )
+{
+    std::vector<std::string> checksums(buffers.size());
 
-        uint64_t byte_counter = 0;
+    if (sha::has_SHA_instructions())
+    {
+        // with SHA-NI one buffer at a time is already quicker than 8 lanes of AVX2
+        bool aborting_var = false;
+        for (uint64_t i=0; i < buffers.size(); ++i)
+            checksums[i] = get_checksum_from_memory(ChecksumType::SHA256, buffers[i].first, buffers[i].second, aborting_var);
+        return checksums;
+    }
 
+    // every buffer is a job, which is given to one of 8 lanes, and next job takes its lane once it's finished
+    struct Job {
+        const uint8_t* data;
+        uint64_t data_chunks;       // complete 64-byte chunks of data
+        uint32_t padding_chunks;    // last incomplete chunk with padding
+        uint64_t next_chunk = 0;
+        uint8_t padding[128];
+        uint32_t h[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83d9AB, 0x5BE0CD19};
+    };
+    std::vector<Job> jobs(buffers.size());
+    for (uint64_t i=0; i < buffers.size(); ++i)
+    {
+        const auto& [data, data_size] = buffers[i];
+        jobs[i].data = data;
+        jobs[i].data_chunks = data_size / 64;
+        jobs[i].padding_chunks = SHA_padding(jobs[i].padding, data + data_size / 64 * 64, data_size % 64, data_size);
+    }
 
+    // empty lanes are calculating garbage
+    uint8_t empty_chunk[64] = {};
+    uint32_t empty_h[8] = {};
 
-        bool leftover = false;
+    int64_t lane_job[8];
+    uint64_t next_job = 0;
+    for (int64_t& job : lane_job) job = next_job < jobs.size() ? next_job++ : -1;
 
-        while ( target_file.good() or leftover )
+    while (true)
+    {
+        uint32_t* h[8];
+        const uint8_t* chunks[8];
+        bool any_job = false;
+        for (uint8_t lane=0; lane < 8; ++lane)
         {
-            // loading data
-            if (!leftover) {
-                target_file.read((char *) &buffer, sizeof(buffer));
-                byte_counter += target_file.gcount();
-
-                if (target_file.gcount() < buffer_size) {
-                    uint64_t read_counter = target_file.gcount();
-                    buffer[read_counter] = 0x80;
-                    read_counter++;
-                    for (uint32_t i = read_counter; i < buffer_size; ++i) buffer[i] = 0;
-
-                    if (buffer_size - read_counter < 8) {
-                        leftover = true;
-                        for (uint32_t i = 0; i < buffer_size; ++i) leftover_buffer[i] = 0;
-                        for (int i = 0; i<8; ++i) leftover_buffer[56 + 7-i] = (byte_counter * 8 >> i * 8) & 0xFF;
-                    } else for (int i = 0; i<8 ; ++i) buffer[56 + 7-i] = (byte_counter * 8 >> i * 8) & 0xFF;
-                }
-            }
-            else {
-                leftover = false;
-                for (uint32_t i=0; i < buffer_size; ++i) buffer[i] = leftover_buffer[i];
-            }
-
-            for (uint8_t i = 0; i < 16; i++) // making 16 32-bit words from 64 8-bit words
-            {
-                uint64_t word = 0;
-                for (uint8_t j = 0; j < 4; j++) // making single 32-bit word
-                {
-                    word = (word << 8);
-                    word += buffer[i*4 + j];
-                }
-                chunks[i] = word;
-            }
-
-            uint32_t S0, S1;
-
-            for (uint32_t i=16; i < chunks_size; i++)
-            {
-                S0 = std::rotr(chunks[i-15], 7) ^ std::rotr(chunks[i-15], 18) ^ (chunks[i-15] >> 3);
-                S1 = std::rotr(chunks[i-2], 17) ^ std::rotr(chunks[i-2], 19)  ^ (chunks[i-2] >> 10);
-                chunks[i] = chunks[i - 16] + S0 + chunks[i - 7] + S1;
-            }
-
-            a = h0;
-            b = h1;
-            c = h2;
-            d = h3;
-            e = h4;
-            f = h5;
-            g = h6;
-            h = h7;
+            h[lane] = empty_h;
+            chunks[lane] = empty_chunk;
+            if (lane_job[lane] == -1) continue;
+
+            Job& job = jobs[lane_job[lane]];
+            any_job = true;
+            h[lane] = job.h;
+            if (job.next_chunk < job.data_chunks) chunks[lane] = job.data + job.next_chunk * 64;
+            else chunks[lane] = job.padding + (job.next_chunk - job.data_chunks) * 64;
+        }
+        if (!any_job) break;
 
+        sha::SHA256_compress_8_lanes(h, chunks);
 
-            for ( uint32_t i = 0; i < buffer_size; i++)
+        for (uint8_t lane=0; lane < 8; ++lane)
+        {
+            if (lane_job[lane] == -1) continue;
+            Job& job = jobs[lane_job[lane]];
+            if (++job.next_chunk == job.data_chunks + job.padding_chunks)
             {
-                S1 = std::rotr(e, 6) ^ std::rotr(e, 11) ^ std::rotr(e, 25);
-                uint32_t ch = (e & f) ^ ((~e) & g);
-                uint32_t temp1 = h + S1 + ch + round_constants[i] + chunks[i];
-                S0 = std::rotr(a, 2) ^ std::rotr(a, 13) ^ std::rotr(a, 22);
-                uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
-                uint32_t temp2 = S0 + maj;
-
-                h = g;
-                g = f;
-                f = e;
-                e = d+temp1;
-                d = c;
-                c = b;
-                b = a;
-                a = temp1 + temp2;
+                checksums[lane_job[lane]] = SHA_to_hex<8>(job.h);
+                lane_job[lane] = next_job < jobs.size() ? next_job++ : -1;
             }
-            h0 += a;
-            h1 += b;
-            h2 += c;
-            h3 += d;
-            h4 += e;
-            h5 += f;
-            h6 += g;
-            h7 += h;
         }
+    }
+    return checksums;
+}
 
-        target_file.seekg(backup_pos);
-
-        if (aborting_var) return "";
-
-
-
-        std::stringstream stream;
-        stream << std::hex;
-        stream << std::setw(8) << std::setfill('0') << h0;
-        stream << std::setw(8) << std::setfill('0') << h1;
-        stream << std::setw(8) << std::setfill('0') << h2;
-        stream << std::setw(8) << std::setfill('0') << h3;
-        stream << std::setw(8) << std::setfill('0') << h4;
-        stream << std::setw(8) << std::setfill('0') << h5;
-        stream << std::setw(8) << std::setfill('0') << h6;
-        stream << std::setw(8) << std::setfill('0') << h7;
-
-        std::string sha256hex = stream.str();
-        this->SHA256 = sha256hex;
-
-        delete[] SHA256_num;
-        SHA256_num = new uint8_t [8*4]();
-        uint32_t copied_ctr = 0;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h0 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h1 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h2 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h3 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h4 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h5 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h6 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h7 >> (24 - i * 8)) & 0xFF;
 
-        return sha256hex;
+std::unique_ptr<IncrementalChecksum> IncrementalChecksum::create( ChecksumType type )
+{
+    switch (type)
+    {
+    case ChecksumType::none:   return nullptr;
+    case ChecksumType::CRC32:  return std::make_unique<IncrementalCRC32>();
+    case ChecksumType::CRC32C: return std::make_unique<IncrementalCRC32C>();
+    case ChecksumType::XXH3:   return std::make_unique<IncrementalXXH3>();
+    case ChecksumType::SHA1:   return std::make_unique<IncrementalSHA1>();
+    case ChecksumType::SHA256: return std::make_unique<IncrementalSHA256>();
     }
-    return "";
+    return nullptr;
 }
 
 
-std::string IntegrityValidation::get_SHA256_from_text( uint8_t text[], uint64_t text_size, bool& aborting_var ) {
-    // based on: https://qvault.io/cryptography/how-sha-2-works-step-by-step-sha-256/
-
-    if (!aborting_var) {
-        assert( text != nullptr and text_size != 0 );
-
-        uint32_t h0 = 0x6A09E667;
-        uint32_t h1 = 0xBB67AE85;
-        uint32_t h2 = 0x3C6EF372;
-        uint32_t h3 = 0xA54FF53A;
-        uint32_t h4 = 0x510E527F;
-        uint32_t h5 = 0x9B05688C;
-        uint32_t h6 = 0x1F83d9AB;
-        uint32_t h7 = 0x5BE0CD19;
-
-        uint32_t a;
-        uint32_t b;
-        uint32_t c;
-        uint32_t d;
-        uint32_t e;
-        uint32_t f;
-        uint32_t g;
-        uint32_t h;
-
-        uint32_t round_constants[64] = {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
-                                        0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
-                                        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
-                                        0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-                                        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
-                                        0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
-                                        0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
-                                        0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-                                        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
-                                        0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
-                                        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
-
-
-        uint32_t buffer_size = 64;
-        uint8_t buffer[buffer_size];
-        uint8_t leftover_buffer[buffer_size];
-
-        uint32_t chunks_size = 64;
-        uint32_t chunks[chunks_size];
-        for (uint32_t i=0; i < chunks_size; ++i) chunks[i] = 0;
-
-        uint64_t byte_counter = 0;
-
-        bool leftover = false;
-
-        uint32_t blocks = ceil((double)text_size / (double)buffer_size);
-
-        for (uint32_t current_block = 0; current_block < blocks; ++current_block)
-        {
-            // loading data
-            if (!leftover) {
-                if ((current_block+1) * buffer_size < text_size) {
-                    for (uint32_t i=(current_block * buffer_size); i < ((current_block+1) * buffer_size); ++i)
-                        buffer[i - current_block * buffer_size] = text[i];
-                    byte_counter += buffer_size;
-                }
-
-                else if ((current_block+1) * buffer_size != text_size)
-                {
-                    for (uint32_t i=current_block * buffer_size; i < text_size; ++i)
-                        buffer[i - current_block * buffer_size] = text[i];
-                    uint64_t read_counter = text_size - current_block * buffer_size;
-                    byte_counter += read_counter;
-
-                    buffer[read_counter] = 0x80;
-                    read_counter++;
-                    for (uint32_t i = read_counter; i < buffer_size; ++i) buffer[i] = 0;
-
-                    if (buffer_size - read_counter < 8) {
-                        blocks++;
-                        leftover = true;
-                        for (uint32_t i = 0; i < buffer_size; ++i) leftover_buffer[i] = 0;
-                        for (int i = 0; i<8; ++i) leftover_buffer[56 + 7-i] = (byte_counter * 8 >> i * 8) & 0xFF;
-                    } else for (int i = 0; i<8; ++i) buffer[56 + 7-i] = (byte_counter * 8 >> i * 8) & 0xFF;
-                }
-                else {  // (current_block+1) * buffer_size == text_size
-                    for (uint32_t i=current_block * buffer_size; i < text_size; ++i)
-                        buffer[i - current_block * buffer_size] = text[i];
-                    uint64_t read_counter = text_size - current_block * buffer_size;
-                    byte_counter += read_counter;
-                    blocks++;
-
-                    leftover = true;
-                    for (uint32_t i = 0; i < buffer_size; ++i) leftover_buffer[i] = 0;
-                    leftover_buffer[0] = 0x80;
-                    for (int i = 0; i<8; ++i) leftover_buffer[56 + 7-i] = (byte_counter * 8 >> i * 8) & 0xFF;//*/
-                }
-            }
-            else {
-                leftover = false;
-                for (uint32_t i=0; i < buffer_size; ++i) buffer[i] = leftover_buffer[i];
-            }
+IncrementalSHA1::IncrementalSHA1()
+: h{0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0} {}
 
-            for (uint8_t i = 0; i < 16; i++) // making 16 32-bit words from 64 8-bit words
-            {
-                uint64_t word = 0;
-                for (uint8_t j = 0; j < 4; j++) // making single 32-bit word
-                {
-                    word = (word << 8);
-                    word += buffer[i*4 + j];
-                }
-                chunks[i] = word;
-            }
 
-            uint32_t S0, S1;
+void IncrementalSHA1::update( const uint8_t* data, uint64_t data_size )
+{
+    byte_counter += data_size;
+    SHA_update( chunk_buffer, chunk_buffer_size, data, data_size, [this](const uint8_t* chunks, uint64_t count){ sha::SHA1_compress(h, chunks, count); } );
+}
 
-            for (uint32_t i=16; i < chunks_size; i++)
-            {
-                S0 = std::rotr(chunks[i-15], 7) ^ std::rotr(chunks[i-15], 18) ^ (chunks[i-15] >> 3);
-                S1 = std::rotr(chunks[i-2], 17) ^ std::rotr(chunks[i-2], 19)  ^ (chunks[i-2] >> 10);
-                chunks[i] = chunks[i - 16] + S0 + chunks[i - 7] + S1;
-            }
 
+std::string IncrementalSHA1::get_checksum()
+{
+    SHA_finish( chunk_buffer, chunk_buffer_size, byte_counter, [this](const uint8_t* chunks, uint64_t count){ sha::SHA1_compress(h, chunks, count); } );
+    chunk_buffer_size = 0;
+    return SHA_to_hex<5>(h);
+}
 
-            a = h0;
-            b = h1;
-            c = h2;
-            d = h3;
-            e = h4;
-            f = h5;
-            g = h6;
-            h = h7;
 
+IncrementalSHA256::IncrementalSHA256()
+: h{0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83d9AB, 0x5BE0CD19} {}
 
-            for ( uint32_t i = 0; i < buffer_size; i++)
-            {
-                S1 = std::rotr(e, 6) ^ std::rotr(e, 11) ^ std::rotr(e, 25);
-                uint32_t ch = (e & f) ^ ((~e) & g);
-                uint32_t temp1 = h + S1 + ch + round_constants[i] + chunks[i];
-                S0 = std::rotr(a, 2) ^ std::rotr(a, 13) ^ std::rotr(a, 22);
-                uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
-                uint32_t temp2 = S0 + maj;
-
-                h = g;
-                g = f;
-                f = e;
-                e = d+temp1;
-                d = c;
-                c = b;
-                b = a;
-                a = temp1 + temp2;
-            }
 
-            h0 += a;
-            h1 += b;
-            h2 += c;
-            h3 += d;
-            h4 += e;
-            h5 += f;
-            h6 += g;
-            h7 += h;
-        }
-        if (aborting_var) return "";
-
-
-        std::stringstream stream;
-        stream << std::hex;
-        stream << std::setw(8) << std::setfill('0') << h0;
-        stream << std::setw(8) << std::setfill('0') << h1;
-        stream << std::setw(8) << std::setfill('0') << h2;
-        stream << std::setw(8) << std::setfill('0') << h3;
-        stream << std::setw(8) << std::setfill('0') << h4;
-        stream << std::setw(8) << std::setfill('0') << h5;
-        stream << std::setw(8) << std::setfill('0') << h6;
-        stream << std::setw(8) << std::setfill('0') << h7;
-
-        std::string sha256hex = stream.str();
-        this->SHA256 = sha256hex;
-
-        delete[] SHA256_num;
-        SHA256_num = new uint8_t [8*4]();
-        uint32_t copied_ctr = 0;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h0 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h1 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h2 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h3 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h4 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h5 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h6 >> (24 - i * 8)) & 0xFF;
-        for (uint32_t i=0; i < 4; ++i) SHA256_num[copied_ctr++] = (h7 >> (24 - i * 8)) & 0xFF;
-
-
-        return sha256hex;
-    }
-    return "";
+void IncrementalSHA256::update( const uint8_t* data, uint64_t data_size )
+{
+    byte_counter += data_size;
+    SHA_update( chunk_buffer, chunk_buffer_size, data, data_size, [this](const uint8_t* chunks, uint64_t count){ sha::SHA256_compress(h, chunks, count); } );
 }
 
 
-void IntegrityValidation::generate_CRC32_lookup_table() {
-    //source: https://stackoverflow.com/questions/26049150/calculate-a-32-bit-crc-lookup-table-in-c-c/26051190
-    uint64_t poly = 0xEDB88320; // reversed 0x4C11DB7
-    uint64_t remainder;
-    for (uint16_t b = 0; b < 256; ++b) {
-        remainder = b;
-        for (uint64_t bit=8; bit > 0; --bit) {
-            if (remainder & 1)
-                remainder = (remainder >> 1) xor poly;
-            else
-                remainder >>= 1;
-        }
-        CRC32_lookup_table[b] = remainder;
-    }
+std::string IncrementalSHA256::get_checksum()
+{
+    SHA_finish( chunk_buffer, chunk_buffer_size, byte_counter, [this](const uint8_t* chunks, uint64_t count){ sha::SHA256_compress(h, chunks, count); } );
+    chunk_buffer_size = 0;
+    return SHA_to_hex<8>(h);
 }
 
 
-std::string IntegrityValidation::get_CRC32_from_text(uint8_t *text, uint64_t text_size, bool& aborting_var) {
-    // Based on pseudocode from wikipedia:
-    // https://en.wikipedia.org/wiki/Cyclic_redundancy_check#CRC-32_algorithm
-    uint32_t crc32 = UINT32_MAX;
-    for (uint64_t i=0; i < text_size; ++i and !aborting_var)
-        crc32 = (crc32 >> 8) xor CRC32_lookup_table[(crc32 xor (uint32_t)text[i]) & 0xFF];
-
-    if (!aborting_var) {
-        std::stringstream stream;
-        stream << "0x" << std::hex << std::setw(8) << std::setfill('0') << ~crc32;
-        std::string crc32_str = stream.str();
-        this->CRC32 = crc32_str;
-        return crc32_str;
-    }
-    else return "";
+void IncrementalCRC32::update( const uint8_t* data, uint64_t data_size )
+{
+    crc32 = crc::CRC32(crc32, data, data_size);
 }
 
 
-std::string IntegrityValidation::get_CRC32_from_file( std::string path, bool& aborting_var ) {
-    // Based on pseudocode from wikipedia:
-    // https://en.wikipedia.org/wiki/Cyclic_redundancy_check#CRC-32_algorithm
-
-    std::fstream source(path, std::ios::binary | std::ios::in);
-    uint8_t buffer[8*1024];
-
-
-    uint32_t crc32 = UINT32_MAX;
-    while (source.good())
-    {
-        source.read((char*)&buffer, sizeof(buffer));
-
-        for (uint64_t i=0; i < source.gcount(); ++i)
-        {
-            crc32 = (crc32 >> 8) xor CRC32_lookup_table[(crc32 xor (uint32_t)buffer[i]) & 0xFF];
-        }
-    }
-
-    if (!aborting_var) {
-        std::stringstream stream;
-        stream << "0x" << std::hex << std::setw(8) << std::setfill('0') << ~crc32;
-        std::string crc32_str = stream.str();
-        this->CRC32 = crc32_str;
-        return crc32_str;
-    }
-    else return "";
+std::string IncrementalCRC32::get_checksum()
+{
+    std::stringstream stream;
+    stream << "0x" << std::hex << std::setw(8) << std::setfill('0') << crc32;
+    return stream.str();
 }
 
 
-std::string IntegrityValidation::get_CRC32_from_stream(std::fstream &source, bool &aborting_var) {
-    // Based on pseudocode from wikipedia:
-    // https://en.wikipedia.org/wiki/Cyclic_redundancy_check#CRC-32_algorithm
-
-    assert( source.is_open() );
-    uint64_t backup_pos = source.tellg();
-
-    uint8_t buffer[8*1024];
-
-    source.seekg(0);
+void IncrementalCRC32C::update( const uint8_t* data, uint64_t data_size )
+{
+    crc32c = crc::CRC32C(crc32c, data, data_size);
+}
 
-    uint32_t crc32 = UINT32_MAX;
-    while (source.good())
-    {
-        source.read((char*)&buffer, sizeof(buffer));
 
-        for (uint64_t i=0; i < source.gcount(); ++i)
-        {
-            crc32 = (crc32 >> 8) xor CRC32_lookup_table[(crc32 xor (uint32_t)buffer[i]) & 0xFF];
-        }
-    }
+std::string IncrementalCRC32C::get_checksum()
+{
+    std::stringstream stream;
+    stream << "0x" << std::hex << std::setw(8) << std::setfill('0') << crc32c;
+    return stream.str();
+}
 
 
-    source.seekg(backup_pos);
-    if (!aborting_var) {
-        std::stringstream stream;
-        stream << "0x" << std::hex << std::setw(8) << std::setfill('0') << ~crc32;
-        std::string crc32_str = stream.str();
-        this->CRC32 = crc32_str;
-        return crc32_str;
-    }
-    else return "";
+void IncrementalXXH3::update( const uint8_t* data, uint64_t data_size )
+{
+    state.update(data, data_size);
 }
 
 
+std::string IncrementalXXH3::get_checksum()
+{
+    std::stringstream stream;
+    stream << std::hex << std::setw(16) << std::setfill('0') << state.digest();
+    return stream.str();
+}
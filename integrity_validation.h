@@ -2,8 +2,51 @@
 #define INTEGRITY_VALIDATION_H
 
 #include <string>
+#include <memory>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+#include <iosfwd>
 
+#include "misc/xxh3.h"
 
+
+// Type of checksum which is stored after compressed data of a file (flags 13-15)
+enum class ChecksumType
+{
+    none,
+    CRC32,
+    CRC32C,
+    SHA1,
+    SHA256,
+    XXH3        // 64-bit, non-cryptographic
+};
+
+// Returns type of checksum selected by bits 13-15 of file's flags
+ChecksumType get_checksum_type_from_flags( uint16_t flags );
+
+// Returns bits 13-15 of flags, which select given type of checksum
+uint16_t get_flags_from_checksum_type( ChecksumType type );
+
+// Returns length (in bytes) of checksum string of given type, as saved in archive
+uint32_t get_checksum_length( ChecksumType type );
+
+// Calculates CRC-32C (Castagnoli) of given data, continuing from previous_crc
+// Used for checksums of single blocks, so it's safe to call from many threads at once
+uint32_t calculate_CRC32C( const uint8_t* data, uint64_t data_size, uint32_t previous_crc = 0 );
+
+// Calculates checksum of given type from current position to the end of stream, reading it in 1 MiB parts
+// Returns empty string for ChecksumType::none, or when aborted
+std::string get_checksum_from_stream( ChecksumType type, std::istream& source, bool& aborting_var );
+std::string get_checksum_from_file( ChecksumType type, const std::filesystem::path& path, bool& aborting_var );
+std::string get_checksum_from_memory( ChecksumType type, const uint8_t* data, uint64_t data_size, bool& aborting_var );
+
+// Calculates SHA-256 of many independent buffers (e.g. small files) at once,
+// 8 of them in parallel with AVX2, unless CPU has SHA-NI
+std::vector<std::string> get_SHA256_of_buffers( const std::vector<std::pair<const uint8_t*, uint64_t>>& buffers );
+
+
+// Older interface, every method is a wrapper for get_checksum_from_* functions
 class IntegrityValidation {
 public:
     // strings of hex chars
@@ -25,12 +68,79 @@ public:
     std::string get_SHA256_from_stream( std::fstream& source, bool& aborting_var );
     std::string get_SHA256_from_text( uint8_t text[], uint64_t text_size, bool& aborting_var );
 
-    void generate_CRC32_lookup_table();
     std::string get_CRC32_from_text( uint8_t text[], uint64_t text_size, bool& aborting_var );
     std::string get_CRC32_from_file( std::string path, bool& aborting_var );
     std::string get_CRC32_from_stream( std::fstream& source, bool& aborting_var );
+};
+
+
+// Checksum calculated from data given in consecutive parts,
+// so it can be computed while the data is being written, instead of reading it back afterwards
+class IncrementalChecksum {
+public:
+    virtual ~IncrementalChecksum() = default;
+
+    // Feeds next part of data into checksum
+    virtual void update( const uint8_t* data, uint64_t data_size ) = 0;
+
+    // Finishes calculation, and returns checksum in the same format as IntegrityValidation does
+    virtual std::string get_checksum() = 0;
+
+    // Returns nullptr for ChecksumType::none
+    static std::unique_ptr<IncrementalChecksum> create( ChecksumType type );
+};
+
+
+class IncrementalSHA1 : public IncrementalChecksum {
+public:
+    IncrementalSHA1();
+    void update( const uint8_t* data, uint64_t data_size ) override;
+    std::string get_checksum() override;
+private:
+    uint32_t h[5];
+    uint8_t chunk_buffer[64];
+    uint32_t chunk_buffer_size = 0;
+    uint64_t byte_counter = 0;
+};
+
+
+class IncrementalSHA256 : public IncrementalChecksum {
+public:
+    IncrementalSHA256();
+    void update( const uint8_t* data, uint64_t data_size ) override;
+    std::string get_checksum() override;
+private:
+    uint32_t h[8];
+    uint8_t chunk_buffer[64];
+    uint32_t chunk_buffer_size = 0;
+    uint64_t byte_counter = 0;
+};
+
+
+class IncrementalCRC32 : public IncrementalChecksum {
+public:
+    void update( const uint8_t* data, uint64_t data_size ) override;
+    std::string get_checksum() override;
+private:
+    uint32_t crc32 = 0;
+};
+
+
+class IncrementalCRC32C : public IncrementalChecksum {
+public:
+    void update( const uint8_t* data, uint64_t data_size ) override;
+    std::string get_checksum() override;
+private:
+    uint32_t crc32c = 0;
+};
+
+
+class IncrementalXXH3 : public IncrementalChecksum {
+public:
+    void update( const uint8_t* data, uint64_t data_size ) override;
+    std::string get_checksum() override;
 private:
-    uint32_t CRC32_lookup_table[256];
+    xxh3::XXH3_64_state state;
 };
 
 #endif
@@ -0,0 +1,148 @@
+#include "append_journal.h"
+
+#include <iostream>
+#include <cstring>
+
+#include "integrity_validation.h"
+#include "positional_io.h"
+
+
+namespace
+{
+    const char magic[8] = {'T','K','2','K','_','J','N','L'};
+
+    void put_u32( std::vector<uint8_t>& buffer, uint32_t value )
+    {
+        for (uint8_t i=0; i < 4; i++) buffer.push_back( (value >> (i*8u)) & 0xFFu );
+    }
+
+    void put_u64( std::vector<uint8_t>& buffer, uint64_t value )
+    {
+        for (uint8_t i=0; i < 8; i++) buffer.push_back( (value >> (i*8u)) & 0xFFu );
+    }
+
+    uint32_t get_u32( const uint8_t* buffer )
+    {
+        return ((uint32_t)buffer[0]) | ((uint32_t)buffer[1]<<8u) | ((uint32_t)buffer[2]<<16u) | ((uint32_t)buffer[3]<<24u);
+    }
+
+    uint64_t get_u64( const uint8_t* buffer )
+    {
+        return ((uint64_t)get_u32(buffer)) | ((uint64_t)get_u32(buffer+4) << 32u);
+    }
+
+    // stream is flushed first, since descriptor knows nothing about its buffer
+    bool sync( std::fstream& archive_file )
+    {
+        archive_file.flush();
+        PositionalFile file;
+        return archive_file.good() and file.attach(archive_file) and file.sync();
+    }
+}
+
+
+void AppendJournal::add( uint64_t position, uint64_t value )
+{
+    patches.emplace_back(position, value);
+}
+
+
+bool AppendJournal::commit( std::fstream& archive_file, const std::filesystem::path& path )
+{
+    if (patches.empty()) return true;
+
+    // new data has to be on the disk before anything points at it
+    if (!sync(archive_file)) return false;
+
+    std::vector<uint8_t> journal;
+    for (auto& [position, value] : patches)
+    {
+        put_u64(journal, position);
+        put_u64(journal, value);
+    }
+
+    archive_file.seekp(0, std::ios_base::end);
+    const uint64_t journal_location = archive_file.tellp();
+    const uint32_t checksum = calculate_CRC32C(journal.data(), journal.size());
+    put_u64(journal, journal_location);
+    put_u32(journal, patches.size());
+    put_u32(journal, checksum);
+    journal.insert(journal.end(), magic, magic + 8);
+
+    archive_file.write((char*)journal.data(), journal.size());
+    if (!sync(archive_file)) return false;
+
+    const bool applied = apply(archive_file, path, journal_location, patches);
+    if (applied) patches.clear();
+    return applied;
+}
+
+
+bool AppendJournal::apply( std::fstream& archive_file, const std::filesystem::path& path, uint64_t journal_location,
+                           const std::vector<std::pair<uint64_t, uint64_t>>& patches )
+{
+    for (auto& [position, value] : patches)
+    {
+        uint8_t buffer[8];
+        for (uint8_t i=0; i < 8; i++) buffer[i] = (value >> (i*8u)) & 0xFFu;
+        archive_file.seekp(position);
+        archive_file.write((char*)buffer, 8);
+    }
+    if (!sync(archive_file)) return false;
+
+    // links are safe now, journal isn't needed anymore
+    std::error_code error;
+    std::filesystem::resize_file(path, journal_location, error);
+    if (error)
+    {
+        std::cout << "append journal couldn't be removed: " << error.message() << std::endl;
+        return false;
+    }
+
+    // stream has to forget what it knew about the old end of file
+    archive_file.seekg(0, std::ios_base::end);
+    archive_file.seekp(0, std::ios_base::end);
+    return true;
+}
+
+
+bool AppendJournal::recover( std::fstream& archive_file, const std::filesystem::path& path )
+{
+    archive_file.clear();
+    archive_file.seekg(0, std::ios_base::end);
+    const uint64_t archive_size = archive_file.tellg();
+    if (archive_size < 1 + trailer_size) return true;
+
+    uint8_t trailer[trailer_size];
+    archive_file.seekg(archive_size - trailer_size);
+    archive_file.read((char*)trailer, trailer_size);
+    if (archive_file.gcount() != trailer_size or memcmp(trailer + 16, magic, 8) != 0)
+    {
+        archive_file.clear();
+        return true;
+    }
+
+    const uint64_t journal_location = get_u64(trailer);
+    const uint32_t entry_count = get_u32(trailer + 8);
+    if (journal_location < 2 or journal_location + (uint64_t)entry_count*16 + trailer_size != archive_size) return true;
+
+    std::vector<uint8_t> journal((uint64_t)entry_count*16);
+    archive_file.seekg(journal_location);
+    archive_file.read((char*)journal.data(), journal.size());
+    if ((uint64_t)archive_file.gcount() != journal.size() or calculate_CRC32C(journal.data(), journal.size()) != get_u32(trailer + 12))
+    {
+        // journal is synced before any link is written, so damaged journal means nothing was changed yet
+        archive_file.clear();
+        return true;
+    }
+
+    std::cout << "archive has unfinished append, finishing it" << std::endl;
+    std::vector<std::pair<uint64_t, uint64_t>> patches;
+    for (uint64_t i=0; i < journal.size(); i += 16)
+    {
+        const uint64_t position = get_u64(&journal[i]);
+        if (position + 8 > journal_location) return false;
+        patches.emplace_back(position, get_u64(&journal[i + 8]));
+    }
+    return apply(archive_file, path, journal_location, patches);
+}
@@ -0,0 +1,49 @@
+#ifndef APPEND_JOURNAL_H
+#define APPEND_JOURNAL_H
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <utility>
+#include <vector>
+
+
+// Makes adding (and removing) files in an existing archive safe without copying the whole archive first.
+// New data and headers are appended at the end, where nothing points at them yet, so a crash there
+// leaves only unused bytes. Links to them (locations in headers which already were in archive)
+// are collected here instead of being written right away (removed entries are unlinked the same way),
+// and are written all at once by commit():
+//
+//   1. everything appended so far is synced to the disk
+//   2. journal with all the links is appended and synced
+//   3. links are written into headers and synced
+//   4. journal is cut off the end of archive
+//
+// If the program stops between 2 and 4, journal is still at the end of archive, and recover()
+// (called when archive is loaded) writes the links again. Writing a link twice changes nothing.
+//
+// Layout:
+//   entries:  [position u64][value u64] for every link
+//   trailer:  [journal location u64][entry count u32][CRC-32C of entries u32][magic "TK2K_JNL"]
+class AppendJournal
+{
+public:
+    static const uint32_t trailer_size = 24;
+
+    // Location value will be written at position, but only when journal is committed
+    void add( uint64_t position, uint64_t value );
+    bool empty() const { return patches.empty(); }
+
+    bool commit( std::fstream& archive_file, const std::filesystem::path& path );
+
+    // Finishes commit interrupted by a crash, false if journal was found, but couldn't be applied
+    static bool recover( std::fstream& archive_file, const std::filesystem::path& path );
+
+private:
+    static bool apply( std::fstream& archive_file, const std::filesystem::path& path, uint64_t journal_location,
+                       const std::vector<std::pair<uint64_t, uint64_t>>& patches );
+
+    std::vector<std::pair<uint64_t, uint64_t>> patches;
+};
+
+#endif // APPEND_JOURNAL_H
@@ -0,0 +1,369 @@
+#include "central_directory.h"
+
+#include <iostream>
+#include <cstring>
+
+#include "archive_structures.h"
+#include "integrity_validation.h"
+#include "free_space.h"
+
+
+namespace
+{
+    const char magic[8] = {'T','K','2','K','_','D','I','R'};
+
+    enum RecordType : uint8_t
+    {
+        folder_record = 0,
+        file_record = 1,
+        free_record = 2,    // isn't a header, only location and size of unused range
+        stamp_record = 3    // modification time and XXH3 of source file, for file header at location
+    };
+
+    void put_u32( std::vector<uint8_t>& buffer, uint32_t value )
+    {
+        for (uint8_t i=0; i < 4; i++) buffer.push_back( (value >> (i*8u)) & 0xFFu );
+    }
+
+    void put_u64( std::vector<uint8_t>& buffer, uint64_t value )
+    {
+        for (uint8_t i=0; i < 8; i++) buffer.push_back( (value >> (i*8u)) & 0xFFu );
+    }
+
+    uint32_t get_u32( const uint8_t* buffer )
+    {
+        return ((uint32_t)buffer[0]) | ((uint32_t)buffer[1]<<8u) | ((uint32_t)buffer[2]<<16u) | ((uint32_t)buffer[3]<<24u);
+    }
+
+    uint64_t get_u64( const uint8_t* buffer )
+    {
+        return ((uint64_t)get_u32(buffer)) | ((uint64_t)get_u32(buffer+4) << 32u);
+    }
+
+    void add_record( std::vector<uint8_t>& records, RecordType type, uint64_t location, uint32_t header_size )
+    {
+        records.push_back(type);
+        put_u64(records, location);
+        records.resize(records.size() + header_size);
+    }
+
+    // Same transforms as in files, but always in this order and with this set, regardless of settings,
+    // so directory can be read back no matter how the files were compressed.
+    // AC2 isn't used, since its table alone (256 KiB) is bigger than most directories
+    void encode_part( const uint8_t* data, uint32_t size, std::vector<uint8_t>& output )
+    {
+        bool aborting_var = false;
+        Compression comp(aborting_var);
+        auto text = new uint8_t[size];
+        memcpy(text, data, size);
+        comp.replace_text(text);
+        comp.size = size;
+
+        comp.BWT_make2();
+        comp.MTF_make();
+        comp.RLE_makeV2();
+        comp.AC_make();
+
+        if (comp.size < size)
+        {
+            put_u32(output, comp.size);
+            put_u32(output, size);
+            output.insert(output.end(), comp.text, comp.text + comp.size);
+        }
+        else
+        {
+            // data which doesn't get smaller is stored as it is
+            put_u32(output, size);
+            put_u32(output, size);
+            output.insert(output.end(), data, data + size);
+        }
+    }
+
+    bool decode_part( const uint8_t* data, uint32_t stored_size, uint32_t original_size, std::vector<uint8_t>& output )
+    {
+        if (stored_size == original_size)
+        {
+            output.insert(output.end(), data, data + stored_size);
+            return true;
+        }
+
+        bool aborting_var = false;
+        Compression comp(aborting_var);
+        auto text = new uint8_t[stored_size];
+        memcpy(text, data, stored_size);
+        comp.replace_text(text);
+        comp.size = stored_size;
+
+        comp.AC_reverse();
+        comp.RLE_reverseV2();
+        comp.MTF_reverse();
+        comp.BWT_reverse2();
+
+        if (comp.size != original_size) return false;
+        output.insert(output.end(), comp.text, comp.text + comp.size);
+        return true;
+    }
+}
+
+
+CentralDirectory::CentralDirectory( std::fstream& archive_file ) : archive(&archive_file) {}
+
+
+uint64_t CentralDirectory::find( std::fstream& archive_file, uint64_t& directory_size, uint32_t& entry_count,
+                                 uint32_t& checksum, uint16_t& flags )
+{
+    archive_file.clear();
+    archive_file.seekg(0, std::ios_base::end);
+    const uint64_t archive_size = archive_file.tellg();
+    if (archive_size < 1 + trailer_size) return 0;
+
+    uint8_t trailer[trailer_size];
+    archive_file.seekg(archive_size - trailer_size);
+    archive_file.read((char*)trailer, trailer_size);
+    if (archive_file.gcount() != trailer_size or memcmp(trailer + 28, magic, 8) != 0) return 0;
+
+    const uint64_t directory_location = get_u64(trailer);
+    directory_size = get_u64(trailer + 8);
+    entry_count = get_u32(trailer + 16);
+    checksum = get_u32(trailer + 20);
+    flags = trailer[24] | (trailer[25] << 8u);
+
+    // anything written after the directory (e.g. appended files) makes it outdated
+    if (directory_location < 2 or directory_location + directory_size + trailer_size != archive_size) return 0;
+    return directory_location;
+}
+
+
+bool CentralDirectory::load( FreeSpace* free_space )
+{
+    loaded = false;
+    records.clear();
+    record_offsets.clear();
+    stamps.clear();
+
+    uint64_t directory_size = 0;
+    uint32_t entry_count = 0, checksum = 0;
+    uint16_t flags = 0;
+    const uint64_t directory_location = find(*archive, directory_size, entry_count, checksum, flags);
+    if (directory_location == 0) return false;
+
+    // the whole directory in one read
+    std::vector<uint8_t> stored(directory_size);
+    archive->seekg(directory_location);
+    archive->read((char*)stored.data(), directory_size);
+    if ((uint64_t)archive->gcount() != directory_size or calculate_CRC32C(stored.data(), directory_size) != checksum)
+    {
+        std::cout << "central directory is corrupted, reading headers one by one" << std::endl;
+        archive->clear();
+        return false;
+    }
+
+    uint64_t position = 0;
+    while (position + 8 <= directory_size)
+    {
+        const uint32_t stored_size = get_u32(&stored[position]);
+        const uint32_t original_size = get_u32(&stored[position + 4]);
+        position += 8;
+        if (stored_size > directory_size - position or original_size > part_size
+            or !decode_part(&stored[position], stored_size, original_size, records))
+        {
+            std::cout << "central directory couldn't be decoded, reading headers one by one" << std::endl;
+            records.clear();
+            return false;
+        }
+        position += stored_size;
+    }
+    if (position != directory_size) records.clear();
+
+    record_offsets.reserve(entry_count);
+    std::vector<std::pair<uint64_t, uint64_t>> free_extents;
+    position = 0;
+    while (position + 10 <= records.size())
+    {
+        const uint8_t type = records[position];
+        const uint64_t location = get_u64(&records[position + 1]);
+        if (type == free_record)
+        {
+            if (position + 17 > records.size()) break;
+            free_extents.emplace_back(location, get_u64(&records[position + 9]));
+            position += 17;
+            continue;
+        }
+        if (type == stamp_record)
+        {
+            if (position + 25 > records.size()) break;
+            stamps[location] = { (int64_t)get_u64(&records[position + 9]), get_u64(&records[position + 17]) };
+            position += 25;
+            continue;
+        }
+
+        const uint32_t header_size = (type == folder_record ? Folder::base_metadata_size : File::base_metadata_size) + records[position + 9];
+        if (type > file_record or position + 9 + header_size > records.size()) break;
+
+        record_offsets[location] = position;
+        position += 9 + header_size;
+    }
+
+    if (records.empty() or position != records.size() or record_offsets.size() != entry_count)
+    {
+        std::cout << "central directory is damaged, reading headers one by one" << std::endl;
+        records.clear();
+        record_offsets.clear();
+        stamps.clear();
+        return false;
+    }
+
+    // free ranges are taken only from directory which is known to be right
+    if (free_space != nullptr)
+        for (auto& [location, size] : free_extents)
+            if (location > 0 and location + size <= directory_location) free_space->release(location, size);
+
+    loaded = true;
+    return true;
+}
+
+
+const uint8_t* CentralDirectory::get_header( uint64_t location, bool is_folder, std::vector<uint8_t>& scratch )
+{
+    if (loaded)
+    {
+        auto record = record_offsets.find(location);
+        if (record != record_offsets.end() and records[record->second] == (is_folder ? folder_record : file_record))
+            return &records[record->second + 9];
+    }
+
+    // header isn't in the directory, so it's read from the archive
+    archive->clear();
+    archive->seekg(location);
+    const int name_length = archive->get();
+    if (name_length == EOF) return nullptr;
+
+    scratch.resize((is_folder ? Folder::base_metadata_size : File::base_metadata_size) + name_length);
+    scratch[0] = name_length;
+    archive->read((char*)&scratch[1], scratch.size() - 1);
+    if ((uint64_t)archive->gcount() != scratch.size() - 1)
+    {
+        archive->clear();
+        return nullptr;
+    }
+    return scratch.data();
+}
+
+
+bool CentralDirectory::get_stamp( uint64_t location, int64_t& modification_time, uint64_t& fast_hash ) const
+{
+    if (!loaded) return false;
+    auto stamp = stamps.find(location);
+    if (stamp == stamps.end()) return false;
+
+    modification_time = stamp->second.first;
+    fast_hash = stamp->second.second;
+    return true;
+}
+
+
+bool CentralDirectory::write( std::fstream& archive_file, Folder& root, const FreeSpace* free_space, bool compress )
+{
+    std::vector<uint8_t> records;
+    std::vector<uint8_t> stamps;
+    uint32_t entry_count = 0;
+
+    // tree is walked with a stack, since sibling lists can be very long
+    std::vector<Folder*> folders{ &root };
+    while (!folders.empty())
+    {
+        Folder* folder = folders.back();
+        folders.pop_back();
+
+        for (; folder != nullptr; folder = folder->sibling_ptr.get())
+        {
+            if (!folder->alreadySaved) return false;
+            folder->parse_children();
+            add_record(records, folder_record, folder->location, Folder::base_metadata_size + folder->name_length);
+            folder->write_header(&records[records.size() - Folder::base_metadata_size - folder->name_length]);
+            entry_count++;
+
+            for (const File* file = folder->child_file_ptr.get(); file != nullptr; file = file->sibling_ptr.get())
+            {
+                if (!file->alreadySaved) return false;
+                add_record(records, file_record, file->location, File::base_metadata_size + file->name_length);
+                file->write_header(&records[records.size() - File::base_metadata_size - file->name_length]);
+                entry_count++;
+
+                if (file->modification_time != 0 or file->fast_hash != 0)
+                {
+                    stamps.push_back(stamp_record);
+                    put_u64(stamps, file->location);
+                    put_u64(stamps, file->modification_time);
+                    put_u64(stamps, file->fast_hash);
+                }
+            }
+
+            if (folder->child_dir_ptr) folders.push_back(folder->child_dir_ptr.get());
+        }
+    }
+
+    if (free_space != nullptr)
+        for (auto& [location, size] : free_space->get_extents())
+        {
+            records.push_back(free_record);
+            put_u64(records, location);
+            put_u64(records, size);
+        }
+    records.insert(records.end(), stamps.begin(), stamps.end());
+
+    std::vector<uint8_t> directory;
+    for (uint64_t position=0; position < records.size(); position += part_size)
+    {
+        const uint32_t size = std::min<uint64_t>(part_size, records.size() - position);
+        if (compress and size > 4096) encode_part(&records[position], size, directory);
+        else
+        {
+            put_u32(directory, size);
+            put_u32(directory, size);
+            directory.insert(directory.end(), records.begin() + position, records.begin() + position + size);
+        }
+    }
+
+    archive_file.clear();
+    archive_file.seekp(0, std::ios_base::end);
+    const uint64_t directory_location = archive_file.tellp();
+
+    std::vector<uint8_t> trailer;
+    put_u64(trailer, directory_location);
+    put_u64(trailer, directory.size());
+    put_u32(trailer, entry_count);
+    put_u32(trailer, calculate_CRC32C(directory.data(), directory.size()));
+    // flags, bit 0: parts may be compressed, bit 1: there are records of unused ranges, bit 2: there are stamps
+    trailer.push_back((compress ? 1 : 0) | (free_space != nullptr and !free_space->empty() ? 2 : 0) | (!stamps.empty() ? 4 : 0));
+    trailer.push_back(0);
+    trailer.push_back(0);                   // reserved
+    trailer.push_back(0);
+    trailer.insert(trailer.end(), magic, magic + 8);
+
+    archive_file.write((char*)directory.data(), directory.size());
+    archive_file.write((char*)trailer.data(), trailer.size());
+    archive_file.flush();
+    return archive_file.good();
+}
+
+
+void CentralDirectory::remove( std::fstream& archive_file, const std::filesystem::path& path )
+{
+    archive_file.flush();
+
+    uint64_t directory_size = 0;
+    uint32_t entry_count = 0, checksum = 0;
+    uint16_t flags = 0;
+    const uint64_t directory_location = find(archive_file, directory_size, entry_count, checksum, flags);
+    archive_file.clear();
+    if (directory_location == 0) return;
+
+    std::error_code error;
+    std::filesystem::resize_file(path, directory_location, error);
+    if (error) std::cout << "central directory couldn't be removed: " << error.message() << std::endl;
+
+    // stream has to forget what it knew about the old end of file
+    archive_file.seekg(0, std::ios_base::end);
+    archive_file.seekp(0, std::ios_base::end);
+}
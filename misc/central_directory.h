@@ -0,0 +1,70 @@
+#ifndef CENTRAL_DIRECTORY_H
+#define CENTRAL_DIRECTORY_H
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+struct Folder;
+class FreeSpace;
+
+
+// Copy of all folder and file headers, kept together at the end of archive.
+// Headers themselves are scattered between data of files, so reading them one by one means
+// a seek for every entry. With central directory whole tree is loaded with one read.
+//
+// Layout, written after the last file:
+//   directory:  parts of at most 1 MiB, each [stored size u32][original size u32][payload]
+//               payload is compressed (BWT2, MTF, RLE, AC) if stored size < original size
+//               after decoding, parts are a list of records [type u8][location u64][header, same bytes as in archive]
+//               or, for unused ranges of archive (type 2), [type u8][location u64][size u64]
+//               or, for source files of file headers (type 3), [type u8][location of file header u64]
+//               [modification time i64, ns since 1970][XXH3-64 of contents u64, 0 if unknown]
+//   trailer:    [directory location u64][directory size u64][entry count u32][CRC-32C of directory u32]
+//               [flags u16][reserved u16][magic "TK2K_DIR"]
+// Stamps (type 3) aren't in file headers, since their layout is fixed and all 16 flags are used.
+// They're only used by Archive::update(), so an archive without directory is simply updated as a whole.
+//
+// Directory is valid only if trailer ends exactly at the end of archive. Every change of archive appends
+// something, so old directory stops being valid on its own, and headers are read from their locations instead.
+class CentralDirectory
+{
+public:
+    static const uint32_t trailer_size = 36;
+    static const uint32_t part_size = 1u << 20;
+
+    explicit CentralDirectory( std::fstream& archive_file );
+
+    // Reads directory from the end of archive, false if there's none, or it's outdated/corrupted
+    // Unused ranges saved in it are added to free_space
+    bool load( FreeSpace* free_space = nullptr );
+    bool is_loaded() const { return loaded; }
+
+    // Returns pointer to header at given location, taken from directory if possible,
+    // or read from the archive itself into scratch. nullptr if header can't be read.
+    const uint8_t* get_header( uint64_t location, bool is_folder, std::vector<uint8_t>& scratch );
+
+    // Modification time and XXH3 of source file of file header at given location, false if directory has none
+    bool get_stamp( uint64_t location, int64_t& modification_time, uint64_t& fast_hash ) const;
+
+    // Writes directory of given tree at the end of archive. Every node has to be saved already,
+    // folders which weren't parsed yet are parsed on the way.
+    static bool write( std::fstream& archive_file, Folder& root, const FreeSpace* free_space = nullptr, bool compress = true );
+
+    // Cuts valid directory off the end of archive, so appended data doesn't leave it unused in the middle
+    static void remove( std::fstream& archive_file, const std::filesystem::path& path );
+
+private:
+    static uint64_t find( std::fstream& archive_file, uint64_t& directory_size, uint32_t& entry_count,
+                          uint32_t& checksum, uint16_t& flags );
+
+    std::fstream* archive;
+    bool loaded = false;
+    std::vector<uint8_t> records;
+    std::unordered_map<uint64_t, uint64_t> record_offsets;  // header location -> offset of record in records
+    std::unordered_map<uint64_t, std::pair<int64_t, uint64_t>> stamps;  // file header location -> modification time, XXH3
+};
+
+#endif // CENTRAL_DIRECTORY_H
@@ -0,0 +1,281 @@
+#include "crc32.h"
+
+#include <cstring>
+#include <bit>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CRC32_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+
+namespace
+{
+// every function below works on the inverted CRC state, crc::CRC32 and crc::CRC32C invert it on their way in and out
+using CRC_function = uint32_t (*)( uint32_t crc, const uint8_t* data, uint64_t data_size );
+
+
+struct SlicingTables
+{
+    // table[0] is the usual byte-at-a-time table,
+    // table[k][b] is CRC of byte b followed by k zero bytes
+    uint32_t table[16][256];
+
+    explicit SlicingTables( uint32_t poly )
+    {
+        //source: https://stackoverflow.com/questions/26049150/calculate-a-32-bit-crc-lookup-table-in-c-c/26051190
+        for (uint16_t b = 0; b < 256; ++b) {
+            uint32_t remainder = b;
+            for (uint8_t bit=8; bit > 0; --bit) {
+                if (remainder & 1)
+                    remainder = (remainder >> 1) xor poly;
+                else
+                    remainder >>= 1;
+            }
+            table[0][b] = remainder;
+        }
+
+        for (uint16_t b = 0; b < 256; ++b)
+            for (uint8_t k = 1; k < 16; ++k)
+                table[k][b] = (table[k-1][b] >> 8) xor table[0][table[k-1][b] & 0xFF];
+    }
+};
+
+
+const SlicingTables& get_CRC32_tables()
+{
+    static const SlicingTables tables(0xEDB88320);     // reversed 0x04C11DB7
+    return tables;
+}
+
+
+const SlicingTables& get_CRC32C_tables()
+{
+    static const SlicingTables tables(0x82F63B78);     // reversed 0x1EDC6F41
+    return tables;
+}
+
+
+uint32_t slice_by_16( const SlicingTables& tables, uint32_t crc, const uint8_t* data, uint64_t data_size )
+{
+    // Slicing-by-16, based on https://create.stephan-brumme.com/crc32/
+    // 16 independent lookups per 16 bytes, instead of 16 lookups each waiting for the previous one
+    const auto& t = tables.table;
+
+    if constexpr (std::endian::native == std::endian::little)
+    {
+        while (data_size >= 16)
+        {
+            uint32_t one, two, three, four;
+            std::memcpy(&one,   data,      4);
+            std::memcpy(&two,   data + 4,  4);
+            std::memcpy(&three, data + 8,  4);
+            std::memcpy(&four,  data + 12, 4);
+            one ^= crc;
+
+            crc = t[ 0][ four  >> 24        ] xor t[ 1][(four  >> 16) & 0xFF] xor t[ 2][(four  >> 8) & 0xFF] xor t[ 3][four  & 0xFF]
+              xor t[ 4][ three >> 24        ] xor t[ 5][(three >> 16) & 0xFF] xor t[ 6][(three >> 8) & 0xFF] xor t[ 7][three & 0xFF]
+              xor t[ 8][ two   >> 24        ] xor t[ 9][(two   >> 16) & 0xFF] xor t[10][(two   >> 8) & 0xFF] xor t[11][two   & 0xFF]
+              xor t[12][ one   >> 24        ] xor t[13][(one   >> 16) & 0xFF] xor t[14][(one   >> 8) & 0xFF] xor t[15][one   & 0xFF];
+
+            data += 16;
+            data_size -= 16;
+        }
+    }
+
+    for (uint64_t i=0; i < data_size; ++i)
+        crc = (crc >> 8) xor t[0][(crc xor (uint32_t)data[i]) & 0xFF];
+    return crc;
+}
+
+
+uint32_t CRC32_slice_by_16_kernel( uint32_t crc, const uint8_t* data, uint64_t data_size )
+{
+    return slice_by_16(get_CRC32_tables(), crc, data, data_size);
+}
+
+
+uint32_t CRC32C_slice_by_16_kernel( uint32_t crc, const uint8_t* data, uint64_t data_size )
+{
+    return slice_by_16(get_CRC32C_tables(), crc, data, data_size);
+}
+
+
+#ifdef CRC32_X86_KERNELS
+__attribute__((target("pclmul,sse4.1")))
+uint32_t CRC32_pclmul_kernel( uint32_t crc, const uint8_t* data, uint64_t data_size )
+{
+    // Folding with carry-less multiplication, from Intel's paper
+    // "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction",
+    // (the same way as zlib in chromium does it).
+    // 4 x 128 bits are folded in parallel, then reduced to 32 bits with Barrett reduction.
+    if (data_size < 64) return CRC32_slice_by_16_kernel(crc, data, data_size);
+
+    alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+    alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+    alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+    alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+    const uint64_t tail_size = data_size % 16;
+    data_size -= tail_size;
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    x0 = _mm_load_si128((const __m128i*)k1k2);
+    data += 64;
+    data_size -= 64;
+
+    // folding 64 bytes at once
+    while (data_size >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+        y6 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+        y7 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+        y8 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        data += 64;
+        data_size -= 64;
+    }
+
+    // folding 4 x 128 bits into 128 bits
+    x0 = _mm_load_si128((const __m128i*)k3k4);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // folding remaining 16 byte parts
+    while (data_size >= 16)
+    {
+        x2 = _mm_loadu_si128((const __m128i*)data);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        data += 16;
+        data_size -= 16;
+    }
+
+    // 128 bits -> 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction, 64 bits -> 32 bits
+    x0 = _mm_load_si128((const __m128i*)poly);
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    crc = (uint32_t)_mm_extract_epi32(x1, 1);
+    return CRC32_slice_by_16_kernel(crc, data, tail_size);
+}
+
+
+__attribute__((target("sse4.2")))
+uint32_t CRC32C_sse42_kernel( uint32_t crc, const uint8_t* data, uint64_t data_size )
+{
+    // crc32 instruction calculates CRC-32C of 8 bytes at once
+    uint64_t crc64 = crc;
+    while (data_size >= 8)
+    {
+        uint64_t value;
+        std::memcpy(&value, data, 8);
+        crc64 = _mm_crc32_u64(crc64, value);
+        data += 8;
+        data_size -= 8;
+    }
+
+    crc = (uint32_t)crc64;
+    for (uint64_t i=0; i < data_size; ++i)
+        crc = _mm_crc32_u8(crc, data[i]);
+    return crc;
+}
+#endif
+
+
+CRC_function choose_CRC32_implementation()
+{
+#ifdef CRC32_X86_KERNELS
+    if (__builtin_cpu_supports("pclmul") and __builtin_cpu_supports("sse4.1"))
+        return &CRC32_pclmul_kernel;
+#endif
+    return &CRC32_slice_by_16_kernel;
+}
+
+
+CRC_function choose_CRC32C_implementation()
+{
+#ifdef CRC32_X86_KERNELS
+    if (__builtin_cpu_supports("sse4.2"))
+        return &CRC32C_sse42_kernel;
+#endif
+    return &CRC32C_slice_by_16_kernel;
+}
+}
+
+
+uint32_t crc::CRC32( uint32_t previous_crc, const uint8_t* data, uint64_t data_size )
+{
+    static const CRC_function implementation = choose_CRC32_implementation();
+    return ~implementation(~previous_crc, data, data_size);
+}
+
+
+uint32_t crc::CRC32C( uint32_t previous_crc, const uint8_t* data, uint64_t data_size )
+{
+    static const CRC_function implementation = choose_CRC32C_implementation();
+    return ~implementation(~previous_crc, data, data_size);
+}
+
+
+uint32_t crc::CRC32_slice_by_16( uint32_t previous_crc, const uint8_t* data, uint64_t data_size )
+{
+    return ~CRC32_slice_by_16_kernel(~previous_crc, data, data_size);
+}
+
+
+uint32_t crc::CRC32C_slice_by_16( uint32_t previous_crc, const uint8_t* data, uint64_t data_size )
+{
+    return ~CRC32C_slice_by_16_kernel(~previous_crc, data, data_size);
+}
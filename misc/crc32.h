@@ -0,0 +1,25 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <cstdint>
+
+
+// CRC-32 (the one from zip / png) and CRC-32C (Castagnoli) of given data.
+// previous_crc is a result of previous call (0 for the first part of data),
+// so data can be given in consecutive parts, and checksum of all of them is returned.
+//
+// Implementation is chosen at runtime, depending on what CPU supports:
+//  - CRC-32:  folding with carry-less multiplication (PCLMULQDQ), slice-by-16 otherwise
+//  - CRC-32C: crc32 instruction from SSE4.2, slice-by-16 otherwise
+// All of them are thread safe.
+namespace crc
+{
+    uint32_t CRC32( uint32_t previous_crc, const uint8_t* data, uint64_t data_size );
+    uint32_t CRC32C( uint32_t previous_crc, const uint8_t* data, uint64_t data_size );
+
+    // Portable implementations, used when CPU doesn't have needed instructions
+    uint32_t CRC32_slice_by_16( uint32_t previous_crc, const uint8_t* data, uint64_t data_size );
+    uint32_t CRC32C_slice_by_16( uint32_t previous_crc, const uint8_t* data, uint64_t data_size );
+}
+
+#endif // CRC32_H
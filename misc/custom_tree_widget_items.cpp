@@ -6,6 +6,17 @@
 #include <QApplication>
 
 
+namespace
+{
+    // members of solid blocks have no compressed size of their own (compressed_size is their offset in the block)
+    double compression_ratio( const File* file )
+    {
+        if (file->is_solid_member() or file->compressed_size == 0) return 0;
+        return (double)file->original_size / (double)file->compressed_size;
+    }
+}
+
+
 TreeWidgetFolder::TreeWidgetFolder(QTreeWidgetItem *parent, Folder* ptr_to_folder, Archive* ptr_to_archive, bool filesize_scaled  )
 : QTreeWidgetItem(parent, QStringList() << ptr_to_folder->name.c_str(), QTreeWidgetItem::UserType+1)
 {
@@ -14,10 +25,12 @@ TreeWidgetFolder::TreeWidgetFolder(QTreeWidgetItem *parent, Folder* ptr_to_folde
     this->FolderIcon = QIcon(":/folder.png");
     this->setIcon(0, FolderIcon);
 
-    if (ptr_to_folder->sibling_ptr) parent->addChild( new TreeWidgetFolder( parent, ptr_to_folder->sibling_ptr.get(), ptr_to_archive, filesize_scaled ) );
-    if (ptr_to_folder->child_dir_ptr) this->addChild( new TreeWidgetFolder( this, ptr_to_folder->child_dir_ptr.get(), ptr_to_archive, filesize_scaled ) );
-    if (ptr_to_folder->child_file_ptr) this->addChild( new TreeWidgetFile( this, ptr_to_folder->child_file_ptr.get(), ptr_to_archive, filesize_scaled ) );
+    this->filesize_scaled = filesize_scaled;
+
+    // children are added when the folder is expanded for the first time
+    if (ptr_to_folder->may_have_children()) this->setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
 
+    if (ptr_to_folder->sibling_ptr) parent->addChild( new TreeWidgetFolder( parent, ptr_to_folder->sibling_ptr.get(), ptr_to_archive, filesize_scaled ) );
 }
 
 
@@ -31,17 +44,31 @@ TreeWidgetFolder::TreeWidgetFolder(TreeWidgetFolder *parent, Folder* ptr_to_fold
     this->setIcon(0, FolderIcon);
 
 
+    this->filesize_scaled = filesize_scaled;
+
+    // children are added when the folder is expanded for the first time
+    if (ptr_to_folder->may_have_children()) this->setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
+
     if (ptr_to_folder->sibling_ptr) parent->addChild( new TreeWidgetFolder( parent, ptr_to_folder->sibling_ptr.get(), ptr_to_archive, filesize_scaled ) );
+}
+
+
+void TreeWidgetFolder::add_children() {
+    if (this->children_added) return;
+    this->children_added = true;
+
+    folder_ptr->parse_children();   // only this level, subfolders are parsed when they're expanded
 
-    if (ptr_to_folder->child_dir_ptr) this->addChild( new TreeWidgetFolder( this, ptr_to_folder->child_dir_ptr.get(), ptr_to_archive, filesize_scaled ) );
-    if (ptr_to_folder->child_file_ptr) this->addChild( new TreeWidgetFile( this, ptr_to_folder->child_file_ptr.get(), ptr_to_archive, filesize_scaled ) );
+    if (folder_ptr->child_dir_ptr) this->addChild( new TreeWidgetFolder( this, folder_ptr->child_dir_ptr.get(), archive_ptr, filesize_scaled ) );
+    if (folder_ptr->child_file_ptr) this->addChild( new TreeWidgetFile( this, folder_ptr->child_file_ptr.get(), archive_ptr, filesize_scaled ) );
+    this->setChildIndicatorPolicy(QTreeWidgetItem::DontShowIndicatorWhenChildless);
 }
 
 
 void TreeWidgetFolder::unpack( std::string path_for_extraction, bool& aborting_var ) {
     std::filesystem::path extraction_path( path_for_extraction );
     if ( !extraction_path.empty() ) {   // check if something is at least written
-        std::fstream source( archive_ptr->load_path, std::ios::binary | std::ios::in);
+        PathStream source( archive_ptr->load_path, std::ios::binary | std::ios::in);
         assert( source.is_open() );
 
         folder_ptr->unpack( path_for_extraction, source, aborting_var, true );
@@ -53,7 +80,7 @@ void TreeWidgetFolder::unpack( std::string path_for_extraction, bool& aborting_v
 void TreeWidgetFile::unpack( std::string path_for_extraction, bool& aborting_var ) {
     std::filesystem::path extraction_path( path_for_extraction );
     if ( !extraction_path.empty() ) {   // check if something is at least written
-        std::fstream source( archive_ptr->load_path, std::ios::binary | std::ios::in);
+        PathStream source( archive_ptr->load_path, std::ios::binary | std::ios::in);
         assert( source.is_open() );
 
         file_ptr->unpack( path_for_extraction, source, aborting_var, false );
@@ -68,7 +95,7 @@ TreeWidgetFile::TreeWidgetFile(TreeWidgetFolder *parent, File* ptr_to_file, Arch
     QStringList() << ptr_to_file->name.c_str()
                     << QString::fromStdString(ptr_to_file->get_uncompressed_filesize_str(filesize_scaled))
                     << QString::fromStdString(ptr_to_file->get_compressed_filesize_str(filesize_scaled))
-                    << QString::number((float)ptr_to_file->original_size / (float)(ptr_to_file->compressed_size)),
+                    << (ptr_to_file->is_solid_member() ? QString("-") : QString::number(compression_ratio(ptr_to_file))),
     QTreeWidgetItem::UserType+2)
 {
     this->setTextAlignment(1, Qt::AlignRight);
@@ -129,7 +156,7 @@ bool TreeWidgetFile::operator<(const QTreeWidgetItem &other)const {
         if (this->type() == other.type() ) {
            // both this and other are TreeWidgetFiles
                 TreeWidgetFile* twfile = (TreeWidgetFile*)(&other);
-                if ( this->file_ptr->compressed_size < twfile->file_ptr->compressed_size ) return true;
+                if ( this->file_ptr->get_stored_data_size() < twfile->file_ptr->get_stored_data_size() ) return true;
                 else return false;
         }
         else if (other.type() == 1001) return true;  // TreeWidgetFolders go before TreeWidgetFiles
@@ -141,7 +168,7 @@ bool TreeWidgetFile::operator<(const QTreeWidgetItem &other)const {
         if (this->type() == other.type() ) {
             // both this and other are TreeWidgetFiles
             TreeWidgetFile* twfile = (TreeWidgetFile*)(&other);
-            if ( (double)this->file_ptr->original_size/(double)this->file_ptr->compressed_size < (double)twfile->file_ptr->original_size / (double)twfile->file_ptr->compressed_size ) return true;
+            if ( compression_ratio(this->file_ptr) < compression_ratio(twfile->file_ptr) ) return true;
             else return false;
         }
         else if (this->type() < other.type()) return true;  // TreeWidgetFolders go before TreeWidgetFiles
@@ -16,12 +16,15 @@ public:
     TreeWidgetFolder(QTreeWidgetItem *parent, Folder* ptr_to_folder, Archive* ptr_to_archive, bool filesize_scaled );
     TreeWidgetFolder(TreeWidgetFolder *parent, Folder* ptr_to_folder, Archive* ptr_to_archive, bool filesize_scaled );
 
+    void add_children();    // creates items of subfolders and files, parsing them first if needed
     void unpack( std::string path_for_extraction, bool& aborting_var );
     void set_disabled(bool disabled);
     bool operator<(const QTreeWidgetItem &other)const;
 
 private:
     QIcon FolderIcon;
+    bool filesize_scaled = false;
+    bool children_added = false;
 };
 
 
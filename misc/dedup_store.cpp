@@ -0,0 +1,299 @@
+#include "dedup_store.h"
+
+#include <array>
+#include <cstring>
+#include <iostream>
+
+#include "archive_structures.h"
+#include "integrity_validation.h"
+#include "positional_io.h"
+#include "solid_block.h"
+
+
+namespace
+{
+    // Random numbers for the gear hash, generated by splitmix64, so they're the same in every build
+    constexpr std::array<uint64_t, 256> make_gear_table()
+    {
+        std::array<uint64_t, 256> table{};
+        uint64_t state = 0x544B324B5F474541ull;    // "TK2K_GEA"
+        for (auto& value : table)
+        {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30u)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27u)) * 0x94D049BB133111EBull;
+            value = z ^ (z >> 31u);
+        }
+        return table;
+    }
+    constexpr std::array<uint64_t, 256> gear = make_gear_table();
+
+    // Normalized chunking: it's harder to cut before the average size, and easier after it,
+    // so chunks are closer to the average. Highest bits of the hash depend on the last 64 bytes.
+    const uint64_t mask_small = ((1ull << 17u) - 1) << 47u;    // 2 bits more than log2(average_chunk)
+    const uint64_t mask_large = ((1ull << 13u) - 1) << 51u;    // 2 bits less
+
+    void put_u64( uint8_t* buffer, uint64_t value )
+    {
+        for (uint8_t i=0; i < 8; i++) buffer[i] = (value >> (i*8u)) & 0xFFu;
+    }
+
+    uint64_t get_u64( const uint8_t* buffer )
+    {
+        uint64_t value = 0;
+        for (uint8_t i=0; i < 8; i++) value |= (uint64_t)buffer[i] << (i*8u);
+        return value;
+    }
+
+    // 64 hex chars of SHA-256 -> 32 bytes
+    std::string hex_to_bytes( const std::string& hex )
+    {
+        auto nibble = []( char c ) -> uint8_t {
+            if (c >= '0' and c <= '9') return c - '0';
+            if (c >= 'a' and c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' and c <= 'F') return c - 'A' + 10;
+            return 0;
+        };
+        std::string bytes( hex.length() / 2, '\0' );
+        for (size_t i=0; i < bytes.length(); ++i)
+            bytes[i] = (char)((nibble(hex[2*i]) << 4u) | nibble(hex[2*i + 1]));
+        return bytes;
+    }
+}
+
+
+uint32_t DedupStore::cut_point( const uint8_t* data, uint64_t size )
+{
+    if (size <= min_chunk) return size;
+    const uint64_t end = std::min<uint64_t>( size, max_chunk );
+    const uint64_t normal = std::min<uint64_t>( end, average_chunk );
+
+    // bytes before min_chunk can't end a chunk, so they aren't even hashed
+    uint64_t hash = 0;
+    uint64_t i = min_chunk;
+    for (; i < normal; ++i) {
+        hash = (hash << 1u) + gear[data[i]];
+        if ((hash & mask_small) == 0) return i + 1;
+    }
+    for (; i < end; ++i) {
+        hash = (hash << 1u) + gear[data[i]];
+        if ((hash & mask_large) == 0) return i + 1;
+    }
+    return end;
+}
+
+
+bool DedupStore::load( std::fstream& archive_file, Folder& root )
+{
+    root.parse_children( true );
+
+    std::vector<Folder*> folders{ &root };
+    std::vector<uint8_t> entries;
+    for (size_t i=0; i < folders.size(); ++i) {
+        for (Folder* folder = folders[i]->child_dir_ptr.get(); folder != nullptr; folder = folder->sibling_ptr.get())
+            folders.push_back( folder );
+
+        for (File* file = folders[i]->child_file_ptr.get(); file != nullptr; file = file->sibling_ptr.get()) {
+            if (!file->is_solid_member() or file->data_location == 0) continue;
+
+            solid::SolidHeader header;
+            if (!solid::read_header( archive_file, file->data_location, header )) return false;
+            if (!solid::is_chunk_list( header )) continue;
+
+            entries.resize( header.compressed_size * solid::chunk_entry_size );
+            archive_file.read( (char*)entries.data(), entries.size() );
+            if ((uint64_t)archive_file.gcount() != entries.size()) {
+                archive_file.clear();
+                return false;
+            }
+
+            for (uint64_t j=0; j < header.compressed_size; ++j) {
+                const uint8_t* entry = entries.data() + j * solid::chunk_entry_size;
+                Chunk chunk;
+                chunk.block_location = get_u64( entry + 32 );
+                chunk.offset = get_u64( entry + 40 );
+                chunk.length = entry[48] | (entry[49] << 8u) | (entry[50] << 16u) | ((uint32_t)entry[51] << 24u);
+                index.emplace( std::string( (const char*)entry, 32 ), chunk );
+            }
+        }
+    }
+    return true;
+}
+
+
+bool DedupStore::is_chunked( const File& file )
+{
+    return !file.alreadySaved and file.is_solid_member() and file.data_location == 0 and file.original_size > solid::small_file_limit;
+}
+
+
+bool DedupStore::any_chunked( const std::vector<File*>& files )
+{
+    for (File* file : files)
+        if (is_chunked( *file )) return true;
+    return false;
+}
+
+
+bool DedupStore::write_files( std::fstream& archive_file, const std::vector<File*>& files, bool& aborting_var )
+{
+    std::vector<File*> chunked_files;
+    for (File* file : files)
+        if (is_chunked( *file )) chunked_files.push_back( file );
+    if (chunked_files.empty()) return true;
+
+    // new chunks are collected in memory (group_limit at most), and compressed into a solid block once it's big enough
+    std::vector<uint8_t> pending;
+    uint16_t pending_flags = 0;
+    std::vector<std::string> pending_hashes;
+
+    auto flush = [&]() -> bool {
+        if (pending.empty()) return true;
+        const uint64_t location = solid::write_block( archive_file, pending.data(), pending_flags, pending.size(), aborting_var );
+        if (location == 0) return false;
+        for (const std::string& hash : pending_hashes) index[hash].block_location = location;
+        pending_hashes.clear();
+        pending.clear();
+        return true;
+    };
+
+    // hashes of chunks of every file, locations are known only after all solid blocks are written
+    std::vector<std::vector<std::string>> lists( chunked_files.size() );
+    std::vector<uint8_t> buffer( 16u << 20 );
+    bool successful = true;
+    for (size_t f=0; f < chunked_files.size() and successful and !aborting_var; ++f) {
+        File* file = chunked_files[f];
+        std::ifstream input( file->path, std::ios::binary );
+        uint64_t filled = 0;
+        uint64_t total_size = 0;
+        bool end_of_file = false;
+
+        while (successful and !aborting_var) {
+            if (!end_of_file) {
+                input.read( (char*)buffer.data() + filled, buffer.size() - filled );
+                filled += input.gcount();
+                if (!input) end_of_file = true;
+            }
+
+            // chunk can be cut only where enough data follows, unless it's the end of file
+            std::vector<std::pair<const uint8_t*, uint64_t>> chunks;
+            uint64_t position = 0;
+            while (filled - position >= max_chunk or (end_of_file and position < filled)) {
+                const uint32_t length = cut_point( buffer.data() + position, filled - position );
+                chunks.emplace_back( buffer.data() + position, length );
+                position += length;
+            }
+
+            const std::vector<std::string> hashes = get_SHA256_of_buffers( chunks );
+            for (size_t c=0; c < chunks.size(); ++c) {
+                const std::string hash = hex_to_bytes( hashes[c] );
+                if (index.count( hash ) == 0) {
+                    if (pending.size() + chunks[c].second > solid::group_limit and !flush()) {
+                        successful = false;
+                        break;
+                    }
+                    if (pending.empty()) pending_flags = file->flags_value;   // solid block gets flags of its first file
+                    index.emplace( hash, Chunk{ 0, pending.size(), (uint32_t)chunks[c].second } );
+                    pending.insert( pending.end(), chunks[c].first, chunks[c].first + chunks[c].second );
+                    pending_hashes.push_back( hash );
+                }
+                lists[f].push_back( hash );
+                total_size += chunks[c].second;
+            }
+
+            std::memmove( buffer.data(), buffer.data() + position, filled - position );
+            filled -= position;
+            if (end_of_file and filled == 0) break;
+        }
+
+        if (total_size != file->original_size) {
+            std::cout << "File " << file->path << " changed its size, it couldn't be deduplicated" << std::endl;
+            successful = false;
+        }
+    }
+    successful = successful and !aborting_var and flush();
+
+    if (!successful) {
+        // chunks of solid blocks which weren't written are forgotten, the rest can still be used
+        for (auto chunk = index.begin(); chunk != index.end(); )
+            chunk = chunk->second.block_location == 0 ? index.erase( chunk ) : std::next( chunk );
+        return false;
+    }
+
+    // chunk lists go after all the solid blocks
+    std::vector<uint8_t> record;
+    for (size_t f=0; f < chunked_files.size(); ++f) {
+        File* file = chunked_files[f];
+        solid::SolidHeader header;
+        header.flags = 1u << solid::flag;
+        header.compressed_size = lists[f].size();
+        header.original_size = file->original_size;
+
+        record.assign( solid::get_stored_size( header ), 0 );
+        solid::write_header( record.data(), header );
+        uint8_t* entry = record.data() + solid::header_size;
+        for (const std::string& hash : lists[f]) {
+            const Chunk& chunk = index.at( hash );
+            std::memcpy( entry, hash.data(), 32 );
+            put_u64( entry + 32, chunk.block_location );
+            put_u64( entry + 40, chunk.offset );
+            for (uint8_t i=0; i < 4; i++) entry[48 + i] = (chunk.length >> (i*8u)) & 0xFFu;
+            entry += solid::chunk_entry_size;
+        }
+
+        const uint64_t location = archive_file.tellp();
+        archive_file.write( (char*)record.data(), record.size() );
+        if (!archive_file.good()) return false;
+        file->data_location = location;
+        file->compressed_size = 0;
+    }
+    return true;
+}
+
+
+uint64_t DedupStore::copy_chunk_list( std::fstream& source, std::fstream& destination, uint64_t location,
+                                      std::unordered_map<uint64_t, uint64_t>& solid_blocks )
+{
+    solid::SolidHeader header;
+    if (!solid::read_header( source, location, header ) or !solid::is_chunk_list( header )) return 0;
+
+    std::vector<uint8_t> record( solid::get_stored_size( header ) );
+    source.seekg( location );
+    source.read( (char*)record.data(), record.size() );
+    if ((uint64_t)source.gcount() != record.size()) {
+        source.clear();
+        return 0;
+    }
+
+    // solid blocks which aren't in destination yet go right after the list, in order of their first chunk
+    destination.seekp( 0, std::ios_base::end );
+    const uint64_t copy_location = destination.tellp();
+    uint64_t next_location = copy_location + record.size();
+    std::vector<std::pair<uint64_t, uint64_t>> new_blocks;    // old location, size
+    for (uint64_t i=0; i < header.compressed_size; ++i) {
+        uint8_t* entry = record.data() + solid::header_size + i * solid::chunk_entry_size;
+        const uint64_t block_location = get_u64( entry + 32 );
+        auto copied = solid_blocks.find( block_location );
+        if (copied == solid_blocks.end()) {
+            solid::SolidHeader block_header;
+            if (!solid::read_header( source, block_location, block_header ) or solid::is_chunk_list( block_header )) return 0;
+            copied = solid_blocks.emplace( block_location, next_location ).first;
+            new_blocks.emplace_back( block_location, solid::get_stored_size( block_header ) );
+            next_location += new_blocks.back().second;
+        }
+        put_u64( entry + 32, copied->second );
+    }
+
+    destination.write( (char*)record.data(), record.size() );
+    destination.flush();
+
+    PositionalFile source_file, destination_file;
+    if (!source_file.attach( source ) or !destination_file.attach( destination )) return 0;
+    uint64_t block_destination = copy_location + record.size();
+    for (auto& [block_location, block_size] : new_blocks) {
+        if (!copy_range( source_file, block_location, destination_file, block_destination, block_size )) return 0;
+        block_destination += block_size;
+    }
+    destination.seekp( block_destination );
+    return destination.good() ? copy_location : 0;
+}
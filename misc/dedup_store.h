@@ -0,0 +1,59 @@
+#ifndef DEDUP_STORE_H
+#define DEDUP_STORE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct File;
+struct Folder;
+
+
+// Deduplication of files bigger than solid::small_file_limit with flag 6 (solid mode).
+// Files are cut into chunks where content says so (FastCDC: gear rolling hash, with normalized chunking),
+// so an insertion shifts only the chunks around it, and the same content gives the same chunks in any file.
+// Every chunk is identified by its SHA-256, and the ones which aren't in archive yet are put into solid blocks,
+// one after another, so they're compressed together. File is then stored as a chunk list (see misc/solid_block.h).
+// Chunk lists keep hashes of their chunks, so they're the index of the archive, load() reads it back
+// before more files are added.
+class DedupStore
+{
+public:
+    static const uint32_t min_chunk = 8u << 10;
+    static const uint32_t average_chunk = 32u << 10;
+    static const uint32_t max_chunk = 128u << 10;
+
+    // Length of the chunk at the beginning of data
+    static uint32_t cut_point( const uint8_t* data, uint64_t size );
+
+    // True for files which write_files() stores as chunk lists, only they need the index
+    static bool is_chunked( const File& file );
+    static bool any_chunked( const std::vector<File*>& files );
+
+    // Reads hashes of chunks from all chunk lists in archive (the whole tree gets parsed)
+    bool load( std::fstream& archive_file, Folder& root );
+
+    // Stores unsaved files bigger than solid::small_file_limit with flag 6, at the end of archive_file:
+    // solid blocks with new chunks first, then chunk lists, and sets data_location of the files.
+    // Headers of files aren't written here. If it fails, data_location of the files stays 0.
+    bool write_files( std::fstream& archive_file, const std::vector<File*>& files, bool& aborting_var );
+
+    // Copies chunk list at given location to the end of destination, followed by solid blocks it needs,
+    // which aren't in solid_blocks (old location -> location in destination) yet. Returns location of the copy, 0 if it failed.
+    static uint64_t copy_chunk_list( std::fstream& source, std::fstream& destination, uint64_t location,
+                                     std::unordered_map<uint64_t, uint64_t>& solid_blocks );
+
+private:
+    struct Chunk
+    {
+        uint64_t block_location = 0;    // 0 until its solid block is written
+        uint64_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    std::unordered_map<std::string, Chunk> index;   // SHA-256 (32 bytes) -> where chunk is
+};
+
+#endif // DEDUP_STORE_H
@@ -0,0 +1,80 @@
+#include "directory_walker.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+
+DirectoryWalker::DirectoryWalker( const PathFilter& filter, uint32_t thread_count ) : filter(filter), thread_count(thread_count)
+{
+    if (this->thread_count == 0) this->thread_count = std::max( 2u, std::thread::hardware_concurrency() * 2 );  // threads mostly wait for I/O
+}
+
+
+std::vector<DirectoryWalker::Entry> DirectoryWalker::walk( const std::filesystem::path& root ) const
+{
+    std::vector<Entry> entries;
+    std::deque<std::pair<std::filesystem::path, std::string>> pending{ { root, "" } };     // folders to list
+    uint32_t busy_threads = 0;
+    std::mutex mut;
+    std::condition_variable cond;
+
+    auto worker = [&]() {
+        std::vector<Entry> found;
+        std::vector<std::pair<std::filesystem::path, std::string>> subfolders;
+        std::unique_lock<std::mutex> lock(mut);
+        while (true) {
+            // walk is finished when there's nothing to list, and nobody can find anything more
+            cond.wait( lock, [&]() { return !pending.empty() or busy_threads == 0; } );
+            if (pending.empty()) break;
+
+            auto [folder_path, folder_relative_path] = std::move( pending.front() );
+            pending.pop_front();
+            busy_threads++;
+            lock.unlock();
+
+            found.clear();
+            subfolders.clear();
+            std::error_code error;
+            for (std::filesystem::directory_iterator it( folder_path, std::filesystem::directory_options::skip_permission_denied, error );
+                 !error and it != std::filesystem::directory_iterator(); it.increment( error ))
+            {
+                Entry entry;
+                entry.path = it->path();
+                entry.relative_path = folder_relative_path.empty() ? it->path().filename().generic_string()
+                                                                   : folder_relative_path + '/' + it->path().filename().generic_string();
+                std::error_code entry_error;
+                if (it->is_directory( entry_error ) and !it->is_symlink( entry_error )) {
+                    if (!filter.accepts_folder( entry.relative_path )) continue;
+                    entry.is_folder = true;
+                    subfolders.emplace_back( entry.path, entry.relative_path );
+                }
+                else if (it->is_regular_file( entry_error )) {
+                    if (!filter.accepts_file( entry.relative_path )) continue;
+                    entry.size = it->file_size( entry_error );
+                    if (entry_error) continue;
+                }
+                else continue;
+                found.push_back( std::move(entry) );
+            }
+            if (error) std::cout << "folder " << folder_path << " couldn't be read: " << error.message() << std::endl;
+
+            lock.lock();
+            for (auto& entry : found) entries.push_back( std::move(entry) );
+            for (auto& subfolder : subfolders) pending.push_back( std::move(subfolder) );
+            busy_threads--;
+            cond.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i=0; i < thread_count; ++i) threads.emplace_back( worker );
+    for (auto& thread : threads) thread.join();
+
+    // order of threads is random, results aren't
+    std::sort( entries.begin(), entries.end(), []( const Entry& a, const Entry& b ) { return a.relative_path < b.relative_path; } );
+    return entries;
+}
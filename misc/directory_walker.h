@@ -0,0 +1,38 @@
+#ifndef DIRECTORY_WALKER_H
+#define DIRECTORY_WALKER_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "path_filter.h"
+
+
+// Lists everything in a folder on disk, on many threads. With cold cache, or on network file systems,
+// most of the time is spent waiting for folders to be read, and files to be stat'ed, so a few of those
+// at once go much faster. Every thread takes a folder from a shared queue, lists it, and puts its
+// subfolders back into the queue. Excluded folders (see PathFilter) aren't even opened.
+class DirectoryWalker
+{
+public:
+    struct Entry
+    {
+        std::filesystem::path path;         // on disk
+        std::string relative_path;          // to the walked folder, with '/' as separator
+        bool is_folder = false;
+        uint64_t size = 0;
+    };
+
+    explicit DirectoryWalker( const PathFilter& filter, uint32_t thread_count = 0 );   // 0 - twice the number of cores
+
+    // Files and folders accepted by filter, sorted by relative path, so every folder is before everything in it.
+    // Symbolic links to folders aren't followed. Entries which can't be read are skipped.
+    std::vector<Entry> walk( const std::filesystem::path& root ) const;
+
+private:
+    const PathFilter& filter;
+    uint32_t thread_count;
+};
+
+#endif // DIRECTORY_WALKER_H
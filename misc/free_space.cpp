@@ -0,0 +1,77 @@
+#include "free_space.h"
+
+#include <iterator>
+
+
+void FreeSpace::release( uint64_t location, uint64_t size )
+{
+    if (size == 0 or location == 0) return;
+
+    // merging with the range right after
+    auto next = extents.lower_bound(location);
+    if (next != extents.end() and next->first == location + size)
+    {
+        size += next->second;
+        next = extents.erase(next);
+    }
+
+    // and with the range right before
+    if (next != extents.begin())
+    {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == location)
+        {
+            previous->second += size;
+            return;
+        }
+    }
+    extents.emplace_hint(next, location, size);
+}
+
+
+uint64_t FreeSpace::allocate( uint64_t size )
+{
+    if (size == 0) return 0;
+
+    // best fit, so big ranges are left for big files
+    auto best = extents.end();
+    for (auto extent = extents.begin(); extent != extents.end(); ++extent)
+    {
+        if (extent->second < size) continue;
+        if (best == extents.end() or extent->second < best->second) best = extent;
+        if (extent->second == size) break;
+    }
+    if (best == extents.end()) return 0;
+
+    const uint64_t location = best->first;
+    const uint64_t left = best->second - size;
+    extents.erase(best);
+    if (left != 0) extents.emplace(location + size, left);
+    return location;
+}
+
+
+void FreeSpace::trim( uint64_t end_of_archive )
+{
+    extents.erase(extents.lower_bound(end_of_archive), extents.end());
+    if (extents.empty()) return;
+
+    auto last = std::prev(extents.end());
+    if (last->first + last->second > end_of_archive) last->second = end_of_archive - last->first;
+}
+
+
+uint64_t FreeSpace::tail( uint64_t end_of_archive ) const
+{
+    if (extents.empty()) return 0;
+    auto last = std::prev(extents.end());
+    return last->first + last->second == end_of_archive ? last->first : 0;
+}
+
+
+uint64_t FreeSpace::total() const
+{
+    uint64_t sum = 0;
+    for (auto& [location, size] : extents) sum += size;
+    return sum;
+}
@@ -0,0 +1,36 @@
+#ifndef FREE_SPACE_H
+#define FREE_SPACE_H
+
+#include <cstdint>
+#include <map>
+
+
+// Ranges inside archive which nothing points at anymore, left by removed files and folders.
+// New data and headers are put there, before archive is made any bigger.
+// List is saved in the central directory. If it's lost, only the space is lost, until archive is compacted.
+class FreeSpace
+{
+public:
+    // Adds range to the list, neighbouring ranges are merged
+    void release( uint64_t location, uint64_t size );
+
+    // Takes size bytes from the smallest range which is big enough, returns their location, or 0 if there's none
+    uint64_t allocate( uint64_t size );
+
+    // Forgets everything at, and after given location (e.g. when archive was cut there)
+    void trim( uint64_t end_of_archive );
+
+    // Location of the range, which reaches given end of archive, so it can be cut off (0 if there's none)
+    uint64_t tail( uint64_t end_of_archive ) const;
+
+    uint64_t total() const;
+    bool empty() const { return extents.empty(); }
+    void clear() { extents.clear(); }
+
+    const std::map<uint64_t, uint64_t>& get_extents() const { return extents; }
+
+private:
+    std::map<uint64_t, uint64_t> extents;   // location -> size
+};
+
+#endif // FREE_SPACE_H
@@ -0,0 +1,339 @@
+#include "io_queue.h"
+
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+#if defined(__linux__) && defined(TK2K_IO_URING) && __has_include(<linux/io_uring.h>)
+#define IO_QUEUE_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+
+#ifdef IO_QUEUE_URING
+// liburing isn't needed for the few things used here, so the ring is set up with raw system calls
+struct IOQueue::Ring
+{
+    int fd = -1;
+    uint32_t sq_entries = 0;
+
+    void* sq_mapping = MAP_FAILED;
+    size_t sq_mapping_size = 0;
+    void* cq_mapping = MAP_FAILED;
+    size_t cq_mapping_size = 0;
+    io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;
+    size_t sqes_size = 0;
+
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    ~Ring()
+    {
+        if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+        if (cq_mapping != MAP_FAILED and cq_mapping != sq_mapping) munmap(cq_mapping, cq_mapping_size);
+        if (sq_mapping != MAP_FAILED) munmap(sq_mapping, sq_mapping_size);
+        if (fd != -1) close(fd);
+    }
+
+    bool setup( uint32_t entries )
+    {
+        io_uring_params params{};
+        fd = syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0)
+        {
+            fd = -1;
+            return false;
+        }
+        sq_entries = params.sq_entries;
+
+        sq_mapping_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_mapping_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mapping = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mapping) sq_mapping_size = cq_mapping_size = std::max(sq_mapping_size, cq_mapping_size);
+
+        sq_mapping = mmap(nullptr, sq_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_mapping == MAP_FAILED) return false;
+
+        if (single_mapping) cq_mapping = sq_mapping;
+        else cq_mapping = mmap(nullptr, cq_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_mapping == MAP_FAILED) return false;
+
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = (io_uring_sqe*)mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return false;
+
+        auto sq = (uint8_t*)sq_mapping;
+        sq_tail  = (unsigned*)(sq + params.sq_off.tail);
+        sq_mask  = (unsigned*)(sq + params.sq_off.ring_mask);
+        sq_array = (unsigned*)(sq + params.sq_off.array);
+
+        auto cq = (uint8_t*)cq_mapping;
+        cq_head = (unsigned*)(cq + params.cq_off.head);
+        cq_tail = (unsigned*)(cq + params.cq_off.tail);
+        cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+        cqes    = (io_uring_cqe*)(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // requests are submitted one by one, so there's always a free entry in submission queue
+    void push( uint8_t opcode, int file_fd, uint8_t* buffer, uint32_t length, uint64_t offset, uint64_t user_data )
+    {
+        const unsigned tail = *sq_tail;
+        const unsigned index = tail & *sq_mask;
+
+        io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = file_fd;
+        sqe->addr = (uint64_t)buffer;
+        sqe->len = length;
+        sqe->off = offset;
+        sqe->user_data = user_data;
+
+        sq_array[index] = index;
+        std::atomic_ref<unsigned>(*sq_tail).store(tail + 1, std::memory_order_release);
+    }
+
+    // submits everything waiting in submission queue, kernel takes no more than it has
+    int enter( uint32_t min_complete )
+    {
+        const unsigned flags = min_complete != 0 ? IORING_ENTER_GETEVENTS : 0;
+        int result;
+        do result = syscall(__NR_io_uring_enter, fd, sq_entries, min_complete, flags, nullptr, 0);
+        while (result < 0 and errno == EINTR);
+        return result;
+    }
+};
+#else
+struct IOQueue::Ring {};
+#endif
+
+
+IOQueue::Ring* IOQueue::take_ring( uint32_t depth )
+{
+#ifdef IO_QUEUE_URING
+    // whether io_uring works is checked once per process, not for every file
+    static const bool available = []() {
+        Ring probe;
+        return probe.setup(1);
+    }();
+    if (!available) return nullptr;
+
+    // rings are kept after queues are destroyed, so processing many files doesn't set up one for each
+    {
+        std::lock_guard<std::mutex> lock(idle_rings_mut());
+        std::vector<std::unique_ptr<Ring>>& idle = idle_rings();
+        for (auto ring = idle.begin(); ring != idle.end(); ++ring)
+        {
+            if ((*ring)->sq_entries < depth) continue;
+            Ring* taken = ring->release();
+            idle.erase(ring);
+            return taken;
+        }
+    }
+
+    auto ring = std::make_unique<Ring>();
+    return ring->setup(depth) ? ring.release() : nullptr;
+#else
+    return nullptr;
+#endif
+}
+
+
+void IOQueue::give_back_ring( Ring* ring )
+{
+    if (ring == nullptr) return;
+    std::lock_guard<std::mutex> lock(idle_rings_mut());
+    idle_rings().emplace_back(ring);
+}
+
+
+std::vector<std::unique_ptr<IOQueue::Ring>>& IOQueue::idle_rings()
+{
+    // one queue uses a ring at a time, so it can go to a queue of another thread (e.g. scribe of the next file)
+    static std::vector<std::unique_ptr<Ring>> idle;
+    return idle;
+}
+
+
+std::mutex& IOQueue::idle_rings_mut()
+{
+    static std::mutex mut;
+    return mut;
+}
+
+
+IOQueue::IOQueue( uint32_t depth )
+{
+    ring = take_ring(depth);
+    if (ring == nullptr) return;
+
+    requests.resize(depth);
+    for (uint32_t i=depth; i > 0; --i) free_slots.push_back(i-1);
+}
+
+
+IOQueue::~IOQueue()
+{
+    wait_for_all();
+
+    // ring with requests still in it (waiting failed) can't be used by another queue
+    if (in_flight() == 0) give_back_ring(ring);
+    else delete ring;
+}
+
+
+void IOQueue::read( PositionalFile& file, void* buffer, uint64_t length, uint64_t offset, std::function<void(bool)> on_done )
+{
+    queue(file, (uint8_t*)buffer, length, offset, false, on_done);
+}
+
+
+void IOQueue::write( PositionalFile& file, const void* buffer, uint64_t length, uint64_t offset, std::function<void(bool)> on_done )
+{
+    queue(file, (uint8_t*)buffer, length, offset, true, on_done);
+}
+
+
+void IOQueue::queue( PositionalFile& file, uint8_t* buffer, uint64_t length, uint64_t offset, bool writing,
+                     std::function<void(bool)>& on_done )
+{
+    while (ring != nullptr and free_slots.empty()) if (!wait_for_one()) break;
+
+    // files without descriptor (see PositionalFile::attach) can't be given to the kernel
+    if (ring == nullptr or file.descriptor() == -1 or length == 0 or free_slots.empty())
+    {
+        const bool done = writing ? file.write_at(buffer, length, offset) : file.read_at(buffer, length, offset);
+        if (on_done) on_done(done);
+        return;
+    }
+
+    const uint32_t slot = free_slots.back();
+    free_slots.pop_back();
+
+    Request& request = requests[slot];
+    request.file = &file;
+    request.buffer = buffer;
+    request.length = length;
+    request.offset = offset;
+    request.writing = writing;
+    request.on_done = std::move(on_done);
+    submit(slot);
+}
+
+
+void IOQueue::submit( uint32_t slot )
+{
+#ifdef IO_QUEUE_URING
+    Request& request = requests[slot];
+
+    // length in submission entry is 32-bit, so longer requests are done in parts of 1 GiB
+    const uint32_t length = std::min<uint64_t>(request.length, 1u << 30);
+    ring->push(request.writing ? IORING_OP_WRITE : IORING_OP_READ,
+               request.file->descriptor(), request.buffer, length, request.offset, slot);
+
+    // if it fails, the request is still in the submission queue, and will be submitted with the next call
+    ring->enter(0);
+#endif
+}
+
+
+void IOQueue::finish_synchronously( Request& request, std::vector<std::function<void()>>& callbacks )
+{
+    const bool done = request.writing ? request.file->write_at(request.buffer, request.length, request.offset)
+                                      : request.file->read_at(request.buffer, request.length, request.offset);
+    callbacks.emplace_back([on_done = std::move(request.on_done), done]() { if (on_done) on_done(done); });
+}
+
+
+uint32_t IOQueue::handle_completions()
+{
+    uint32_t handled = 0;
+#ifdef IO_QUEUE_URING
+    // callbacks are called after the completion queue is released, since they may queue other requests
+    std::vector<std::function<void()>> callbacks;
+
+    unsigned head = *ring->cq_head;
+    const unsigned tail = std::atomic_ref<unsigned>(*ring->cq_tail).load(std::memory_order_acquire);
+    std::vector<uint32_t> resubmitted;
+
+    for (; head != tail; ++head)
+    {
+        const io_uring_cqe& cqe = ring->cqes[head & *ring->cq_mask];
+        const uint32_t slot = cqe.user_data;
+        const int result = cqe.res;
+        Request& request = requests[slot];
+
+        if (result == -EINTR or result == -EAGAIN)
+        {
+            resubmitted.push_back(slot);
+            continue;
+        }
+        if (result == -EINVAL or result == -EOPNOTSUPP)
+        {
+            // kernel older than 5.6 doesn't know IORING_OP_READ/WRITE
+            finish_synchronously(request, callbacks);
+        }
+        else if (result <= 0)
+        {
+            // error, or end of file while reading
+            callbacks.emplace_back([on_done = std::move(request.on_done)]() { if (on_done) on_done(false); });
+        }
+        else if ((uint64_t)result < request.length)
+        {
+            request.buffer += result;
+            request.offset += result;
+            request.length -= result;
+            resubmitted.push_back(slot);
+            continue;
+        }
+        else callbacks.emplace_back([on_done = std::move(request.on_done)]() { if (on_done) on_done(true); });
+
+        request = Request();
+        free_slots.push_back(slot);
+        handled++;
+    }
+    std::atomic_ref<unsigned>(*ring->cq_head).store(head, std::memory_order_release);
+
+    for (uint32_t slot : resubmitted) submit(slot);
+    for (auto& callback : callbacks) callback();
+#endif
+    return handled;
+}
+
+
+void IOQueue::poll()
+{
+    if (ring != nullptr) handle_completions();
+}
+
+
+bool IOQueue::wait_for_one()
+{
+    if (ring == nullptr or in_flight() == 0) return false;
+#ifdef IO_QUEUE_URING
+    while (handle_completions() == 0)
+    {
+        if (ring->enter(1) < 0 and errno != EAGAIN and errno != EBUSY) return false;
+    }
+#endif
+    return true;
+}
+
+
+void IOQueue::wait_for_all()
+{
+    while (in_flight() != 0) if (!wait_for_one()) break;
+}
@@ -0,0 +1,71 @@
+#ifndef IO_QUEUE_H
+#define IO_QUEUE_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "positional_io.h"
+
+
+// Queue of positional reads and writes, which are done in the background while caller keeps working.
+// On Linux it uses io_uring, so many requests are in flight at once, and storage with high latency stays busy.
+// Without io_uring (other systems, old kernel, disabled by TK2K_IO_URING, forbidden by seccomp) every request
+// is done right away, synchronously, before read()/write() returns.
+//
+// Whether io_uring works is checked once per process. Rings of destroyed queues are kept, and reused by the next
+// queues (of any thread), so a new queue for every file doesn't set up a new ring.
+//
+// Queue isn't thread-safe, it should be used by one thread. Callbacks are called only from that thread,
+// inside read(), write(), poll(), wait_for_one() and wait_for_all(). Nothing is printed (it's a part of tk2k_core),
+// failures come back through on_done, and is_asynchronous() tells which way requests are done.
+class IOQueue
+{
+public:
+    explicit IOQueue( uint32_t depth = 32 );
+    ~IOQueue();     // waits for all requests
+    IOQueue( const IOQueue& ) = delete;
+    IOQueue& operator=( const IOQueue& ) = delete;
+
+    bool is_asynchronous() const { return ring != nullptr; }
+
+    // on_done gets true if all the bytes were transferred. Buffer has to stay valid until then.
+    void read( PositionalFile& file, void* buffer, uint64_t length, uint64_t offset, std::function<void(bool)> on_done );
+    void write( PositionalFile& file, const void* buffer, uint64_t length, uint64_t offset, std::function<void(bool)> on_done );
+
+    void poll();            // handles requests, which are already done
+    bool wait_for_one();    // false if nothing was queued
+    void wait_for_all();
+    uint32_t in_flight() const { return requests.size() - free_slots.size(); }
+
+private:
+    struct Ring;
+    struct Request
+    {
+        PositionalFile* file = nullptr;
+        uint8_t* buffer = nullptr;
+        uint64_t length = 0;    // still to be transferred
+        uint64_t offset = 0;
+        bool writing = false;
+        std::function<void(bool)> on_done;
+    };
+
+    static Ring* take_ring( uint32_t depth );       // idle ring, or a new one (nullptr without io_uring)
+    static void give_back_ring( Ring* ring );
+    static std::vector<std::unique_ptr<Ring>>& idle_rings();
+    static std::mutex& idle_rings_mut();
+
+    void queue( PositionalFile& file, uint8_t* buffer, uint64_t length, uint64_t offset, bool writing,
+                std::function<void(bool)>& on_done );
+    void submit( uint32_t slot );
+    uint32_t handle_completions();
+    void finish_synchronously( Request& request, std::vector<std::function<void()>>& callbacks );
+
+    Ring* ring = nullptr;
+    std::vector<Request> requests;
+    std::vector<uint32_t> free_slots;
+};
+
+#endif // IO_QUEUE_H
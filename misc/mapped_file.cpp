@@ -0,0 +1,76 @@
+#include "mapped_file.h"
+
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPED_FILE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+
+bool MappedFile::map( const std::filesystem::path& path )
+{
+    unmap();
+#ifdef MAPPED_FILE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) != 0 or file_stat.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* address = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);   // mapping stays valid after closing the descriptor
+
+    if (address == MAP_FAILED)
+    {
+        std::cout << "mapping " << path << " failed, reading it instead" << std::endl;
+        return false;
+    }
+
+    mapping = (const uint8_t*)address;
+    mapping_size = file_stat.st_size;
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+void MappedFile::unmap()
+{
+#ifdef MAPPED_FILE_MMAP
+    if (mapping != nullptr) munmap((void*)mapping, mapping_size);
+#endif
+    mapping = nullptr;
+    mapping_size = 0;
+}
+
+
+void MappedFile::advise_sequential( uint64_t offset, uint64_t length ) const
+{
+#ifdef MAPPED_FILE_MMAP
+    if (mapping == nullptr or offset >= mapping_size) return;
+    if (length > mapping_size - offset) length = mapping_size - offset;
+
+    // madvise wants an address aligned to page size
+    const uint64_t page_size = sysconf(_SC_PAGESIZE);
+    const uint64_t aligned_offset = offset / page_size * page_size;
+    length += offset - aligned_offset;
+
+    madvise((void*)(mapping + aligned_offset), length, MADV_SEQUENTIAL);
+    madvise((void*)(mapping + aligned_offset), length, MADV_WILLNEED);
+#endif
+}
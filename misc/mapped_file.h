@@ -0,0 +1,35 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstdint>
+#include <filesystem>
+
+
+// Read-only memory mapping of a whole file.
+// Blocks of the file can be given to worker threads as views, without reading them into separate buffers.
+// If mapping isn't possible (empty file, no mmap on this platform), map() returns false,
+// and caller should read the file the usual way.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile( const MappedFile& ) = delete;
+    MappedFile& operator=( const MappedFile& ) = delete;
+
+    bool map( const std::filesystem::path& path );
+    void unmap();
+
+    bool is_mapped() const { return mapping != nullptr; }
+    const uint8_t* data() const { return mapping; }
+    uint64_t size() const { return mapping_size; }
+
+    // Hints for the kernel, that given range will be read soon, from beginning to end
+    void advise_sequential( uint64_t offset, uint64_t length ) const;
+
+private:
+    const uint8_t* mapping = nullptr;
+    uint64_t mapping_size = 0;
+};
+
+#endif // MAPPED_FILE_H
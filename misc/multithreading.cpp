@@ -42,6 +42,13 @@ inline uint16_t calculate_progress( float finishedWork, float totalWork )
     return roundf(finishedWork*100 / totalWork);
 }
 
+inline uint64_t getPartSize(uint64_t original_size, uint32_t part_id, uint32_t block_size)
+{
+    const uint64_t part_start = (uint64_t)part_id * block_size;
+    if (part_start + block_size < original_size) return block_size;
+    return original_size - part_start;
+}
+
 inline void incrementProgressCtr(uint16_t* progressCounterPtr)
 {
     if (progressCounterPtr != nullptr)
@@ -191,22 +198,83 @@ inline void decompressIfNeeded(
             uint16_t flags,
             bool& aborting_var,
             bool* is_finished,
-            uint16_t* progress_ptr)
+            uint16_t* progress_ptr,
+            uint32_t* block_checksum,
+            std::atomic<bool>* corrupted_block_found,
+            PositionalFile* input,
+            uint64_t input_offset,
+            PositionalFile* output,
+            uint64_t output_offset,
+            uint64_t output_size,
+            bool keep_written_block,
+            std::string* block_digest)
     {
         Flagset bin_flags = flags;
+
+        // worker reads its own block, without waiting for foreman or other workers
+        if (input != nullptr and !comp->load_text(*input, input_offset, comp->size) and !aborting_var)
+        {
+            std::cout << "Block " << comp->part_id << " couldn't be read" << std::endl;
+            if (corrupted_block_found != nullptr) *corrupted_block_found = true;
+            *is_finished = true;
+            return;
+        }
+
         if (task == multithreading::mode::compress)
         {
+            if (bin_flags[8])
+            {
+                comp->block_checksum = calculate_CRC32C(comp->text, comp->size);
+                if (block_checksum != nullptr) *block_checksum = comp->block_checksum;
+            }
+            if (block_digest != nullptr)
+                *block_digest = get_checksum_from_memory(get_checksum_type_from_flags(flags), comp->text, comp->size, aborting_var);
             performCompression(comp, bin_flags, aborting_var, progress_ptr);
         }
         else if (task == multithreading::mode::decompress)
         {
             performDecompression(comp, bin_flags, aborting_var, progress_ptr);
+            bool block_corrupted = false;
+
+            // checking the block right after decoding it, so corruption is found without waiting for other blocks
+            if (bin_flags[8] and block_checksum != nullptr and !aborting_var)
+            {
+                *block_checksum = calculate_CRC32C(comp->text, comp->size);
+                // only the foreman's extraction (which writes blocks here) is reported, callers of other modes
+                // (e.g. stream_codec) find out from corrupted_block_found, and decide what to print themselves
+                if (*block_checksum != comp->block_checksum)
+                {
+                    if (output != nullptr) std::cout << "Block " << comp->part_id << " is corrupted" << std::endl;
+                    block_corrupted = true;
+                }
+            }
+            if (block_digest != nullptr and !aborting_var and !block_corrupted)
+                *block_digest = get_checksum_from_memory(get_checksum_type_from_flags(flags), comp->text, comp->size, aborting_var);
+
+            // block is written where it belongs as soon as it's decoded, without waiting for the previous ones
+            if (output != nullptr and !aborting_var and !block_corrupted)
+            {
+                if (comp->size != output_size)
+                {
+                    std::cout << "Block " << comp->part_id << " has wrong size after decoding" << std::endl;
+                    block_corrupted = true;
+                }
+                else if (!comp->save_text(*output, output_offset))
+                {
+                    std::cout << "Block " << comp->part_id << " couldn't be written" << std::endl;
+                    block_corrupted = true;
+                }
+                else std::cout << "Block " << comp->part_id << " saved" << std::endl;
+                if (!keep_written_block) comp->free_text();
+            }
+            if (block_corrupted and corrupted_block_found != nullptr) *corrupted_block_found = true;
         }
         *is_finished = true;
     }
 
     void writeChecksumWhenReady(
-        std::fstream& output,
+        PositionalFile& output,
+        uint64_t output_offset,
         std::string& checksum,
         bool& checksum_done,
         bool& aborting_var,
@@ -220,82 +288,183 @@ inline void decompressIfNeeded(
             cond.wait(lock);
         }
         if (aborting_var) return;
-        if (checksum.length() != 0)
+        if (checksum.length() != 0 and !output.write_at(checksum.c_str(), checksum.length(), output_offset))
         {
-            output.write(checksum.c_str(), checksum.length());
+            return;
         }
         *successful = true;
         std::cout << "Checksum done" << std::endl;
     }
 
-    enum class ChecksumType
+    std::string calculateChecksumFromBlockDigests(
+        ChecksumType type,
+        const std::vector<std::string>& block_digests)
     {
-        CRC32,
-        SHA1,
-        SHA256
-    };
+        // with flag 8, checksum of the whole file is a root of two-level hash tree: leaves are checksums of every block
+        // (of the same type, calculated by workers), and the root is their checksum, so it's as strong as the type itself
+        std::unique_ptr<IncrementalChecksum> checksum_calculator = IncrementalChecksum::create(type);
+        if (checksum_calculator == nullptr) return "";
+
+        for (const std::string& block_digest : block_digests)
+            checksum_calculator->update(reinterpret_cast<const uint8_t*>(block_digest.data()), block_digest.length());
+        return checksum_calculator->get_checksum();
+    }
 
-    ChecksumType getChecksumTypeByLength(std::size_t length)
+    bool readBlockHeader(
+        PositionalFile& archive_file,
+        uint64_t& archive_position,     // moved past the block
+        Compression* comp,
+        bool has_block_checksum,
+        uint64_t& payload_offset)
     {
-        switch (length)
+        // only the header is read here, payload is read by the worker itself
+        uint8_t header[12];
+        const uint32_t header_size = has_block_checksum ? 12 : 8;
+        if (!archive_file.read_at(header, header_size, archive_position)) return false;
+
+        comp->part_id = 0;
+        comp->size = 0;
+        comp->block_checksum = 0;
+        for (uint8_t i=0; i < 4; ++i)
         {
-            case 10:
-                return ChecksumType::CRC32;
-            case 40:
-                return ChecksumType::SHA1;
-            case 64:
-                return ChecksumType::SHA256;
-        }
-        throw std::runtime_error("Unknown checksum. Possible data corruption.");
+            comp->part_id |= (uint32_t)header[i] << (i*8u);
+            comp->size |= (uint32_t)header[i+4] << (i*8u);
+            if (has_block_checksum) comp->block_checksum |= (uint32_t)header[i+8] << (i*8u);
+        }
+
+        payload_offset = archive_position + header_size;
+        archive_position = payload_offset + comp->size;
+        return true;
     }
 
-    std::string calculateChecksumFromDecompressedFile(
-        ChecksumType type,
-        std::fstream& output,
-        bool& aborting_var,
-        uint64_t original_size)
+    PositionalFile* prepareBlockFromFile(
+        PositionalFile& target_file,
+        const MappedFile& mapped_target,
+        const uint8_t* target_data,     // the whole file in memory (mapping of the file, or data given to the foreman)
+        Compression* comp,
+        uint64_t original_size,
+        uint32_t part_id,
+        uint32_t block_size,
+        uint64_t& part_offset)
+    // returns file, from which the worker has to read its block, or nullptr if block is already in memory
     {
-        IntegrityValidation iv;
-        switch (type)
+        comp->part_id = part_id;
+        part_offset = (uint64_t)part_id * block_size;
+
+        if (target_data != nullptr)
         {
-            case ChecksumType::CRC32:
-                return iv.get_CRC32_from_stream(output, aborting_var);
-            case ChecksumType::SHA1:
-                return iv.get_SHA1_from_stream(output, original_size, aborting_var);
-            case ChecksumType::SHA256:
-                return iv.get_SHA256_from_stream(output, aborting_var);
-        }
-        throw std::runtime_error("Unknown checksum. Possible data corruption.");
+            // worker reads its block straight from memory
+            if (mapped_target.is_mapped()) mapped_target.advise_sequential(part_offset, block_size);
+            comp->load_view(target_data, original_size, part_id, block_size);
+            return nullptr;
+        }
+
+        comp->size = getPartSize(original_size, part_id, block_size);
+        return &target_file;
     }
 
-    void validateChecksumWhenReady(
-        std::fstream& output,
-        std::string& checksum,
-        bool& checksum_done,
-        bool& aborting_var,
-        uint64_t original_size,
-        bool* successful,
-        std::condition_variable& cond,
-        std::unique_lock<std::mutex>& lock)
+    // Gives blocks to the foreman, in order.
+    // If I/O is asynchronous, blocks are read a few ahead of workers, so storage is kept busy while workers compute.
+    // Otherwise workers read their blocks by themselves.
+    class BlockReader
     {
-        // awake after checksum is completed
-        while (!checksum_done) cond.wait(lock);
+    public:
+        BlockReader(
+            multithreading::mode task,
+            PositionalFile& archive_file,
+            uint64_t archive_offset,
+            PositionalFile& target_file,
+            const MappedFile& mapped_target,
+            const uint8_t* target_data,
+            std::vector<Compression*>& comp_v,
+            uint64_t original_size,
+            uint32_t block_size,
+            bool has_block_checksum,
+            uint32_t read_ahead) :
+                task(task), archive_file(archive_file), archive_position(archive_offset), target_file(target_file),
+                mapped_target(mapped_target), target_data(target_data), comp_v(comp_v), original_size(original_size), block_size(block_size),
+                has_block_checksum(has_block_checksum), read_ahead(read_ahead),
+                inputs(comp_v.size(), nullptr), offsets(comp_v.size(), 0),
+                read_queued(comp_v.size(), false), read_done(comp_v.size(), false), read_failed(comp_v.size(), false) {}
+
+        // returns false if block couldn't be read; if input is set, worker has to read the block from it
+        bool get_block( uint32_t index, PositionalFile*& input, uint64_t& input_offset )
+        {
+            while (!header_failed and prepared < comp_v.size() and prepared <= index + read_ahead)
+            {
+                if (prepare(prepared)) prepared++;
+                else header_failed = true;
+            }
+            if (index >= prepared)
+            {
+                std::cout << "Header of block " << index << " couldn't be read, or is damaged" << std::endl;
+                return false;
+            }
 
-        if (aborting_var) return;
-        
-        if (checksum.length() != 0)
+            input = inputs[index];
+            input_offset = offsets[index];
+            if (!read_queued[index]) return true;
+
+            input = nullptr;
+            while (!read_done[index]) if (!queue.wait_for_one()) break;
+            return read_done[index] and !read_failed[index];
+        }
+
+        uint64_t get_archive_position() const { return archive_position; }  // right after the last prepared block
+        void wait_for_all() { queue.wait_for_all(); }
+
+    private:
+        bool prepare( uint32_t index )
         {
-            ChecksumType checksumType = getChecksumTypeByLength(checksum.length());
-            std::string recalculatedChecksum = calculateChecksumFromDecompressedFile(
-                checksumType,
-                output,
-                aborting_var,
-                original_size);
+            Compression* comp = comp_v[index];
+            if (task == multithreading::mode::compress)
+            {
+                inputs[index] = prepareBlockFromFile(target_file, mapped_target, target_data, comp, original_size, index, block_size,
+                                                     offsets[index]);
+            }
+            else
+            {
+                // headers are chained, so they're read one by one, only payloads can be read in parallel
+                if (!readBlockHeader(archive_file, archive_position, comp, has_block_checksum, offsets[index])) return false;
+                inputs[index] = &archive_file;
+
+                // decoded block is written at part_id * block_size, so part number must not point somewhere else
+                if (comp->part_id != index) return false;
+            }
 
-            *successful = recalculatedChecksum == checksum;
+            if (inputs[index] != nullptr and queue.is_asynchronous())
+            {
+                comp->replace_text(new uint8_t[comp->size]);
+                read_queued[index] = true;
+                queue.read(*inputs[index], comp->text, comp->size, offsets[index], [this, index](bool done) {
+                    read_done[index] = true;
+                    read_failed[index] = !done;
+                });
+            }
+            return true;
         }
-        else *successful = true;
-    }
+
+        multithreading::mode task;
+        PositionalFile& archive_file;
+        uint64_t archive_position;
+        PositionalFile& target_file;
+        const MappedFile& mapped_target;
+        const uint8_t* target_data;
+        std::vector<Compression*>& comp_v;
+        uint64_t original_size;
+        uint32_t block_size;
+        bool has_block_checksum;
+        uint32_t read_ahead;
+
+        uint32_t prepared = 0;  // blocks with known size and position
+        bool header_failed = false;
+        std::vector<PositionalFile*> inputs;
+        std::vector<uint64_t> offsets;
+        std::vector<bool> read_queued;
+        std::vector<bool> read_done;
+        std::vector<bool> read_failed;
+        IOQueue queue;
+    };
 
     void writeBlockMetadata(
         std::uint32_t blockIndex,
@@ -360,76 +529,119 @@ inline void decompressIfNeeded(
     }
 
     void processing_scribe(
-            multithreading::mode task,
-            std::fstream& output,
+            PositionalFile& output,
+            uint64_t output_offset,
             std::vector<Compression*>& comp_v,
             bool worker_finished[],
             uint32_t block_count,
             uint64_t* compressed_size,
             std::string& checksum,
             bool& checksum_done,
-            uint64_t original_size,
+            bool write_block_checksums,
+            std::vector<uint64_t>* block_offsets,
             bool& aborting_var,
             bool* successful,
             std::condition_variable& cond,
             std::mutex& cond_mut)
+    // writes compressed blocks into archive in order, followed by checksum
+    // if block_offsets is given, position of every block header (relative to output_offset) is added to it
     {
         assert( output.is_open() );
         uint32_t next_to_write = 0;  // index of last written block of data in comp_v
+        uint64_t written = 0;        // bytes written since output_offset
         *compressed_size = 0;
+
+        // blocks are only queued for writing, and freed after they land in the file,
+        // so scribe can go on with the next block while storage is still busy with previous ones
+        bool write_failed = false;
+        IOQueue write_queue;    // waits for queued writes when destroyed, so it has to be declared after write_failed
+
         std::unique_lock<std::mutex> lock(cond_mut);
         while ( next_to_write != block_count )
         {
             if (aborting_var) return;
+            if (write_failed) return;
 
             if (worker_finished[next_to_write]) {
-                if (task == multithreading::mode::compress) {
-                    std::stringstream block_metadata;
-                    block_metadata.write((char *) &next_to_write, sizeof(next_to_write)); // part number
-                    block_metadata.write((char *) &comp_v[next_to_write]->size,
-                                         sizeof(comp_v[next_to_write]->size));
-                    output << block_metadata.rdbuf();
-                    *compressed_size += comp_v[next_to_write]->size + 4 + 4;    // due to part number and block size
+                if (block_offsets != nullptr) block_offsets->push_back(written);
+
+                auto block_metadata = new uint8_t[12];
+                uint32_t metadata_size = 8;     // part number and block size
+                for (uint8_t i=0; i < 4; ++i)
+                {
+                    block_metadata[i] = (next_to_write >> (i*8u)) & 0xFFu;
+                    block_metadata[i+4] = (comp_v[next_to_write]->size >> (i*8u)) & 0xFFu;
+                    block_metadata[i+8] = (comp_v[next_to_write]->block_checksum >> (i*8u)) & 0xFFu;
                 }
+                if (write_block_checksums) metadata_size += 4;
+
+                write_queue.write(output, block_metadata, metadata_size, output_offset + written,
+                                  [block_metadata, &write_failed](bool done) {
+                                      if (!done) write_failed = true;
+                                      delete[] block_metadata;
+                                  });
+                written += metadata_size;
+                *compressed_size += comp_v[next_to_write]->size + metadata_size;
 
-                comp_v[next_to_write]->save_text(output);
-                delete comp_v[next_to_write];
+                Compression* comp = comp_v[next_to_write];
                 comp_v[next_to_write] = nullptr;
-                std::cout << "Block " << next_to_write << " saved" << std::endl;
+                write_queue.write(output, comp->text, comp->size, output_offset + written,
+                                  [comp, &write_failed](bool done) {
+                                      if (!done) write_failed = true;
+                                      else std::cout << "Block " << comp->part_id << " saved" << std::endl;
+                                      delete comp;
+                                  });
+                written += comp->size;
                 next_to_write++;
             }
             else {
+                write_queue.poll();
                 std::cout << "Waiting for block " << next_to_write << "to be finished" << std::endl;
                 cond.wait(lock); // awake after each block is finished
             }
         }
 
-        if (task == multithreading::mode::compress) {
-            writeChecksumWhenReady(
-                output,
-                checksum,
-                checksum_done,
-                aborting_var,
-                successful,
-                cond,
-                lock);
-        }
-        else if (task == multithreading::mode::decompress)
-        {
-            validateChecksumWhenReady(
-                output,
-                checksum,
-                checksum_done,
-                aborting_var,
-                original_size,
-                successful,
-                cond,
-                lock);
+        write_queue.wait_for_all();
+        if (write_failed) return;
+
+        writeChecksumWhenReady(
+            output,
+            output_offset + written,
+            checksum,
+            checksum_done,
+            aborting_var,
+            successful,
+            cond,
+            lock);
+    }
+
+
+    void get_block_layout( uint16_t flags, uint64_t original_size, uint32_t& block_size, uint32_t& block_count )
+    {
+        const auto bin_flags = Flagset{flags};
+        block_size = 1 << 24;  // 2^24 Bytes = 16 MiB, default block size
+
+        if ( bin_flags[9]  ) block_size >>= 1;
+        if ( bin_flags[10] ) block_size >>= 2;
+        if ( bin_flags[11] ) block_size >>= 4;
+        if ( bin_flags[12] ) block_size >>= 8;
 
-            if (output.is_open()) output.close();
+        block_count = ceill((long double)original_size / block_size);
+        if (block_count == 1) block_size = original_size;
+        if (block_count == 0) {
+            block_count = 1;
+            block_size = 0;
         }
     }
 
+    uint64_t get_block_index_size( uint16_t flags, uint64_t original_size )
+    {
+        if (!Flagset{flags}[5]) return 0;
+
+        uint32_t block_size, block_count;
+        get_block_layout(flags, original_size, block_size, block_count);
+        return (uint64_t)block_count * 16;
+    }
 
     bool processing_foreman(
             std::fstream &archive_stream,
@@ -442,7 +654,8 @@ inline void decompressIfNeeded(
             bool validate_integrity,
             uint16_t* progress_ptr,
             uint8_t* metadata,
-            uint32_t metadata_size)
+            uint32_t metadata_size,
+            const uint8_t* target_data)
     /*/ 1. delegates work to each thread
     // 2. calculates checksum and sends it to scribe, after all the blocks of data have been processed
 
@@ -455,46 +668,51 @@ inline void decompressIfNeeded(
         assert(task == mode::compress xor task == mode::decompress);
         assert(archive_stream.is_open());
         std::cout << target_path << std::endl;
-        if (task == mode::compress)
+        if (task == mode::compress and target_data == nullptr)
             assert(std::filesystem::exists(target_path));
 
         const auto bin_flags = Flagset{flags};
-        uint32_t block_size = 1 << 24;  // 2^24 Bytes = 16 MiB, default block size
-
-        if ( bin_flags[9]  ) block_size >>= 1;
-        if ( bin_flags[10] ) block_size >>= 2;
-        if ( bin_flags[11] ) block_size >>= 4;
-        if ( bin_flags[12] ) block_size >>= 8;
+        uint32_t block_size, block_count;
+        get_block_layout(flags, original_size, block_size, block_count);
         std::cout << "\n block size from flags: " << block_size << "\n";
 
-        uint32_t block_count = ceill((long double)original_size / block_size);
-        if (block_count == 1) block_size = original_size;
-        if (block_count == 0) {
-            block_count = 1;
-            block_size = 0;
-        }
-        
-
         // preparing vector of empty Compression objects for threads
         std::vector<Compression*> comp_v;
         for (uint32_t i=0; i < block_count; ++i) comp_v.emplace_back(new Compression(aborting_var));
 
         uint32_t worker_count = getWorkerThreadCount(block_count);
 
-        std::fstream target_stream;
-        if (task == multithreading::mode::compress)
+        // both files are accessed with positional reads and writes, so workers don't have to share stream position
+        PositionalFile target_file;
+        if (task == multithreading::mode::compress and target_data == nullptr)
         {
-            target_stream.open(target_path, std::ios::binary | std::ios::in | std::ios::out);
+            target_file.open(target_path, false);
         }
         else if (task == multithreading::mode::decompress)
         {
-            target_stream.open(target_path, std::ios::binary | std::ios::out);  // making sure target file exists
-            target_stream.close();
-            target_stream.open(target_path, std::ios::binary | std::ios::in | std::ios::out);
+            std::ofstream(target_path, std::ios::binary);  // making sure target file exists and is empty
+            target_file.open(target_path, true);
+
+            // workers write their blocks in any order, so the whole file is allocated up front
+            target_file.allocate(original_size);
         }
 
-        assert(archive_stream.is_open());
-        assert(target_stream.is_open());
+        // data of this file starts at current position of archive_stream, writes through fstream have to land first
+        if (task == multithreading::mode::compress) archive_stream.flush();
+        const uint64_t archive_offset = archive_stream.tellg();
+        PositionalFile archive_file;
+        archive_file.attach(archive_stream);
+
+        assert(archive_file.is_open());
+        assert(target_file.is_open() or target_data != nullptr);
+
+        // when compressing, blocks are read from memory mapped file if possible, instead of copying them from target_stream
+        MappedFile mapped_target;
+        if (task == multithreading::mode::compress and original_size != 0 and target_data == nullptr)
+        {
+            if (mapped_target.map(target_path) and mapped_target.size() != original_size) mapped_target.unmap();
+            if (mapped_target.is_mapped()) target_data = mapped_target.data();
+        }
 
         bool* task_finished_arr = new bool[block_count];
         bool* task_started_arr  = new bool[block_count];
@@ -507,23 +725,49 @@ inline void decompressIfNeeded(
         std::vector<std::thread> workers;
         std::string checksum;
         bool checksum_done = false;
+
+        const ChecksumType checksum_type = get_checksum_type_from_flags(flags);
+
+        // with flag 8, every block has its own CRC-32C, calculated by workers
+        const bool block_checksums = bin_flags[8];
+        const bool verify_block_checksums = block_checksums and (task == multithreading::mode::compress or validate_integrity);
+        std::vector<uint32_t> block_checksum_v(block_count, 0);
+        std::vector<std::string> block_digest_v(verify_block_checksums ? block_count : 0);
+        std::atomic<bool> corrupted_block_found = false;
+
+        // without flag 8, checksum of the whole file is calculated from decoded blocks in order, while the next ones
+        // are still decoded and written out of order, so the file doesn't have to be read again at the end
+        std::unique_ptr<IncrementalChecksum> checksum_calculator;
+        if (task == multithreading::mode::decompress and validate_integrity and !block_checksums)
+            checksum_calculator = IncrementalChecksum::create(checksum_type);
+        const bool keep_written_blocks = checksum_calculator != nullptr;
+        uint32_t next_to_hash = 0;
+        auto hash_written_blocks = [&]() {
+            // workers are joined in order of their blocks, so joined ones are always the beginning of the file
+            for (; keep_written_blocks and next_to_hash < workers.size() and !workers[next_to_hash].joinable(); ++next_to_hash)
+            {
+                if (!aborting_var and !corrupted_block_found)
+                    checksum_calculator->update(comp_v[next_to_hash]->text, comp_v[next_to_hash]->size);
+                comp_v[next_to_hash]->free_text();
+            }
+        };
+
         uint32_t lowest_free_work_ind = 0;
+        BlockReader block_reader(task, archive_file, archive_offset, target_file, mapped_target, target_data, comp_v,
+                                 original_size, block_size, block_checksums, worker_count);
+        if (compressed_size != nullptr and task == multithreading::mode::compress) *compressed_size = 0;
 
         // filling compression objects, and starting worker threads to process them
         for ( uint32_t i=0; i < worker_count; ++i )
         {
-            if (aborting_var) break;
-            if (task == multithreading::mode::compress)
+            if (aborting_var or corrupted_block_found) break;
+            PositionalFile* block_input = nullptr;
+            uint64_t block_offset = 0;
+            if (!block_reader.get_block(i, block_input, block_offset))
             {
-                comp_v[i]->load_part(target_stream, original_size, i, block_size);
-                comp_v[i]->part_id = i;
-
-                if (compressed_size != nullptr) *compressed_size = 0;
-            }
-            else if (task == multithreading::mode::decompress) {
-                archive_stream.read((char*)&comp_v[i]->part_id, sizeof(comp_v[i]->part_id));
-                archive_stream.read((char*)&comp_v[i]->size, sizeof(comp_v[i]->size));
-                comp_v[i]->load_text(archive_stream, comp_v[i]->size);
+                std::cout << "Block " << i << " couldn't be read" << std::endl;
+                corrupted_block_found = true;
+                break;
             }
 
             workers.emplace_back(
@@ -533,15 +777,25 @@ inline void decompressIfNeeded(
                         flags,
                         std::ref(aborting_var),
                         &task_finished_arr[i],
-                        progress_ptr);
+                        progress_ptr,
+                        verify_block_checksums ? &block_checksum_v[i] : nullptr,
+                        &corrupted_block_found,
+                        block_input,
+                        block_offset,
+                        task == multithreading::mode::decompress ? &target_file : nullptr,
+                        (uint64_t)i * block_size,
+                        getPartSize(original_size, i, block_size),
+                        keep_written_blocks,
+                        verify_block_checksums ? &block_digest_v[i] : nullptr);
 
 
             task_started_arr[i] = true;
             lowest_free_work_ind++;
         }
-        if (aborting_var)
+        if (aborting_var or corrupted_block_found)
         {
             for (auto& th: workers) th.join();
+            block_reader.wait_for_all();
             delete[] task_finished_arr;
             delete[] task_started_arr;
             for (auto & comp : comp_v) delete comp;
@@ -556,46 +810,48 @@ inline void decompressIfNeeded(
 
         bool successful = false;
 
+        // with flag 5, offsets of blocks are written after checksum, so any block can be found without reading the previous ones
+        std::vector<uint64_t> block_offsets;
+        uint64_t block_index_size = 0;
+
+        // blocks of archive have to be written in order, decompressed blocks are written by workers themselves
         if (task == multithreading::mode::compress)
         {
             scribe = std::thread(
                 &processing_scribe,
-                task,
-                std::ref(archive_stream),
+                std::ref(archive_file),
+                archive_offset,
                 std::ref(comp_v),
                 task_finished_arr,
                 block_count,
                 compressed_size,
                 std::ref(checksum),
                 std::ref(checksum_done),
-                original_size,
+                block_checksums,
+                bin_flags[5] ? &block_offsets : nullptr,
                 std::ref(aborting_var),
                 &successful,
                 std::ref(scribe_cond),
                 std::ref(scribe_mut));
         }
-        else if (task == multithreading::mode::decompress)
-            scribe = std::thread( &processing_scribe, task, std::ref(target_stream), std::ref(comp_v), task_finished_arr,
-                                  block_count, compressed_size, std::ref(checksum), std::ref(checksum_done),
-                                  original_size, std::ref(aborting_var), &successful, std::ref(scribe_cond), std::ref(scribe_mut));
 
-        while (lowest_free_work_ind != block_count and !aborting_var) {
+        while (lowest_free_work_ind != block_count and !aborting_var and !corrupted_block_found) {
 
-            for (uint32_t i=0; i < workers.size() and !aborting_var; ++i) {
+            for (uint32_t i=0; i < workers.size() and !aborting_var and !corrupted_block_found; ++i) {
                 if (workers[i].joinable()) {
                     if (workers[i].joinable()) workers[i].join();
                     scribe_cond.notify_one();
-                    if (aborting_var) break;
+                    hash_written_blocks();
+                    if (aborting_var or corrupted_block_found) break;
 
                     if (lowest_free_work_ind != block_count) {
-                        if (task == multithreading::mode::compress) {
-                            comp_v[lowest_free_work_ind]->load_part(target_stream, original_size, lowest_free_work_ind, block_size);
-                            comp_v[lowest_free_work_ind]->part_id = lowest_free_work_ind;
-                        }
-                        else if (task == multithreading::mode::decompress) {
-                            archive_stream.read((char*)&comp_v[lowest_free_work_ind]->part_id, sizeof(comp_v[lowest_free_work_ind]->part_id));
-                            archive_stream.read((char*)&comp_v[lowest_free_work_ind]->size, sizeof(comp_v[lowest_free_work_ind]->size));
-                            comp_v[lowest_free_work_ind]->load_text(archive_stream, comp_v[lowest_free_work_ind]->size);
+                        PositionalFile* block_input = nullptr;
+                        uint64_t block_offset = 0;
+                        if (!block_reader.get_block(lowest_free_work_ind, block_input, block_offset))
+                        {
+                            std::cout << "Block " << lowest_free_work_ind << " couldn't be read" << std::endl;
+                            corrupted_block_found = true;
+                            break;
                         }
 
                         workers.emplace_back(&processing_worker,
@@ -604,7 +860,16 @@ inline void decompressIfNeeded(
                                              flags,
                                              std::ref(aborting_var),
                                              &task_finished_arr[lowest_free_work_ind],
-                                             progress_ptr);
+                                             progress_ptr,
+                                             verify_block_checksums ? &block_checksum_v[lowest_free_work_ind] : nullptr,
+                                             &corrupted_block_found,
+                                             block_input,
+                                             block_offset,
+                                             task == multithreading::mode::decompress ? &target_file : nullptr,
+                                             (uint64_t)lowest_free_work_ind * block_size,
+                                             getPartSize(original_size, lowest_free_work_ind, block_size),
+                                             keep_written_blocks,
+                                             verify_block_checksums ? &block_digest_v[lowest_free_work_ind] : nullptr);
 
                         lowest_free_work_ind++;
                     }
@@ -612,11 +877,14 @@ inline void decompressIfNeeded(
             }
         }
 
-        if (aborting_var)
+        if (aborting_var or corrupted_block_found)
         {
+            checksum_done = true;
             scribe_cond.notify_one();
             for (auto& th: workers) if (th.joinable()) th.join();
+            scribe_cond.notify_one();
             if (scribe.joinable()) scribe.join();
+            block_reader.wait_for_all();
             delete[] task_finished_arr;
             delete[] task_started_arr;
             for (auto & comp : comp_v) delete comp;
@@ -624,60 +892,226 @@ inline void decompressIfNeeded(
             return false;
         }
 
-        if (task == multithreading::mode::compress) {
+        if (task == multithreading::mode::compress and block_checksums) {
+            // checksum of the whole file is calculated from checksums of blocks (see calculateChecksumFromBlockDigests),
+            // so it has to wait for all workers
+            for (auto& th : workers) if (th.joinable()) th.join();
+            checksum = calculateChecksumFromBlockDigests(checksum_type, block_digest_v);
+
+            checksum_done = true;
+            scribe_cond.notify_one();
+        }
+        else if (task == multithreading::mode::compress) {
             // since we're done with giving workers work, we can calculate checksum, which scribe thread will append to file
 
-            if (bin_flags[15])  // SHA-1
-            {
-                IntegrityValidation iv;
-                checksum = iv.get_SHA1_from_file(target_path, aborting_var);
-            }
-            if (bin_flags[14])  // CRC-32
-            {
-                IntegrityValidation iv;
-                checksum = iv.get_CRC32_from_file(target_path, aborting_var);
-            }
-            if (bin_flags[13])  // SHA-256
-            {
-                IntegrityValidation iv;
-                checksum = iv.get_SHA256_from_file(target_path, aborting_var);
-            }
+            if (target_data != nullptr)
+                checksum = get_checksum_from_memory(checksum_type, target_data, original_size, aborting_var);
+            else
+                checksum = get_checksum_from_file(checksum_type, target_path, aborting_var);
 
             checksum_done = true;
             scribe_cond.notify_one();
         }
         else if (task == multithreading::mode::decompress)
         {
-            if (bin_flags[15])  // SHA-1
-            {
-                checksum = std::string(40, 0x00);
-                archive_stream.read((char*)checksum.data(), checksum.length());
-            }
-            if (bin_flags[14])  // CRC-32
-            {
-                checksum = std::string(10, 0x00);
-                archive_stream.read((char*)checksum.data(), checksum.length());
-            }
-            if (bin_flags[13])  // SHA-256
-            {
-                checksum = std::string(64, 0x00);
-                archive_stream.read((char*)checksum.data(), checksum.length());
-            }
-
+            checksum = std::string(get_checksum_length(checksum_type), 0x00);
+            archive_file.read_at(checksum.data(), checksum.length(), block_reader.get_archive_position());
             checksum_done = true;
-            scribe_cond.notify_one();
         }
 
         for (auto& th : workers) if (th.joinable()) th.join();
+        hash_written_blocks();
         scribe_cond.notify_one();
         if (scribe.joinable()) scribe.join();
+        block_reader.wait_for_all();
 
         delete[] task_finished_arr;
         delete[] task_started_arr;
         for (auto & comp : comp_v) delete comp;
 
-        if (aborting_var) return false;
+        if (task == multithreading::mode::compress and bin_flags[5] and successful and !aborting_var)
+        {
+            // every entry: compressed offset of block header (relative to data location), and uncompressed offset of block
+            block_index_size = get_block_index_size(flags, original_size);
+            std::vector<uint8_t> block_index(block_index_size, 0);
+            for (uint32_t i=0; i < block_offsets.size() and i < block_count; ++i)
+            {
+                const uint64_t uncompressed_offset = (uint64_t)i * block_size;
+                for (uint8_t j=0; j < 8; ++j)
+                {
+                    block_index[i*16 + j] = (block_offsets[i] >> (j*8u)) & 0xFFu;
+                    block_index[i*16 + 8 + j] = (uncompressed_offset >> (j*8u)) & 0xFFu;
+                }
+            }
+            successful = archive_file.write_at(block_index.data(), block_index.size(),
+                                               archive_offset + *compressed_size + checksum.length());
+        }
+
+        // fstream doesn't know about positional writes, so it's moved right after data of this file
+        if (task == multithreading::mode::compress)
+            archive_stream.seekp(archive_offset + *compressed_size + checksum.length() + block_index_size);
+        else
+            archive_stream.seekg(block_reader.get_archive_position() + checksum.length() + get_block_index_size(flags, original_size));
+
+        if (aborting_var or corrupted_block_found) return false;
+
+        if (task == multithreading::mode::decompress)
+        {
+            if (!validate_integrity or checksum.length() == 0) successful = true;
+            else if (verify_block_checksums)
+                successful = calculateChecksumFromBlockDigests(checksum_type, block_digest_v) == checksum;
+            else
+                successful = checksum_calculator != nullptr and checksum_calculator->get_checksum() == checksum;
+        }
         return successful;
     }
 
+    bool decode_range(
+            std::fstream& archive_stream,
+            uint64_t data_location,
+            uint16_t flags,
+            uint64_t original_size,
+            uint64_t compressed_size,
+            uint64_t offset,
+            uint64_t length,
+            std::vector<uint8_t>& destination,
+            bool& aborting_var)
+    {
+        destination.clear();
+        if (offset > original_size) return false;
+        if (length > original_size - offset) length = original_size - offset;
+        if (length == 0) return true;
+
+        const auto bin_flags = Flagset{flags};
+        uint32_t block_size, block_count;
+        get_block_layout(flags, original_size, block_size, block_count);
+
+        PositionalFile archive_file;
+        archive_file.attach(archive_stream);
+
+        // finding blocks, which contain the range, and positions of their headers
+        std::vector<uint64_t> header_offsets(block_count, 0);
+        std::vector<uint64_t> uncompressed_offsets(block_count, 0);
+        uint32_t first = offset / block_size;
+        uint32_t last = (offset + length - 1) / block_size;
+
+        if (bin_flags[5])
+        {
+            // block index lies right after checksum
+            const uint64_t index_location = data_location + compressed_size
+                                          + get_checksum_length(get_checksum_type_from_flags(flags));
+            std::vector<uint8_t> block_index(get_block_index_size(flags, original_size));
+            if (!archive_file.read_at(block_index.data(), block_index.size(), index_location)) return false;
+
+            for (uint32_t i=0; i < block_count; ++i)
+                for (uint8_t j=0; j < 8; ++j)
+                {
+                    header_offsets[i] |= (uint64_t)block_index[i*16 + j] << (j*8u);
+                    uncompressed_offsets[i] |= (uint64_t)block_index[i*16 + 8 + j] << (j*8u);
+                }
+
+            auto block_containing = [&](uint64_t position) {
+                return uint32_t(std::upper_bound(uncompressed_offsets.begin(), uncompressed_offsets.end(), position)
+                                - uncompressed_offsets.begin() - 1);
+            };
+            first = block_containing(offset);
+            last = block_containing(offset + length - 1);
+        }
+        else
+        {
+            // without index, only headers of the previous blocks have to be read, not their contents
+            Compression header(aborting_var);
+            uint64_t position = data_location;
+            for (uint32_t i=0; i <= last; ++i)
+            {
+                header_offsets[i] = position - data_location;
+                uncompressed_offsets[i] = (uint64_t)i * block_size;
+                uint64_t payload_offset;
+                if (!readBlockHeader(archive_file, position, &header, bin_flags[8], payload_offset)) return false;
+            }
+        }
+        if (first >= block_count or last >= block_count) return false;
+
+        // decoding needed blocks, as many at once as there are worker threads
+        const uint32_t worker_count = getWorkerThreadCount(last - first + 1);
+        std::atomic<bool> corrupted_block_found = false;
+        destination.reserve(length);
+
+        for (uint32_t batch_start = first; batch_start <= last and !aborting_var; batch_start += worker_count)
+        {
+            const uint32_t batch_end = std::min(last + 1, batch_start + worker_count);
+            std::vector<Compression*> comp_v;
+            std::vector<uint32_t> block_checksum_v(batch_end - batch_start, 0);
+            bool* task_finished_arr = new bool[batch_end - batch_start];
+            std::vector<std::thread> workers;
+
+            for (uint32_t i = batch_start; i < batch_end; ++i)
+            {
+                auto comp = new Compression(aborting_var);
+                comp_v.push_back(comp);
+                task_finished_arr[i - batch_start] = false;
+
+                uint64_t position = data_location + header_offsets[i];
+                uint64_t payload_offset;
+                if (!readBlockHeader(archive_file, position, comp, bin_flags[8], payload_offset) or comp->part_id != i)
+                {
+                    std::cout << "Header of block " << i << " couldn't be read, or is damaged" << std::endl;
+                    corrupted_block_found = true;
+                    break;
+                }
+
+                workers.emplace_back(&processing_worker,
+                                     multithreading::mode::decompress,
+                                     comp,
+                                     flags,
+                                     std::ref(aborting_var),
+                                     &task_finished_arr[i - batch_start],
+                                     nullptr,
+                                     bin_flags[8] ? &block_checksum_v[i - batch_start] : nullptr,
+                                     &corrupted_block_found,
+                                     &archive_file,
+                                     payload_offset,
+                                     nullptr,
+                                     0,
+                                     0,
+                                     false,
+                                     nullptr);
+            }
+            for (auto& th : workers) th.join();
+            for (uint32_t i = batch_start; i < batch_start + workers.size() and corrupted_block_found and !aborting_var; ++i)
+            {
+                if (block_checksum_v[i - batch_start] != comp_v[i - batch_start]->block_checksum)
+                    std::cout << "Block " << i << " is corrupted" << std::endl;
+            }
+
+            // copying the part of every block, which overlaps with the range
+            for (uint32_t i = batch_start; i < batch_start + comp_v.size() and !corrupted_block_found; ++i)
+            {
+                Compression* comp = comp_v[i - batch_start];
+                if (comp->size != getPartSize(original_size, i, block_size))
+                {
+                    std::cout << "Block " << i << " has wrong size after decoding" << std::endl;
+                    corrupted_block_found = true;
+                    break;
+                }
+
+                const uint64_t block_start = uncompressed_offsets[i];
+                const uint64_t copy_start = std::max(offset, block_start);
+                const uint64_t copy_end = std::min(offset + length, block_start + comp->size);
+                destination.insert(destination.end(), comp->text + (copy_start - block_start), comp->text + (copy_end - block_start));
+            }
+
+            delete[] task_finished_arr;
+            for (auto comp : comp_v) delete comp;
+            if (corrupted_block_found) break;
+        }
+
+        if (aborting_var or corrupted_block_found)
+        {
+            destination.clear();
+            return false;
+        }
+        return true;
+    }
+
 }
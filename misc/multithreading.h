@@ -3,6 +3,9 @@
 
 #include "integrity_validation.h"
 #include "compression.h"
+#include "mapped_file.h"
+#include "positional_io.h"
+#include "io_queue.h"
 
 #include <cmath>
 #include <bitset>
@@ -10,6 +13,7 @@
 #include <cassert>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 #include <sstream>
 #include <map>
@@ -74,23 +78,39 @@ static std::map<std::string, AlgorithmFlag> strToAlgorithmFlag{
         uint16_t flags,
         bool& aborting_var,
         bool* is_finished,
-        uint16_t* progress_ptr = nullptr);
+        uint16_t* progress_ptr = nullptr,
+        uint32_t* block_checksum = nullptr,
+        std::atomic<bool>* corrupted_block_found = nullptr,
+        PositionalFile* input = nullptr,        // if given, worker reads its block from here by itself
+        uint64_t input_offset = 0,
+        PositionalFile* output = nullptr,       // if given, decoded block is written here, output_size is expected
+        uint64_t output_offset = 0,
+        uint64_t output_size = 0,
+        bool keep_written_block = false,       // written block stays in comp, e.g. for checksum calculated in order
+        std::string* block_digest = nullptr);  // if given, checksum of the original block, of type from flags
 
     void processing_scribe(
-        multithreading::mode task,
-        std::fstream& output,
+        PositionalFile& output,
+        uint64_t output_offset,
         std::vector<Compression*>& comp_v,
         bool worker_finished[],
         uint32_t block_count,
         uint64_t* compressed_size,
         std::string& checksum,
         bool& checksum_done,
-        uint64_t original_size,
+        bool write_block_checksums,
+        std::vector<uint64_t>* block_offsets,
         bool& aborting_var,
         bool* successful,
         std::condition_variable& cond,
         std::mutex& cond_mut);
 
+    // Block size and number of blocks of a file, as they're stored in archive
+    void get_block_layout( uint16_t flags, uint64_t original_size, uint32_t& block_size, uint32_t& block_count );
+
+    // Size of block index stored after checksum (only with flag 5)
+    uint64_t get_block_index_size( uint16_t flags, uint64_t original_size );
+
     bool processing_foreman(
         std::fstream &archive_stream,
         const std::string& target_path,
@@ -102,6 +122,21 @@ static std::map<std::string, AlgorithmFlag> strToAlgorithmFlag{
         bool validate_integrity,
         uint16_t* progress_ptr,
         uint8_t* metadata=nullptr,
-        uint32_t metadata_size=0);
+        uint32_t metadata_size=0,
+        const uint8_t* target_data=nullptr);    // if given when compressing, data is taken from memory instead of target_path
+
+    // Decodes only the blocks containing given range of uncompressed file, and puts the range into destination.
+    // Block index (flag 5) is used to find the blocks, otherwise block headers are walked from the beginning.
+    // Only CRC-32C of blocks (flag 8) can be verified here, checksum of the whole file needs all of it.
+    bool decode_range(
+        std::fstream& archive_stream,
+        uint64_t data_location,
+        uint16_t flags,
+        uint64_t original_size,
+        uint64_t compressed_size,
+        uint64_t offset,
+        uint64_t length,
+        std::vector<uint8_t>& destination,
+        bool& aborting_var);
 }
 #endif // MULTITHREADING_H
@@ -0,0 +1,58 @@
+#include "path_filter.h"
+
+
+bool PathFilter::accepts_file( const std::string& relative_path ) const
+{
+    if (matches_any( excludes, relative_path )) return false;
+    return includes.empty() or matches_any( includes, relative_path );
+}
+
+
+bool PathFilter::accepts_folder( const std::string& relative_path ) const
+{
+    return !matches_any( excludes, relative_path );
+}
+
+
+bool PathFilter::match( const char* pattern, const char* text )
+{
+    while (*pattern != '\0') {
+        if (pattern[0] == '*' and pattern[1] == '*') {
+            pattern += 2;
+            if (*pattern == '/' and match( pattern + 1, text )) return true;   // "**/" can be no folders at all
+            for (const char* rest = text; ; ++rest) {
+                if (match( pattern, rest )) return true;
+                if (*rest == '\0') return false;
+            }
+        }
+        if (*pattern == '*') {
+            ++pattern;
+            for (const char* rest = text; ; ++rest) {
+                if (match( pattern, rest )) return true;
+                if (*rest == '\0' or *rest == '/') return false;
+            }
+        }
+
+        if (*text == '\0') return false;
+        if (*pattern == '?' ? *text == '/' : *pattern != *text) return false;
+        ++pattern;
+        ++text;
+    }
+    return *text == '\0';
+}
+
+
+bool PathFilter::matches_any( const std::vector<std::string>& patterns, const std::string& relative_path )
+{
+    const size_t name_start = relative_path.find_last_of( '/' ) + 1;    // 0 if there's no '/'
+    for (const std::string& pattern : patterns) {
+        if (pattern.find( '/' ) == std::string::npos) {
+            if (match( pattern.c_str(), relative_path.c_str() + name_start )) return true;
+        }
+        else {
+            const size_t pattern_start = pattern[0] == '/' ? 1 : 0;     // "/a" means "a" in the root
+            if (match( pattern.c_str() + pattern_start, relative_path.c_str() )) return true;
+        }
+    }
+    return false;
+}
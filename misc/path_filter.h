@@ -0,0 +1,35 @@
+#ifndef PATH_FILTER_H
+#define PATH_FILTER_H
+
+#include <string>
+#include <vector>
+
+
+// Include and exclude patterns, for paths relative to a folder on disk, or to the root of archive ('/' as separator).
+// Pattern with '/' is matched against the whole path, pattern without it against the name only, at any depth:
+//      *   any characters except '/'       **  any characters (also "a/**/b" matches "a/b")
+//      ?   one character except '/'
+// Folder is taken if it isn't excluded (excluded folder is skipped with everything in it). File is taken
+// if it isn't excluded, and there are no include patterns, or it matches one of them.
+class PathFilter
+{
+public:
+    void include( const std::string& pattern ) { includes.push_back( pattern ); }
+    void exclude( const std::string& pattern ) { excludes.push_back( pattern ); }
+
+    bool empty() const { return includes.empty() and excludes.empty(); }
+    bool has_includes() const { return !includes.empty(); }
+
+    bool accepts_file( const std::string& relative_path ) const;
+    bool accepts_folder( const std::string& relative_path ) const;
+
+    static bool match( const char* pattern, const char* text );
+
+private:
+    static bool matches_any( const std::vector<std::string>& patterns, const std::string& relative_path );
+
+    std::vector<std::string> includes;
+    std::vector<std::string> excludes;
+};
+
+#endif // PATH_FILTER_H
@@ -0,0 +1,248 @@
+#include "positional_io.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define POSITIONAL_IO_PREAD
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#endif
+
+
+PositionalFile::~PositionalFile()
+{
+    close();
+}
+
+
+bool PositionalFile::open( const std::filesystem::path& path, bool writable )
+{
+    close();
+#ifdef POSITIONAL_IO_PREAD
+    fd = ::open(path.c_str(), writable ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+    if (fd != -1) return true;
+#endif
+    // creating the file first, since std::ios::in alone doesn't
+    if (writable and !std::filesystem::exists(path)) std::ofstream(path, std::ios::binary);
+
+    auto mode = std::ios::binary | std::ios::in;
+    if (writable) mode |= std::ios::out;
+    own_stream.open(path, mode);
+    if (!own_stream.is_open()) return false;
+
+    stream = &own_stream;
+    return true;
+}
+
+
+void PositionalFile::close()
+{
+#ifdef POSITIONAL_IO_PREAD
+    if (fd != -1) ::close(fd);
+#endif
+    fd = -1;
+
+    if (own_stream.is_open()) own_stream.close();
+    stream = nullptr;
+}
+
+
+bool PositionalFile::attach( std::fstream& attached_stream )
+{
+    close();
+    if (!attached_stream.is_open()) return false;
+
+#ifdef POSITIONAL_IO_PREAD
+    // separate descriptor of the same file, read-only if the file can't be written
+    if (auto path_stream = dynamic_cast<PathStream*>(&attached_stream))
+    {
+        fd = ::open(path_stream->path().c_str(), O_RDWR);
+        if (fd == -1) fd = ::open(path_stream->path().c_str(), O_RDONLY);
+        if (fd != -1) return true;
+    }
+#endif
+    stream = &attached_stream;
+    return true;
+}
+
+
+bool PositionalFile::allocate( uint64_t size )
+{
+    if (size == 0) return true;
+#ifdef POSITIONAL_IO_PREAD
+    if (fd != -1)
+    {
+#ifdef __linux__
+        // not every file system supports fallocate, then only the size is set
+        if (::fallocate(fd, 0, 0, (off_t)size) == 0) return true;
+#endif
+        return ::ftruncate(fd, (off_t)size) == 0;
+    }
+#endif
+    // without descriptor, file simply grows with each write
+    return stream != nullptr;
+}
+
+
+bool PositionalFile::read_at( void* buffer, uint64_t length, uint64_t offset )
+{
+#ifdef POSITIONAL_IO_PREAD
+    if (fd != -1)
+    {
+        auto destination = (uint8_t*)buffer;
+        while (length != 0)
+        {
+            // pread may read less than asked for, e.g. when interrupted by a signal
+            ssize_t read_count = ::pread(fd, destination, length, (off_t)offset);
+            if (read_count == -1 and errno == EINTR) continue;
+            if (read_count <= 0) return false;
+
+            destination += read_count;
+            offset += read_count;
+            length -= read_count;
+        }
+        return true;
+    }
+#endif
+    if (stream == nullptr) return false;
+
+    std::lock_guard<std::mutex> lock(stream_mut);
+    stream->clear();
+    stream->seekg(offset);
+    stream->read((char*)buffer, length);
+    return (uint64_t)stream->gcount() == length;
+}
+
+
+bool PositionalFile::write_at( const void* buffer, uint64_t length, uint64_t offset )
+{
+#ifdef POSITIONAL_IO_PREAD
+    if (fd != -1)
+    {
+        auto source = (const uint8_t*)buffer;
+        while (length != 0)
+        {
+            ssize_t written_count = ::pwrite(fd, source, length, (off_t)offset);
+            if (written_count == -1 and errno == EINTR) continue;
+            if (written_count <= 0)
+            {
+                std::cout << "positional write failed at offset " << offset << std::endl;
+                return false;
+            }
+
+            source += written_count;
+            offset += written_count;
+            length -= written_count;
+        }
+        return true;
+    }
+#endif
+    if (stream == nullptr) return false;
+
+    std::lock_guard<std::mutex> lock(stream_mut);
+    stream->clear();
+    stream->seekp(offset);
+    stream->write((const char*)buffer, length);
+    return stream->good();
+}
+
+
+bool PositionalFile::truncate( uint64_t size )
+{
+#ifdef POSITIONAL_IO_PREAD
+    if (fd != -1) return ::ftruncate(fd, (off_t)size) == 0;
+#endif
+    return false;
+}
+
+
+bool PositionalFile::sync()
+{
+#ifdef POSITIONAL_IO_PREAD
+    if (fd != -1)
+    {
+        int result;
+        do result = ::fsync(fd);
+        while (result == -1 and errno == EINTR);
+        return result == 0;
+    }
+#endif
+    // stream can only hand its buffer over to the system
+    if (stream == nullptr) return false;
+
+    std::lock_guard<std::mutex> lock(stream_mut);
+    stream->flush();
+    return stream->good();
+}
+
+
+bool copy_range( PositionalFile& source, uint64_t source_offset, PositionalFile& destination, uint64_t destination_offset,
+                 uint64_t length )
+{
+    if (length == 0) return true;
+#ifdef __linux__
+    const int source_fd = source.descriptor();
+    const int destination_fd = destination.descriptor();
+    if (source_fd != -1 and destination_fd != -1)
+    {
+#ifdef FICLONERANGE
+        struct stat status;
+        const uint64_t block_size = (fstat(destination_fd, &status) == 0 and status.st_blksize > 0) ? status.st_blksize : 4096;
+        if (length >= 2*block_size and source_offset % block_size == destination_offset % block_size)
+        {
+            const uint64_t head = (block_size - source_offset % block_size) % block_size;
+            const uint64_t middle = (length - head) / block_size * block_size;
+
+            file_clone_range range{};
+            range.src_fd = source_fd;
+            range.src_offset = source_offset + head;
+            range.src_length = middle;
+            range.dest_offset = destination_offset + head;
+
+            // unsupported file system, or files on different ones, end up in copy_file_range below
+            if (ioctl(destination_fd, FICLONERANGE, &range) == 0)
+                return copy_range(source, source_offset, destination, destination_offset, head)
+                   and copy_range(source, source_offset + head + middle, destination, destination_offset + head + middle,
+                                  length - head - middle);
+        }
+#endif
+        while (length != 0)
+        {
+            loff_t source_position = source_offset;
+            loff_t destination_position = destination_offset;
+            const ssize_t copied = copy_file_range(source_fd, &source_position, destination_fd, &destination_position,
+                                                   std::min<uint64_t>(length, 1u << 30), 0);
+            if (copied == -1 and errno == EINTR) continue;
+            if (copied <= 0) break;     // e.g. EXDEV or ENOSYS on older kernels, buffers below copy the rest
+
+            source_offset += copied;
+            destination_offset += copied;
+            length -= copied;
+        }
+        if (length == 0) return true;
+    }
+#endif
+    // aligned to the page size, so the system can copy whole pages
+    const uint64_t buffer_size = std::min<uint64_t>(length, 4ull << 20);
+    auto buffer = (uint8_t*)std::aligned_alloc(4096, (buffer_size + 4095) / 4096 * 4096);
+    if (buffer == nullptr) return false;
+
+    bool successful = true;
+    for (uint64_t done = 0; successful and done < length; done += buffer_size)
+    {
+        const uint64_t part = std::min(buffer_size, length - done);
+        successful = source.read_at(buffer, part, source_offset + done)
+                 and destination.write_at(buffer, part, destination_offset + done);
+    }
+    std::free(buffer);
+    return successful;
+}
@@ -0,0 +1,85 @@
+#ifndef POSITIONAL_IO_H
+#define POSITIONAL_IO_H
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+
+
+// Reading and writing a file at given offsets (pread/pwrite), without moving any shared position.
+// Thanks to this, many threads can use one file at once: every worker reads its own block,
+// and blocks can be written wherever they belong, in any order.
+//
+// Object can either open a file on its own, or use a file already open in std::fstream. Then its own descriptor
+// of the same file is opened, if the stream is a PathStream (so its path is known). Otherwise, or if there's
+// no pread on this platform, every operation seeks and reads the stream instead, under a mutex.
+class PositionalFile
+{
+public:
+    PositionalFile() = default;
+    ~PositionalFile();
+    PositionalFile( const PositionalFile& ) = delete;
+    PositionalFile& operator=( const PositionalFile& ) = delete;
+
+    bool open( const std::filesystem::path& path, bool writable );
+    void close();
+
+    // Uses file open in the stream. Stream has to be flushed before, and seeked after positional writes,
+    // because fstream doesn't know anything about them.
+    bool attach( std::fstream& stream );
+
+    bool is_open() const { return fd != -1 or stream != nullptr; }
+    int descriptor() const { return fd; }   // -1 if stream is used instead
+
+    // Reserves space for the file, and sets its size, so blocks can be written at any offset without fragmentation
+    bool allocate( uint64_t size );
+
+    // Both return false if not all the bytes could be read/written
+    bool read_at( void* buffer, uint64_t length, uint64_t offset );
+    bool write_at( const void* buffer, uint64_t length, uint64_t offset );
+
+    // Cuts the file (or makes it longer), false if it can't be done without descriptor
+    bool truncate( uint64_t size );
+
+    // Waits until everything written so far is on the disk (fsync), not only in the cache of the system
+    bool sync();
+
+private:
+    int fd = -1;
+
+    std::fstream own_stream;
+    std::fstream* stream = nullptr;
+    std::mutex stream_mut;
+};
+
+
+// std::fstream which remembers the path of its file, so PositionalFile::attach() can open the same file again
+class PathStream : public std::fstream
+{
+public:
+    PathStream() = default;
+    PathStream( const std::filesystem::path& path, std::ios::openmode mode ) { open(path, mode); }
+
+    void open( const std::filesystem::path& path, std::ios::openmode mode )
+    {
+        std::fstream::open(path, mode);
+        file_path = path;
+    }
+
+    const std::filesystem::path& path() const { return file_path; }
+
+private:
+    std::filesystem::path file_path;
+};
+
+
+// Copies length bytes from one file to another (or inside one file, if ranges don't overlap), fastest way available:
+//  - reflink (FICLONERANGE, btrfs, xfs), blocks are shared, nothing is copied. Works only for whole blocks
+//    which lie at the same offset within a block in both files, the rest is copied normally
+//  - copy_file_range, data is copied by the kernel, without going through user space
+//  - reading and writing big aligned buffers, if neither works (other systems, files without descriptor)
+bool copy_range( PositionalFile& source, uint64_t source_offset, PositionalFile& destination, uint64_t destination_offset,
+                 uint64_t length );
+
+#endif // POSITIONAL_IO_H
@@ -1,9 +1,10 @@
 #include "processing_helpers.h"
+#include "archive.h"
 
 
-CompressionObject::CompressionObject(std::vector<File*> given_file_list, uint16_t* progress_ptr, uint32_t* progressBarStepMax, std::filesystem::path tmp_path) : QObject(nullptr)
+CompressionObject::CompressionObject(std::vector<File*> given_file_list, uint16_t* progress_ptr, uint32_t* progressBarStepMax, Archive* archive) : QObject(nullptr)
 {
-    temp_path = tmp_path;
+    this->archive = archive;
     this->file_list = given_file_list;
     this->aborting_variable = false;
     this->progress_step = progress_ptr;
@@ -12,14 +13,10 @@ CompressionObject::CompressionObject(std::vector<File*> given_file_list, uint16_
 
 
 CompressionObject::~CompressionObject() {
-    if (temp_output.is_open()) temp_output.close();
 }
 
 
 void CompressionObject::startProcessing() {
-
-    this->temp_output.open(temp_path, std::ios::binary | std::ios::in | std::ios::out);
-    assert( temp_output.is_open() );
     start();
 }
 
@@ -33,26 +30,31 @@ void CompressionObject::start() {
     emit progressNextFile(0);
     emit progressNextStep(0);
 
-    QStringList failed_files;
-
-    uint16_t i=0;
-    for (; i < file_list.size(); ++i)
-    {
-        emit setFilePathLabel( file_list[i]->path.data() );
+    uint64_t started_files = 0;
+    auto progress = [this, &started_files]( const std::string& label, File* file ) {
+        emit setFilePathLabel( QString::fromStdString( label ) );
+        if (file == nullptr) return;
 
+        emit progressNextFile( (double)started_files++ / (double)file_list.size() * 100.0 );
         *progress_step = 0;
-        std::bitset<16> bin_flags(file_list[i]->flags_value);
-        *progressBarStepMax = ceil((double)std::filesystem::file_size(file_list[i]->path) / (double)((1ull << 24)-1))*bin_flags.count();
+        std::bitset<16> bin_flags(file->flags_value);
+        *progressBarStepMax = ceil((double)std::filesystem::file_size(file->path) / (double)((1ull << 24)-1))*bin_flags.count();
+    };
 
-        bool successful = false;
-        if (!aborting_variable) successful = file_list[i]->append_to_archive( temp_output, aborting_variable, false, progress_step );
+    // new files go where the central directory was, it's written again after them
+    archive->remove_central_directory();
+    const bool successful = archive->append_files( file_list, aborting_variable, progress_step, progress );
 
-        if (!successful) failed_files.append(QString::fromStdString(file_list[i]->path));
-        emit progressNextFile((1.0+i)/(double)file_list.size()*100.0);
-    }
+    // files are linked all at once, so if anything failed, none of them is in archive
+    QStringList failed_files;
+    if (!successful and !aborting_variable)
+        for (auto& file : file_list) failed_files.append(QString::fromStdString(file->path));
+    if (!successful) archive->reread_tree();     // file_list points into the old model after that
+    archive->write_central_directory();
 
+    emit progressNextFile(100);
     emit progressNextStep(100);
-    emit processingFinished( !aborting_variable and failed_files.empty() );
+    emit processingFinished( successful );
     if (!failed_files.empty()) emit displayFailedFiles(failed_files);
 
     QThread::currentThread()->quit();
@@ -10,18 +10,20 @@
 
 #include "archive_structures.h"
 
+class Archive;
+
 
 class CompressionObject : public QObject
 {
     Q_OBJECT
 public:
-    explicit CompressionObject( std::vector<File*> file_list, uint16_t* progress_ptr, uint32_t* progressBarStepMax, std::filesystem::path tmp_path );
+    explicit CompressionObject( std::vector<File*> file_list, uint16_t* progress_ptr, uint32_t* progressBarStepMax, Archive* archive );
     ~CompressionObject();
     void start();
 
+    // files are appended to the archive itself, and linked into it only if all of them succeeded (see Archive::append_files)
     std::vector<File*> file_list;
-    std::fstream temp_output;
-    std::filesystem::path temp_path;
+    Archive* archive;
     bool aborting_variable;
     uint16_t* progress_step;
     uint32_t* progressBarStepMax = nullptr;
@@ -0,0 +1,402 @@
+#include "sha.h"
+
+#include <bit>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHA_X86_KERNELS
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+
+namespace
+{
+alignas(16) const uint32_t SHA256_round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+
+using SHA1_function = void (*)( uint32_t h[5], const uint8_t* data, uint64_t block_count );
+using SHA256_function = void (*)( uint32_t h[8], const uint8_t* data, uint64_t block_count );
+using SHA256_lanes_function = void (*)( uint32_t* h[8], const uint8_t* blocks[8] );
+
+
+inline uint32_t load_big_endian( const uint8_t* bytes )
+{
+    return ((uint32_t)bytes[0] << 24u) | ((uint32_t)bytes[1] << 16u) | ((uint32_t)bytes[2] << 8u) | (uint32_t)bytes[3];
+}
+
+
+void SHA256_lanes_portable( uint32_t* h[8], const uint8_t* blocks[8] )
+{
+    for (uint8_t lane = 0; lane < 8; ++lane)
+        sha::SHA256_compress_portable(h[lane], blocks[lane], 1);
+}
+
+
+#ifdef SHA_X86_KERNELS
+bool cpu_has_SHA_NI()
+{
+    // CPUID leaf 7, EBX bit 29; SHA-NI kernels also use SSSE3 and SSE4.1
+    uint32_t eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+    return ((ebx >> 29) & 1) and __builtin_cpu_supports("ssse3") and __builtin_cpu_supports("sse4.1");
+}
+
+
+template<int round_function>
+__attribute__((target("sha,ssse3,sse4.1")))
+inline void SHA1_NI_20_rounds( __m128i& abcd, __m128i& e0, __m128i& e1, __m128i msg[4], uint32_t first_group )
+{
+    // 5 groups of 4 rounds, each group also calculates next 4 words of message schedule
+    for (uint32_t group = first_group; group < first_group + 5; ++group)
+    {
+        __m128i& w = msg[group % 4];
+        if (group >= 4)
+        {
+            // w[t] = rotl(w[t-3] ^ w[t-8] ^ w[t-14] ^ w[t-16], 1)
+            w = _mm_sha1msg1_epu32(w, msg[(group + 1) % 4]);
+            w = _mm_xor_si128(w, msg[(group + 2) % 4]);
+            w = _mm_sha1msg2_epu32(w, msg[(group + 3) % 4]);
+        }
+
+        if (group == 0) e0 = _mm_add_epi32(e0, w);
+        else e0 = _mm_sha1nexte_epu32(e1, w);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, round_function);
+    }
+}
+
+
+__attribute__((target("sha,ssse3,sse4.1")))
+void SHA1_NI( uint32_t h[5], const uint8_t* data, uint64_t block_count )
+{
+    // based on Intel's "New Instructions Supporting the Secure Hash Algorithm on Intel Architecture Processors"
+    const __m128i byte_swap_mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)h), 0x1B);
+    __m128i e0 = _mm_set_epi32((int)h[4], 0, 0, 0);
+    __m128i e1;
+    __m128i msg[4];
+
+    for (uint64_t block = 0; block < block_count; ++block, data += 64)
+    {
+        const __m128i abcd_saved = abcd;
+        const __m128i e0_saved = e0;
+
+        for (uint8_t i = 0; i < 4; ++i)
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16*i)), byte_swap_mask);
+
+        SHA1_NI_20_rounds<0>(abcd, e0, e1, msg, 0);
+        SHA1_NI_20_rounds<1>(abcd, e0, e1, msg, 5);
+        SHA1_NI_20_rounds<2>(abcd, e0, e1, msg, 10);
+        SHA1_NI_20_rounds<3>(abcd, e0, e1, msg, 15);
+
+        e0 = _mm_sha1nexte_epu32(e1, e0_saved);
+        abcd = _mm_add_epi32(abcd, abcd_saved);
+    }
+
+    _mm_storeu_si128((__m128i*)h, _mm_shuffle_epi32(abcd, 0x1B));
+    h[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+
+__attribute__((target("sha,ssse3,sse4.1")))
+void SHA256_NI( uint32_t h[8], const uint8_t* data, uint64_t block_count )
+{
+    // based on Intel's "New Instructions Supporting the Secure Hash Algorithm on Intel Architecture Processors"
+    const __m128i byte_swap_mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // state is kept as ABEF and CDGH, the way sha256rnds2 wants it
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&h[0]), 0xB1);   // CDAB
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&h[4]), 0x1B);   // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);       // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);           // CDGH
+
+    __m128i msg[4];
+
+    for (uint64_t block = 0; block < block_count; ++block, data += 64)
+    {
+        const __m128i state0_saved = state0;
+        const __m128i state1_saved = state1;
+
+        for (uint8_t group = 0; group < 16; ++group)
+        {
+            __m128i& w = msg[group % 4];
+            if (group < 4)
+                w = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16*group)), byte_swap_mask);
+            else
+            {
+                // w[t] = w[t-16] + s0(w[t-15]) + w[t-7] + s1(w[t-2])
+                w = _mm_sha256msg1_epu32(w, msg[(group + 1) % 4]);
+                w = _mm_add_epi32(w, _mm_alignr_epi8(msg[(group + 3) % 4], msg[(group + 2) % 4], 4));
+                w = _mm_sha256msg2_epu32(w, msg[(group + 3) % 4]);
+            }
+
+            __m128i words = _mm_add_epi32(w, _mm_load_si128((const __m128i*)&SHA256_round_constants[4*group]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, words);
+            words = _mm_shuffle_epi32(words, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, words);
+        }
+
+        state0 = _mm_add_epi32(state0, state0_saved);
+        state1 = _mm_add_epi32(state1, state1_saved);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);                 // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);              // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);           // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);              // HGFE
+
+    _mm_storeu_si128((__m128i*)&h[0], state0);
+    _mm_storeu_si128((__m128i*)&h[4], state1);
+}
+
+
+__attribute__((target("avx2")))
+inline __m256i rotr_8_lanes( __m256i x, int n )
+{
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+
+__attribute__((target("avx2")))
+void SHA256_lanes_AVX2( uint32_t* h[8], const uint8_t* blocks[8] )
+{
+    // the same as SHA256_compress_portable, but every 32-bit variable holds 8 values, one for every lane
+    __m256i w[64];
+    for (uint8_t i = 0; i < 16; ++i)
+    {
+        w[i] = _mm256_setr_epi32(
+            (int)load_big_endian(blocks[0] + 4*i), (int)load_big_endian(blocks[1] + 4*i),
+            (int)load_big_endian(blocks[2] + 4*i), (int)load_big_endian(blocks[3] + 4*i),
+            (int)load_big_endian(blocks[4] + 4*i), (int)load_big_endian(blocks[5] + 4*i),
+            (int)load_big_endian(blocks[6] + 4*i), (int)load_big_endian(blocks[7] + 4*i));
+    }
+    for (uint8_t i = 16; i < 64; ++i)
+    {
+        __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(rotr_8_lanes(w[i-15], 7), rotr_8_lanes(w[i-15], 18)), _mm256_srli_epi32(w[i-15], 3));
+        __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(rotr_8_lanes(w[i-2], 17), rotr_8_lanes(w[i-2], 19)), _mm256_srli_epi32(w[i-2], 10));
+        w[i] = _mm256_add_epi32(_mm256_add_epi32(w[i-16], S0), _mm256_add_epi32(w[i-7], S1));
+    }
+
+    __m256i state[8];
+    for (uint8_t j = 0; j < 8; ++j)
+        state[j] = _mm256_setr_epi32((int)h[0][j], (int)h[1][j], (int)h[2][j], (int)h[3][j],
+                                     (int)h[4][j], (int)h[5][j], (int)h[6][j], (int)h[7][j]);
+
+    __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+    __m256i e = state[4], f = state[5], g = state[6], hh = state[7];
+
+    for (uint8_t i = 0; i < 64; ++i)
+    {
+        __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(rotr_8_lanes(e, 6), rotr_8_lanes(e, 11)), rotr_8_lanes(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i temp1 = _mm256_add_epi32(_mm256_add_epi32(hh, S1), _mm256_add_epi32(ch, w[i]));
+        temp1 = _mm256_add_epi32(temp1, _mm256_set1_epi32((int)SHA256_round_constants[i]));
+        __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(rotr_8_lanes(a, 2), rotr_8_lanes(a, 13)), rotr_8_lanes(a, 22));
+        __m256i maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+        __m256i temp2 = _mm256_add_epi32(S0, maj);
+
+        hh = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, temp1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(temp1, temp2);
+    }
+
+    state[0] = _mm256_add_epi32(state[0], a);
+    state[1] = _mm256_add_epi32(state[1], b);
+    state[2] = _mm256_add_epi32(state[2], c);
+    state[3] = _mm256_add_epi32(state[3], d);
+    state[4] = _mm256_add_epi32(state[4], e);
+    state[5] = _mm256_add_epi32(state[5], f);
+    state[6] = _mm256_add_epi32(state[6], g);
+    state[7] = _mm256_add_epi32(state[7], hh);
+
+    alignas(32) uint32_t lanes[8];
+    for (uint8_t j = 0; j < 8; ++j)
+    {
+        _mm256_store_si256((__m256i*)lanes, state[j]);
+        for (uint8_t lane = 0; lane < 8; ++lane) h[lane][j] = lanes[lane];
+    }
+}
+#endif
+
+
+SHA1_function choose_SHA1_implementation()
+{
+#ifdef SHA_X86_KERNELS
+    if (cpu_has_SHA_NI()) return &SHA1_NI;
+#endif
+    return &sha::SHA1_compress_portable;
+}
+
+
+SHA256_function choose_SHA256_implementation()
+{
+#ifdef SHA_X86_KERNELS
+    if (cpu_has_SHA_NI()) return &SHA256_NI;
+#endif
+    return &sha::SHA256_compress_portable;
+}
+
+
+SHA256_lanes_function choose_SHA256_lanes_implementation()
+{
+#ifdef SHA_X86_KERNELS
+    if (__builtin_cpu_supports("avx2")) return &SHA256_lanes_AVX2;
+#endif
+    return &SHA256_lanes_portable;
+}
+}
+
+
+void sha::SHA1_compress( uint32_t h[5], const uint8_t* data, uint64_t block_count )
+{
+    static const SHA1_function implementation = choose_SHA1_implementation();
+    implementation(h, data, block_count);
+}
+
+
+void sha::SHA256_compress( uint32_t h[8], const uint8_t* data, uint64_t block_count )
+{
+    static const SHA256_function implementation = choose_SHA256_implementation();
+    implementation(h, data, block_count);
+}
+
+
+void sha::SHA256_compress_8_lanes( uint32_t* h[8], const uint8_t* blocks[8] )
+{
+    static const SHA256_lanes_function implementation = choose_SHA256_lanes_implementation();
+    implementation(h, blocks);
+}
+
+
+bool sha::has_SHA_instructions()
+{
+#ifdef SHA_X86_KERNELS
+    static const bool has_SHA_NI = cpu_has_SHA_NI();
+    return has_SHA_NI;
+#else
+    return false;
+#endif
+}
+
+
+void sha::SHA1_compress_portable( uint32_t h[5], const uint8_t* data, uint64_t block_count )
+{
+    // implemented using pseudocode from: https://en.wikipedia.org/wiki/SHA-1#SHA-1_pseudocode
+    for (uint64_t block = 0; block < block_count; ++block, data += 64)
+    {
+        uint32_t chunk[80];
+        for (uint8_t i = 0; i < 16; i++) // making 16 32-bit words from 64 8-bit words
+            chunk[i] = load_big_endian(data + i*4);
+        for (uint8_t i = 16; i < 80; i++)
+            chunk[i] = std::rotl(chunk[i-3] ^ chunk[i-8] ^ chunk[i-14] ^ chunk[i-16], 1);
+
+        uint32_t a = h[0];
+        uint32_t b = h[1];
+        uint32_t c = h[2];
+        uint32_t d = h[3];
+        uint32_t e = h[4];
+
+        for (uint8_t i = 0; i < 80; i++)
+        {
+            uint32_t f, k;
+            if (i <= 19) {
+                f = (b & c) | ((~b) & d);
+                k = 0x5A827999;
+            }
+            else if (i <= 39) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if (i <= 59) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            }
+            else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t temp = std::rotl(a, 5) + f + e + k + chunk[i];
+            e = d;
+            d = c;
+            c = std::rotl(b, 30);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+}
+
+
+void sha::SHA256_compress_portable( uint32_t h[8], const uint8_t* data, uint64_t block_count )
+{
+    // implemented using pseudocode from: https://en.wikipedia.org/wiki/SHA-2#Pseudocode
+    for (uint64_t block = 0; block < block_count; ++block, data += 64)
+    {
+        uint32_t chunks[64];
+        for (uint8_t i = 0; i < 16; i++) // making 16 32-bit words from 64 8-bit words
+            chunks[i] = load_big_endian(data + i*4);
+        for (uint32_t i = 16; i < 64; i++)
+        {
+            uint32_t S0 = std::rotr(chunks[i-15], 7) ^ std::rotr(chunks[i-15], 18) ^ (chunks[i-15] >> 3);
+            uint32_t S1 = std::rotr(chunks[i-2], 17) ^ std::rotr(chunks[i-2], 19)  ^ (chunks[i-2] >> 10);
+            chunks[i] = chunks[i - 16] + S0 + chunks[i - 7] + S1;
+        }
+
+        uint32_t a = h[0];
+        uint32_t b = h[1];
+        uint32_t c = h[2];
+        uint32_t d = h[3];
+        uint32_t e = h[4];
+        uint32_t f = h[5];
+        uint32_t g = h[6];
+        uint32_t hh = h[7];
+
+        for (uint32_t i = 0; i < 64; i++)
+        {
+            uint32_t S1 = std::rotr(e, 6) ^ std::rotr(e, 11) ^ std::rotr(e, 25);
+            uint32_t ch = (e & f) ^ ((~e) & g);
+            uint32_t temp1 = hh + S1 + ch + SHA256_round_constants[i] + chunks[i];
+            uint32_t S0 = std::rotr(a, 2) ^ std::rotr(a, 13) ^ std::rotr(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t temp2 = S0 + maj;
+
+            hh = g;
+            g = f;
+            f = e;
+            e = d + temp1;
+            d = c;
+            c = b;
+            b = a;
+            a = temp1 + temp2;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+        h[5] += f;
+        h[6] += g;
+        h[7] += hh;
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef SHA_H
+#define SHA_H
+
+#include <cstdint>
+
+
+// Compression functions of SHA-1 and SHA-256, without padding and formatting,
+// which are done in integrity_validation.cpp.
+//
+// Implementation is chosen at runtime, depending on what CPU supports:
+//  - SHA-1 / SHA-256: SHA-NI instructions, portable implementation otherwise
+//  - 8 independent SHA-256 at once: AVX2, one after another otherwise
+// All of them are thread safe.
+namespace sha
+{
+    // Processes block_count consecutive 64-byte blocks of data
+    void SHA1_compress( uint32_t h[5], const uint8_t* data, uint64_t block_count );
+    void SHA256_compress( uint32_t h[8], const uint8_t* data, uint64_t block_count );
+
+    // Processes one 64-byte block for each of 8 independent SHA-256 states
+    void SHA256_compress_8_lanes( uint32_t* h[8], const uint8_t* blocks[8] );
+
+    // true if SHA256_compress uses SHA-NI, and so single buffer is quicker than SHA256_compress_8_lanes
+    bool has_SHA_instructions();
+
+    // Portable implementations, used when CPU doesn't have needed instructions
+    void SHA1_compress_portable( uint32_t h[5], const uint8_t* data, uint64_t block_count );
+    void SHA256_compress_portable( uint32_t h[8], const uint8_t* data, uint64_t block_count );
+}
+
+#endif // SHA_H
@@ -0,0 +1,322 @@
+#include "solid_block.h"
+
+#include <algorithm>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "archive_structures.h"
+#include "integrity_validation.h"
+#include "multithreading.h"
+
+
+namespace
+{
+    void put_u64( uint8_t* buffer, uint64_t value )
+    {
+        for (uint8_t i=0; i < 8; i++) buffer[i] = (value >> (i*8u)) & 0xFFu;
+    }
+
+    uint64_t get_u64( const uint8_t* buffer )
+    {
+        uint64_t value = 0;
+        for (uint8_t i=0; i < 8; i++) value |= (uint64_t)buffer[i] << (i*8u);
+        return value;
+    }
+
+    // Decoded blocks of solid blocks, the most recently used first
+    struct CachedBlock
+    {
+        const std::fstream* archive;
+        uint64_t location;
+        uint16_t flags;
+        uint64_t compressed_size;
+        uint32_t index;
+        std::shared_ptr<const std::vector<uint8_t>> data;     // shared, so reading a few bytes doesn't copy the whole block
+    };
+    const uint32_t cache_capacity = 4;
+    std::list<CachedBlock> cache;
+    std::mutex cache_mut;
+
+    std::shared_ptr<const std::vector<uint8_t>> get_block( std::fstream& archive_file, uint64_t location, const solid::SolidHeader& header,
+                                                           uint32_t index, uint32_t block_size, bool& aborting_var )
+    {
+        {
+            std::lock_guard<std::mutex> lock(cache_mut);
+            for (auto cached = cache.begin(); cached != cache.end(); ++cached)
+                if (cached->archive == &archive_file and cached->location == location and cached->index == index
+                    and cached->flags == header.flags and cached->compressed_size == header.compressed_size)
+                {
+                    cache.splice(cache.begin(), cache, cached);
+                    return cached->data;
+                }
+        }
+
+        auto block = std::make_shared<std::vector<uint8_t>>();
+        const uint64_t block_start = (uint64_t)index * block_size;
+        if (!multithreading::decode_range(archive_file, location + solid::header_size, header.flags, header.original_size,
+                                          header.compressed_size, block_start, block_size, *block, aborting_var))
+            return nullptr;
+
+        std::lock_guard<std::mutex> lock(cache_mut);
+        cache.push_front(CachedBlock{&archive_file, location, header.flags, header.compressed_size, index, block});
+        if (cache.size() > cache_capacity) cache.pop_back();
+        return block;
+    }
+
+    // Appends given part of uncompressed stream of a solid block to destination
+    bool extract_from_block( std::fstream& archive_file, const solid::Range& range, std::vector<uint8_t>& destination, bool& aborting_var )
+    {
+        if (range.length == 0) return true;
+
+        solid::SolidHeader header;
+        if (!solid::read_header(archive_file, range.block_location, header) or solid::is_chunk_list(header)) return false;
+        if (range.offset + range.length > header.original_size) return false;
+
+        uint32_t block_size, block_count;
+        multithreading::get_block_layout(header.flags, header.original_size, block_size, block_count);
+        if (block_size == 0) return false;
+
+        const uint64_t end = range.offset + range.length;
+        for (uint32_t index = range.offset / block_size; index <= (end - 1) / block_size; ++index)
+        {
+            auto block = get_block(archive_file, range.block_location, header, index, block_size, aborting_var);
+            if (block == nullptr) return false;
+
+            const uint64_t block_start = (uint64_t)index * block_size;
+            const uint64_t from = std::max(range.offset, block_start) - block_start;
+            const uint64_t to = std::min<uint64_t>(end - block_start, block->size());
+            if (from >= to) return false;
+            destination.insert(destination.end(), block->begin() + from, block->begin() + to);
+        }
+        return true;
+    }
+}
+
+
+std::vector<std::vector<File*>> solid::make_groups( const std::vector<File*>& files )
+{
+    std::vector<File*> small_files;
+    for (File* file : files)
+    {
+        if (file->alreadySaved or !is_member(file->flags_value) or file->data_location != 0) continue;
+        if (file->original_size <= small_file_limit) small_files.push_back(file);
+    }
+
+    // similar files (by extension) next to each other compress better, names keep the order stable
+    std::stable_sort(small_files.begin(), small_files.end(), [](const File* a, const File* b) {
+        const std::string extension_a = std::filesystem::path(a->name).extension().string();
+        const std::string extension_b = std::filesystem::path(b->name).extension().string();
+        if (extension_a != extension_b) return extension_a < extension_b;
+        return a->name < b->name;
+    });
+
+    std::vector<std::vector<File*>> groups;
+    uint64_t group_size = 0;
+    for (File* file : small_files)
+    {
+        // every solid block is compressed with flags of its first member
+        if (groups.empty() or group_size + file->original_size > group_limit
+            or (groups.back()[0]->flags_value != file->flags_value))
+        {
+            groups.emplace_back();
+            group_size = 0;
+        }
+        groups.back().push_back(file);
+        group_size += file->original_size;
+    }
+
+    for (auto& group : groups)
+        if (group.size() == 1) group[0]->flags_value &= ~(1u << flag);
+    groups.erase(std::remove_if(groups.begin(), groups.end(), [](auto& group) { return group.size() < 2; }), groups.end());
+    return groups;
+}
+
+
+bool solid::write_group( std::fstream& archive_file, const std::vector<File*>& members, bool& aborting_var )
+{
+    if (members.empty()) return true;
+
+    // members are put together in memory (group_limit at most), and the foreman compresses them from there
+    uint64_t total_size = 0;
+    for (File* member : members) total_size += member->original_size;
+    std::vector<uint8_t> stream;
+    stream.reserve(total_size);
+
+    std::unordered_map<std::string, uint64_t> offsets;     // SHA-256 -> offset, so copies of the same file are stored once
+    for (File* member : members)
+    {
+        const uint64_t offset = stream.size();
+        stream.resize(offset + member->original_size);
+        std::ifstream input(member->path, std::ios::binary);
+        input.read((char*)stream.data() + offset, member->original_size);
+        if ((uint64_t)input.gcount() != member->original_size)
+        {
+            std::cout << "File " << member->path << " changed its size, solid block couldn't be made" << std::endl;
+            return false;
+        }
+
+        const std::string hash = get_checksum_from_memory(ChecksumType::SHA256, stream.data() + offset, member->original_size, aborting_var);
+        auto [known, inserted] = offsets.emplace(hash, offset);
+        member->compressed_size = known->second;   // offset in uncompressed stream
+        if (!inserted) stream.resize(offset);
+    }
+    if (aborting_var) return false;
+
+    const uint64_t location = write_block(archive_file, stream.data(), members[0]->flags_value, stream.size(), aborting_var);
+    if (location == 0) return false;
+
+    for (File* member : members) member->data_location = location;
+    return true;
+}
+
+
+uint64_t solid::write_block( std::fstream& archive_file, const uint8_t* data, uint16_t flags, uint64_t original_size, bool& aborting_var )
+{
+    // members are decoded block by block, without the checksum of the whole stream, so every block gets its own CRC-32C
+    SolidHeader header;
+    header.flags = (flags & ~(1u << flag)) | (1u << 5u) | (1u << 8u);
+    header.original_size = original_size;
+
+    const uint64_t location = archive_file.tellp();
+    uint8_t buffer[header_size] = {0};
+    archive_file.write((char*)buffer, header_size);     // written again, when compressed size is known
+
+    const bool successful = multithreading::processing_foreman(archive_file, "", multithreading::mode::compress,
+                                                               header.flags, header.original_size, &header.compressed_size,
+                                                               aborting_var, true, nullptr, nullptr, 0, data);
+    if (!successful or aborting_var) return 0;
+
+    const uint64_t end_of_block = archive_file.tellp();
+    write_header(buffer, header);
+    archive_file.seekp(location);
+    archive_file.write((char*)buffer, header_size);
+    archive_file.seekp(end_of_block);
+    return archive_file.good() ? location : 0;
+}
+
+
+bool solid::read_header( std::fstream& archive_file, uint64_t location, SolidHeader& header )
+{
+    uint8_t buffer[header_size];
+    archive_file.clear();
+    archive_file.seekg(location);
+    archive_file.read((char*)buffer, header_size);
+    if (archive_file.gcount() != header_size)
+    {
+        archive_file.clear();
+        return false;
+    }
+
+    header.flags = buffer[0] | (buffer[1] << 8u);
+    header.compressed_size = get_u64(buffer + 2);
+    header.original_size = get_u64(buffer + 10);
+    return true;
+}
+
+
+void solid::write_header( uint8_t* buffer, const SolidHeader& header )
+{
+    buffer[0] = header.flags & 0xFFu;
+    buffer[1] = header.flags >> 8u;
+    put_u64(buffer + 2, header.compressed_size);
+    put_u64(buffer + 10, header.original_size);
+}
+
+
+uint64_t solid::get_stored_size( const SolidHeader& header )
+{
+    if (is_chunk_list(header)) return header_size + header.compressed_size * chunk_entry_size;
+    return header_size + header.compressed_size
+         + get_checksum_length( get_checksum_type_from_flags(header.flags) )
+         + multithreading::get_block_index_size( header.flags, header.original_size );
+}
+
+
+bool solid::get_ranges( std::fstream& archive_file, const File& member, std::vector<Range>& ranges )
+{
+    ranges.clear();
+    SolidHeader header;
+    if (!read_header(archive_file, member.data_location, header)) return false;
+
+    if (!is_chunk_list(header))
+    {
+        ranges.push_back(Range{member.data_location, member.compressed_size, member.original_size});
+        return member.compressed_size + member.original_size <= header.original_size;
+    }
+
+    std::vector<uint8_t> entries(header.compressed_size * chunk_entry_size);
+    archive_file.read((char*)entries.data(), entries.size());
+    if ((uint64_t)archive_file.gcount() != entries.size())
+    {
+        archive_file.clear();
+        return false;
+    }
+
+    uint64_t total_length = 0;
+    ranges.reserve(header.compressed_size);
+    for (uint64_t i=0; i < header.compressed_size; ++i)
+    {
+        const uint8_t* entry = entries.data() + i * chunk_entry_size + 32;     // after SHA-256
+        const uint64_t length = entry[16] | (entry[17] << 8u) | (entry[18] << 16u) | ((uint64_t)entry[19] << 24u);
+        ranges.push_back(Range{get_u64(entry), get_u64(entry + 8), length});
+        total_length += length;
+    }
+    return total_length == member.original_size and header.original_size == member.original_size;
+}
+
+
+bool solid::extract( std::fstream& archive_file, const File& member, uint64_t offset, uint64_t length,
+                     std::vector<uint8_t>& destination, bool& aborting_var )
+{
+    destination.clear();
+    if (offset > member.original_size) return false;
+    length = std::min(length, member.original_size - offset);
+    if (length == 0) return true;
+
+    std::vector<Range> ranges;
+    if (!get_ranges(archive_file, member, ranges)) return false;
+
+    destination.reserve(length);
+    uint64_t range_start = 0;       // in the member
+    for (const Range& range : ranges)
+    {
+        const uint64_t range_end = range_start + range.length;
+        if (range_end > offset and range_start < offset + length)
+        {
+            const uint64_t from = std::max(offset, range_start) - range_start;
+            const uint64_t to = std::min(offset + length, range_end) - range_start;
+            if (!extract_from_block(archive_file, Range{range.block_location, range.offset + from, to - from}, destination, aborting_var))
+                return false;
+        }
+        range_start = range_end;
+        if (range_start >= offset + length or aborting_var) break;
+    }
+    return destination.size() == length;
+}
+
+
+bool solid::unpack( std::fstream& archive_file, const File& member, std::ostream& output, bool& aborting_var )
+{
+    std::vector<Range> ranges;
+    if (!get_ranges(archive_file, member, ranges)) return false;
+
+    std::vector<uint8_t> data;
+    for (const Range& range : ranges)
+    {
+        if (aborting_var) return false;
+        data.clear();
+        if (!extract_from_block(archive_file, range, data, aborting_var)) return false;
+        output.write((char*)data.data(), data.size());
+    }
+    return output.good();
+}
+
+
+void solid::clear_cache()
+{
+    std::lock_guard<std::mutex> lock(cache_mut);
+    cache.clear();
+}
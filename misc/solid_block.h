@@ -0,0 +1,86 @@
+#ifndef SOLID_BLOCK_H
+#define SOLID_BLOCK_H
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+struct File;
+
+
+// Solid mode (flag 6): small files are concatenated, sorted by extension (so similar files are next to each other),
+// and compressed as one stream, so they share blocks (16 MiB by default), block headers, tables of entropy coders,
+// and a single checksum, instead of paying for all of it file by file. Identical files in one solid block are stored once.
+// Bigger files with flag 6 are cut into chunks instead, and only chunks which aren't in archive yet
+// are put into solid blocks (see misc/dedup_store.h).
+//
+// Solid block in archive:  [flags u16][compressed size u64][original size u64], then data encoded the usual way
+//                          (blocks, checksum, block index - flags 5 and 8 are always set, so members can be decoded
+//                          separately, and every decoded block is still checked)
+// Chunk list in archive:   [flags u16][chunk count u64][original size u64], then for every chunk
+//                          [SHA-256 of chunk, 32 bytes][location of solid block u64][offset in it u64][length u32]
+//                          (flag 6 is set in flags of chunk lists, and never in flags of solid blocks)
+// Header of every member keeps flag 6, and:
+//      data_location    - location of its solid block, or of its chunk list
+//      compressed_size  - offset of the member in uncompressed stream of solid block (0 with chunk list)
+//      original_size    - size of the member
+// Block containing a member is found from its offset, and the block index.
+namespace solid
+{
+    const uint8_t flag = 6;
+    const uint32_t header_size = 18;
+    const uint32_t chunk_entry_size = 52;
+    const uint64_t small_file_limit = 1ull << 20;   // bigger files are cut into chunks
+    const uint64_t group_limit = 128ull << 20;      // uncompressed size of one solid block
+
+    struct SolidHeader
+    {
+        uint16_t flags = 0;
+        uint64_t compressed_size = 0;               // chunk count in chunk lists
+        uint64_t original_size = 0;
+    };
+
+    // Part of a member, stored in a solid block
+    struct Range
+    {
+        uint64_t block_location = 0;
+        uint64_t offset = 0;                        // in uncompressed stream of the block
+        uint64_t length = 0;
+    };
+
+    inline bool is_member( uint16_t flags ) { return (flags >> flag) & 1u; }
+    inline bool is_chunk_list( const SolidHeader& header ) { return is_member( header.flags ); }
+
+    // Splits unsaved files up to small_file_limit with flag 6 into groups, each becomes one solid block.
+    // Files which would be alone in their group lose flag 6, and are compressed as usual.
+    std::vector<std::vector<File*>> make_groups( const std::vector<File*>& files );
+
+    // Writes solid block of given files at the current position of archive_file, and sets their locations and offsets.
+    // Headers of members aren't written here (File::write_to_archive skips data of members with data_location set).
+    bool write_group( std::fstream& archive_file, const std::vector<File*>& members, bool& aborting_var );
+
+    // Compresses given data into a solid block at the current position of archive_file, returns its location (0 if it failed)
+    uint64_t write_block( std::fstream& archive_file, const uint8_t* data, uint16_t flags, uint64_t original_size, bool& aborting_var );
+
+    bool read_header( std::fstream& archive_file, uint64_t location, SolidHeader& header );
+    void write_header( uint8_t* buffer, const SolidHeader& header );   // header_size bytes
+
+    // Size of the whole solid block in archive (header, data, checksum, block index), or of the whole chunk list
+    uint64_t get_stored_size( const SolidHeader& header );
+
+    // Parts of solid blocks which make up the member, in order
+    bool get_ranges( std::fstream& archive_file, const File& member, std::vector<Range>& ranges );
+
+    // Decodes given range of a member. Decoded blocks are kept for a while, since the next member is usually in the same one
+    bool extract( std::fstream& archive_file, const File& member, uint64_t offset, uint64_t length,
+                  std::vector<uint8_t>& destination, bool& aborting_var );
+
+    // Decodes the whole member into output, range by range, so big ones don't have to fit into memory
+    bool unpack( std::fstream& archive_file, const File& member, std::ostream& output, bool& aborting_var );
+
+    // Forgets decoded blocks, has to be called when archive changes, or another one is loaded
+    void clear_cache();
+}
+
+#endif // SOLID_BLOCK_H
@@ -0,0 +1,474 @@
+#include "stream_codec.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "compression.h"
+#include "integrity_validation.h"
+#include "multithreading.h"
+
+
+namespace
+{
+    const char magic[8] = {'T','K','2','K','_','S','T','R'};
+    const uint16_t used_flags = 0x1F | (1u << 7u) | (0xFu << 9u);   // algorithms and block size
+    const uint32_t read_buffer_size = 1u << 20u;
+
+    void put_u32( uint8_t* buffer, uint32_t value )
+    {
+        for (uint8_t i=0; i < 4; i++) buffer[i] = (value >> (i*8u)) & 0xFFu;
+    }
+
+    uint32_t get_u32( const uint8_t* buffer )
+    {
+        return ((uint32_t)buffer[0]) | ((uint32_t)buffer[1]<<8u) | ((uint32_t)buffer[2]<<16u) | ((uint32_t)buffer[3]<<24u);
+    }
+
+    // Blocks in memory at once: one per thread is processed, and one per thread waits to be written
+    uint32_t get_window_size( uint32_t thread_count )
+    {
+        if (thread_count == 0) thread_count = std::thread::hardware_concurrency();
+        return thread_count == 0 ? 4 : thread_count * 2;
+    }
+
+    void start_worker( stream_codec::Job& job, multithreading::mode task, uint16_t flags, bool& aborting_var,
+                       std::atomic<bool>& corrupted_block_found )
+    {
+        job.worker = std::thread(&multithreading::processing_worker, task, job.comp, flags,
+                                 std::ref(aborting_var), &job.finished, nullptr, &job.block_checksum, &corrupted_block_found,
+                                 nullptr, 0, nullptr, 0, 0, false, nullptr);
+    }
+
+    // Stops workers which are still running, after the stream failed. aborting_var is only borrowed to stop them,
+    // so the caller can go on using it for other streams
+    void finish_jobs( std::deque<stream_codec::Job>& jobs, bool& aborting_var )
+    {
+        const bool aborted_by_caller = aborting_var;
+        aborting_var = true;
+        for (stream_codec::Job& job : jobs)
+        {
+            if (job.worker.joinable()) job.worker.join();
+            delete job.comp;
+        }
+        jobs.clear();
+        aborting_var = aborted_by_caller;
+    }
+
+    stream_codec::Sink make_sink( std::ostream& output )
+    {
+        return [&output]( const uint8_t* data, uint64_t size ) {
+            output.write((const char*)data, size);
+            return output.good();
+        };
+    }
+
+    stream_codec::Sink make_sink( std::vector<uint8_t>& output )
+    {
+        return [&output]( const uint8_t* data, uint64_t size ) {
+            output.insert(output.end(), data, data + size);
+            return true;
+        };
+    }
+}
+
+
+uint16_t stream_codec::get_stream_flags( uint16_t flags )
+{
+    // there's nothing to go back to for a checksum of the whole stream, so every block has its own
+    return (flags & used_flags) | (1u << 8u);
+}
+
+
+uint32_t stream_codec::get_block_size( uint16_t stream_flags )
+{
+    // the same block size as files bigger than one block get
+    uint32_t block_size, block_count;
+    multithreading::get_block_layout(stream_flags, 1ull << 40u, block_size, block_count);
+    return block_size;
+}
+
+
+uint64_t stream_codec::get_max_stored_size( uint32_t block_size )
+{
+    // stored block can be bigger than the original one (e.g. by table of AC2), but not by much
+    return 2ull * block_size + (1u << 20u);
+}
+
+
+void stream_codec::write_header( uint8_t* buffer, uint16_t stream_flags )
+{
+    memcpy(buffer, magic, 8);
+    buffer[8] = stream_flags & 0xFFu;
+    buffer[9] = stream_flags >> 8u;
+    put_u32(buffer + 10, get_block_size(stream_flags));
+}
+
+
+bool stream_codec::is_stream( const uint8_t* buffer )
+{
+    return memcmp(buffer, magic, 8) == 0;
+}
+
+
+bool stream_codec::read_header( const uint8_t* buffer, uint16_t& stream_flags, uint32_t& block_size )
+{
+    if (!is_stream(buffer)) return false;
+    stream_flags = buffer[8] | (buffer[9] << 8u);
+    block_size = get_u32(buffer + 10);
+    return (stream_flags & ~used_flags) == (1u << 8u) and block_size == get_block_size(stream_flags);
+}
+
+
+void stream_codec::write_frame( uint8_t* buffer, const Frame& frame )
+{
+    put_u32(buffer, frame.part_id);
+    put_u32(buffer + 4, frame.original_size);
+    put_u32(buffer + 8, frame.stored_size);
+    put_u32(buffer + 12, frame.block_checksum);
+    put_u32(buffer + 16, frame.stored_checksum);
+}
+
+
+stream_codec::Frame stream_codec::read_frame( const uint8_t* buffer )
+{
+    return Frame{get_u32(buffer), get_u32(buffer + 4), get_u32(buffer + 8), get_u32(buffer + 12), get_u32(buffer + 16)};
+}
+
+
+bool stream_codec::is_end( const Frame& frame, uint32_t next_part )
+{
+    return frame.part_id == next_part and frame.original_size == 0 and frame.stored_size == 0;
+}
+
+
+bool stream_codec::is_valid( const Frame& frame, uint32_t next_part, uint32_t block_size )
+{
+    return frame.part_id == next_part and frame.original_size != 0 and frame.original_size <= block_size
+           and frame.stored_size != 0 and frame.stored_size <= get_max_stored_size(block_size);
+}
+
+
+void stream_codec::write_end( uint8_t* buffer, uint32_t block_count, uint64_t total_size )
+{
+    memset(buffer, 0, end_size);
+    put_u32(buffer, block_count);
+    put_u32(buffer + frame_header_size, total_size & 0xFFFFFFFFu);
+    put_u32(buffer + frame_header_size + 4, total_size >> 32u);
+}
+
+
+uint64_t stream_codec::read_total_size( const uint8_t* end )
+{
+    return get_u32(end) | ((uint64_t)get_u32(end + 4) << 32u);
+}
+
+
+stream_codec::Encoder::Encoder( uint16_t flags, Sink sink, bool& aborting_var, uint32_t thread_count ) :
+        flags(get_stream_flags(flags))
+        , block_size(get_block_size(this->flags))
+        , window_size(get_window_size(thread_count))
+        , sink(std::move(sink))
+        , aborting_var(aborting_var)
+{
+    uint8_t header[header_size];
+    write_header(header, this->flags);
+    if (!this->sink(header, header_size)) fail("output couldn't be written");
+}
+
+
+stream_codec::Encoder::~Encoder()
+{
+    if (!jobs.empty()) stop();
+    delete[] block;
+}
+
+
+bool stream_codec::Encoder::write( const uint8_t* data, uint64_t size )
+{
+    if (finished) return false;
+    while (size > 0 and successful and !aborting_var)
+    {
+        if (block == nullptr) block = new uint8_t[block_size];
+        const uint32_t piece = std::min<uint64_t>(size, block_size - block_filled);
+        memcpy(block + block_filled, data, piece);
+        block_filled += piece;
+        data += piece;
+        size -= piece;
+        if (block_filled == block_size) start_block();
+    }
+    return successful and !aborting_var;
+}
+
+
+bool stream_codec::Encoder::finish()
+{
+    if (finished) return successful;
+    finished = true;
+
+    if (successful and block_filled > 0) start_block();
+    while (successful and !aborting_var and !jobs.empty()) write_first_block();
+
+    if (!successful or aborting_var)
+    {
+        fail("stream couldn't be compressed");
+        stop();
+        return false;
+    }
+
+    uint8_t end[end_size];
+    write_end(end, next_part, total_size);
+    if (!sink(end, sizeof(end))) fail("output couldn't be written");
+    return successful;
+}
+
+
+void stream_codec::Encoder::start_block()
+{
+    // next blocks are read while the ones before them are compressed
+    while (successful and jobs.size() >= window_size) write_first_block();
+    if (!successful) return;
+
+    Job& job = jobs.emplace_back();
+    job.comp = new Compression(aborting_var);
+    job.comp->replace_text(block);
+    job.comp->size = block_filled;
+    job.comp->part_id = next_part++;
+    job.original_size = block_filled;
+    total_size += block_filled;
+    block = nullptr;
+    block_filled = 0;
+    start_worker(job, multithreading::mode::compress, flags, aborting_var, corrupted_block_found);
+}
+
+
+void stream_codec::Encoder::write_first_block()
+{
+    Job& job = jobs.front();
+    job.worker.join();
+    uint8_t frame_header[frame_header_size];
+    write_frame(frame_header, Frame{job.comp->part_id, job.original_size, job.comp->size, job.block_checksum,
+                                    calculate_CRC32C(job.comp->text, job.comp->size)});
+    if (!aborting_var and !(sink(frame_header, frame_header_size) and sink(job.comp->text, job.comp->size)))
+        fail("output couldn't be written");
+    successful = successful and !aborting_var;
+    delete job.comp;
+    jobs.pop_front();
+}
+
+
+void stream_codec::Encoder::fail( const std::string& reason )
+{
+    if (error.empty()) error = reason;
+    successful = false;
+}
+
+
+void stream_codec::Encoder::stop()
+{
+    successful = false;
+    finish_jobs(jobs, aborting_var);
+}
+
+
+stream_codec::Decoder::Decoder( Sink sink, bool& aborting_var, uint32_t thread_count ) :
+        window_size(get_window_size(thread_count))
+        , sink(std::move(sink))
+        , aborting_var(aborting_var) {}
+
+
+stream_codec::Decoder::~Decoder()
+{
+    if (!jobs.empty()) stop();
+    delete[] payload;
+}
+
+
+uint64_t stream_codec::Decoder::get_needed_size() const
+{
+    if (!successful or state == State::done) return 0;
+    return needed - filled;
+}
+
+
+bool stream_codec::Decoder::write( const uint8_t* data, uint64_t size )
+{
+    while (size > 0 and successful and !aborting_var and state != State::done)
+    {
+        uint8_t* destination = state == State::payload ? payload : frame;
+        const uint64_t piece = std::min(size, needed - filled);
+        memcpy(destination + filled, data, piece);
+        filled += piece;
+        data += piece;
+        size -= piece;
+        if (filled == needed) handle_piece();
+    }
+    if (size > 0 and successful and state == State::done) fail("there's data after the end of stream");
+    return successful and !aborting_var;
+}
+
+
+bool stream_codec::Decoder::finish()
+{
+    if (state != State::done or !successful or aborting_var)
+    {
+        if (state != State::done) fail("stream is damaged or cut off after block " + std::to_string(next_part));
+        else fail("stream couldn't be decompressed");
+        stop();
+        return false;
+    }
+    return true;
+}
+
+
+void stream_codec::Decoder::handle_piece()
+{
+    filled = 0;
+    if (state == State::header)
+    {
+        if (!read_header(frame, flags, block_size))
+            fail(is_stream(frame) ? "header of the stream is damaged" : "input isn't a tk2k stream");
+        state = State::frame;
+        needed = frame_header_size;
+    }
+    else if (state == State::frame)
+    {
+        current = read_frame(frame);
+        if (is_end(current, next_part))
+        {
+            state = State::end;
+            needed = 8;
+            return;
+        }
+
+        if (!is_valid(current, next_part, block_size))
+        {
+            fail("header of block " + std::to_string(next_part) + " is damaged");
+            return;
+        }
+        payload = new uint8_t[current.stored_size];
+        state = State::payload;
+        needed = current.stored_size;
+    }
+    else if (state == State::payload)
+    {
+        if (calculate_CRC32C(payload, needed) != current.stored_checksum)
+        {
+            fail("block " + std::to_string(next_part) + " is damaged");
+            return;
+        }
+        while (successful and jobs.size() >= window_size) write_first_block();
+        if (!successful) return;
+
+        Job& job = jobs.emplace_back();
+        job.comp = new Compression(aborting_var);
+        job.comp->replace_text(payload);
+        job.comp->size = needed;
+        job.comp->part_id = next_part++;
+        job.comp->block_checksum = current.block_checksum;
+        job.original_size = current.original_size;
+        total_size += job.original_size;
+        payload = nullptr;
+        start_worker(job, multithreading::mode::decompress, flags, aborting_var, corrupted_block_found);
+
+        state = State::frame;
+        needed = frame_header_size;
+    }
+    else if (state == State::end)
+    {
+        if (read_total_size(frame) != total_size) fail("size at the end of stream doesn't match its blocks");
+        while (successful and !aborting_var and !jobs.empty()) write_first_block();
+        state = State::done;
+        needed = 0;
+    }
+}
+
+
+void stream_codec::Decoder::write_first_block()
+{
+    // blocks are written in order, and only after their CRC-32C was checked
+    Job& job = jobs.front();
+    job.worker.join();
+    if (corrupted_block_found) fail("block " + std::to_string(job.comp->part_id) + " is corrupted");
+    else if (job.comp->size != job.original_size)
+        fail("block " + std::to_string(job.comp->part_id) + " has wrong size after decoding");
+    else if (!aborting_var and !sink(job.comp->text, job.comp->size)) fail("output couldn't be written");
+    successful = successful and !aborting_var;
+    delete job.comp;
+    jobs.pop_front();
+}
+
+
+void stream_codec::Decoder::fail( const std::string& reason )
+{
+    if (error.empty()) error = reason;
+    successful = false;
+}
+
+
+void stream_codec::Decoder::stop()
+{
+    successful = false;
+    finish_jobs(jobs, aborting_var);
+}
+
+
+bool stream_codec::compress( std::istream& input, std::ostream& output, uint16_t flags, bool& aborting_var, std::string* error )
+{
+    Encoder encoder(flags, make_sink(output), aborting_var);
+    std::vector<uint8_t> buffer(read_buffer_size);
+    while (!aborting_var and input.good())
+    {
+        input.read((char*)buffer.data(), buffer.size());
+        if (!encoder.write(buffer.data(), input.gcount())) break;
+    }
+    if (input.bad())
+    {
+        if (error != nullptr) *error = "input couldn't be read";
+        return false;
+    }
+    const bool successful = encoder.finish();
+    output.flush();
+    if (error != nullptr) *error = encoder.get_error();
+    return successful and output.good();
+}
+
+
+bool stream_codec::decompress( std::istream& input, std::ostream& output, bool& aborting_var, std::string* error )
+{
+    Decoder decoder(make_sink(output), aborting_var);
+    std::vector<uint8_t> buffer(read_buffer_size);
+
+    // only as much as the stream needs is read, so whatever follows it stays in input
+    while (!aborting_var and decoder.get_needed_size() > 0)
+    {
+        input.read((char*)buffer.data(), std::min<uint64_t>(decoder.get_needed_size(), buffer.size()));
+        if (input.gcount() == 0 or !decoder.write(buffer.data(), input.gcount())) break;
+    }
+    const bool successful = decoder.finish();
+    output.flush();
+    if (error != nullptr) *error = decoder.get_error();
+    return successful and output.good();
+}
+
+
+bool stream_codec::compress( std::span<const uint8_t> input, std::vector<uint8_t>& output, uint16_t flags, bool& aborting_var,
+                             std::string* error )
+{
+    output.clear();
+    Encoder encoder(flags, make_sink(output), aborting_var);
+    const bool successful = encoder.write(input.data(), input.size()) and encoder.finish();
+    if (error != nullptr) *error = encoder.get_error();
+    return successful;
+}
+
+
+bool stream_codec::decompress( std::span<const uint8_t> input, std::vector<uint8_t>& output, bool& aborting_var,
+                               std::string* error )
+{
+    output.clear();
+    Decoder decoder(make_sink(output), aborting_var);
+    const bool written = decoder.write(input.data(), input.size());
+    const bool successful = decoder.finish() and written;
+    if (error != nullptr) *error = decoder.get_error();
+    return successful;
+}
@@ -0,0 +1,173 @@
+#ifndef STREAM_CODEC_H
+#define STREAM_CODEC_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Compression;
+
+
+// Compression of data which can only be read once, from beginning to end (e.g. stdin of "pg_dump | tk2k | ssh ..."),
+// so its size isn't known up front, and nothing can be written back. Blocks are read one after another,
+// compressed on all threads, and written in order, each with its own size and CRC-32C, so the stream ends itself
+// and can be decoded the same way, without seeking. Only a few blocks per thread are in memory at once.
+//
+// Layout:
+//   header:  [magic "TK2K_STR"][flags u16][block size u32]
+//   blocks:  [part number u32][original size u32][stored size u32][CRC-32C of original block u32]
+//            [CRC-32C of stored block u32][stored block]
+//   end:     [block count u32][0 u32][0 u32][0 u32][0 u32][total original size u64]
+//
+// Flags are the same as flags of files, but only algorithms (0-4, 7) and block size (9-12) are used,
+// and flag 8 (CRC-32C of every block) is always set. Stored block is checked too, before it's decoded,
+// since streams often go through networks, and decoders aren't made for damaged input. Nothing after the end
+// is read by decompress().
+//
+// The same format is used in memory (messages, cache entries): Encoder and Decoder take data in pieces of any size,
+// and give their output to a sink, so nothing touches the filesystem.
+namespace stream_codec
+{
+    const uint32_t header_size = 14;
+    const uint32_t frame_header_size = 20;
+    const uint32_t end_size = frame_header_size + 8;
+
+    // Header of every block
+    struct Frame
+    {
+        uint32_t part_id = 0;
+        uint32_t original_size = 0;     // 0 (with stored_size 0) at the end
+        uint32_t stored_size = 0;
+        uint32_t block_checksum = 0;    // CRC-32C of original block
+        uint32_t stored_checksum = 0;   // CRC-32C of stored block
+    };
+
+    // Parts of the format, for codecs which keep their own buffers (see tk2k.h)
+    uint16_t get_stream_flags( uint16_t flags );    // flags which are stored, out of flags of a file
+    uint32_t get_block_size( uint16_t stream_flags );
+    uint64_t get_max_stored_size( uint32_t block_size );
+    void write_header( uint8_t* buffer, uint16_t stream_flags );
+    bool is_stream( const uint8_t* buffer );        // only checks the magic of header
+    bool read_header( const uint8_t* buffer, uint16_t& stream_flags, uint32_t& block_size );   // false if it's damaged
+    void write_frame( uint8_t* buffer, const Frame& frame );
+    Frame read_frame( const uint8_t* buffer );
+    bool is_end( const Frame& frame, uint32_t next_part );
+    bool is_valid( const Frame& frame, uint32_t next_part, uint32_t block_size );     // for frames of blocks
+    void write_end( uint8_t* buffer, uint32_t block_count, uint64_t total_size );
+    uint64_t read_total_size( const uint8_t* end );     // the last 8 bytes of end
+
+    // Gets output in order, in pieces. Returning false stops encoding (or decoding).
+    using Sink = std::function<bool( const uint8_t* data, uint64_t size )>;
+
+    // Block being processed by its own worker, in the order of the stream
+    struct Job
+    {
+        Compression* comp = nullptr;
+        std::thread worker;
+        bool finished = false;
+        uint32_t original_size = 0;
+        uint32_t block_checksum = 0;
+    };
+
+    // Every full block is compressed on its own thread as soon as it's written, write() waits only
+    // when 2 blocks per thread are in memory already. If anything fails, aborting_var is set until workers stop,
+    // and then given back its value, so it only tells whether the caller cancelled.
+    // Nothing is printed, get_error() tells what went wrong.
+    class Encoder
+    {
+    public:
+        Encoder( uint16_t flags, Sink sink, bool& aborting_var, uint32_t thread_count = 0 );  // 0 - number of cores
+        ~Encoder();     // stops workers, if finish() wasn't called
+        Encoder( const Encoder& ) = delete;
+        Encoder& operator=( const Encoder& ) = delete;
+
+        bool write( const uint8_t* data, uint64_t size );
+        bool finish();  // compresses what's left, and ends the stream
+        const std::string& get_error() const { return error; }     // empty, if nothing failed
+
+    private:
+        void start_block();
+        void write_first_block();
+        void stop();
+        void fail( const std::string& reason );
+
+        uint16_t flags;
+        uint32_t block_size;
+        uint32_t window_size;
+        Sink sink;
+        bool& aborting_var;
+        std::deque<Job> jobs;
+        std::atomic<bool> corrupted_block_found = false;
+        uint8_t* block = nullptr;       // filled until it's full
+        uint32_t block_filled = 0;
+        uint32_t next_part = 0;
+        uint64_t total_size = 0;
+        bool successful = true;
+        bool finished = false;
+        std::string error;
+    };
+
+    // Decoded blocks go to sink in order, only after their CRC-32C was checked. Data after the end of stream
+    // isn't accepted, get_needed_size() tells how much can be written without going past the end.
+    class Decoder
+    {
+    public:
+        explicit Decoder( Sink sink, bool& aborting_var, uint32_t thread_count = 0 );
+        ~Decoder();
+        Decoder( const Decoder& ) = delete;
+        Decoder& operator=( const Decoder& ) = delete;
+
+        bool write( const uint8_t* data, uint64_t size );
+        bool finish();  // decodes what's left, false if the stream isn't complete
+        uint64_t get_needed_size() const;   // bytes of the next part of stream (header, block...), 0 after the end
+        const std::string& get_error() const { return error; }     // empty, if nothing failed
+
+    private:
+        enum class State { header, frame, payload, end, done };
+
+        void handle_piece();
+        void write_first_block();
+        void stop();
+        void fail( const std::string& reason );
+
+        uint16_t flags = 0;
+        uint32_t block_size = 0;
+        uint32_t window_size;
+        Sink sink;
+        bool& aborting_var;
+        std::deque<Job> jobs;
+        std::atomic<bool> corrupted_block_found = false;
+        State state = State::header;
+        uint8_t frame[frame_header_size];   // header of stream, of the current block, or total size at the end
+        Frame current;
+        uint8_t* payload = nullptr;
+        uint64_t needed = header_size;
+        uint64_t filled = 0;
+        uint32_t next_part = 0;
+        uint64_t total_size = 0;
+        bool successful = true;
+        std::string error;
+    };
+
+    // If given, error gets the reason of failure (see get_error() of Encoder and Decoder)
+    bool compress( std::istream& input, std::ostream& output, uint16_t flags, bool& aborting_var,
+                   std::string* error = nullptr );
+
+    bool decompress( std::istream& input, std::ostream& output, bool& aborting_var, std::string* error = nullptr );
+
+    // Whole buffer at once, output is replaced
+    bool compress( std::span<const uint8_t> input, std::vector<uint8_t>& output, uint16_t flags, bool& aborting_var,
+                   std::string* error = nullptr );
+
+    bool decompress( std::span<const uint8_t> input, std::vector<uint8_t>& output, bool& aborting_var,
+                     std::string* error = nullptr );
+}
+
+#endif // STREAM_CODEC_H
@@ -0,0 +1,54 @@
+#include "worker_pool.h"
+
+
+WorkerPool::WorkerPool( uint32_t thread_count, uint32_t capacity ) :
+        queue(capacity == 0 ? 1 : capacity)
+{
+    if (thread_count == 0) thread_count = std::thread::hardware_concurrency();
+    if (thread_count == 0) thread_count = 2;
+    threads.reserve(thread_count);
+    for (uint32_t i=0; i < thread_count; ++i) threads.emplace_back(&WorkerPool::work, this);
+}
+
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        stopping = true;
+    }
+    cond.notify_all();
+    for (std::thread& thread : threads) thread.join();
+}
+
+
+bool WorkerPool::submit( Task task, void* argument )
+{
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        if (queued == queue.size() or stopping) return false;
+        queue[(first + queued) % queue.size()] = {task, argument};
+        queued++;
+    }
+    cond.notify_one();
+    return true;
+}
+
+
+void WorkerPool::work()
+{
+    std::unique_lock<std::mutex> lock(mut);
+    while (true)
+    {
+        cond.wait(lock, [this]() { return queued > 0 or stopping; });
+        if (queued == 0) return;    // stopping, and nothing is left
+
+        const auto [task, argument] = queue[first];
+        first = (first + 1) % queue.size();
+        queued--;
+
+        lock.unlock();
+        task(argument);
+        lock.lock();
+    }
+}
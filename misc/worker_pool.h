@@ -0,0 +1,39 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Threads which are started once, and then run tasks one after another, so a block doesn't need its own thread.
+// Tasks are plain function pointers with an argument, and the queue has fixed capacity,
+// so nothing is allocated after the pool is made.
+class WorkerPool
+{
+public:
+    using Task = void (*)( void* argument );
+
+    WorkerPool( uint32_t thread_count, uint32_t capacity );    // thread_count 0 - number of cores
+    ~WorkerPool();     // waits for tasks which are already queued
+    WorkerPool( const WorkerPool& ) = delete;
+    WorkerPool& operator=( const WorkerPool& ) = delete;
+
+    bool submit( Task task, void* argument );   // false if capacity tasks are queued already
+    uint32_t get_thread_count() const { return threads.size(); }
+
+private:
+    void work();
+
+    std::vector<std::thread> threads;
+    std::vector<std::pair<Task, void*>> queue;  // ring
+    uint32_t first = 0;
+    uint32_t queued = 0;
+    bool stopping = false;
+    std::mutex mut;
+    std::condition_variable cond;
+};
+
+#endif // WORKER_POOL_H
@@ -0,0 +1,366 @@
+#include "xxh3.h"
+
+#include <cstring>
+#include <bit>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define XXH3_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+
+namespace
+{
+// based on the XXH3 specification and reference implementation: https://github.com/Cyan4973/xxHash
+
+const uint32_t PRIME32_1 = 0x9E3779B1U;
+const uint32_t PRIME32_2 = 0x85EBCA77U;
+const uint32_t PRIME32_3 = 0xC2B2AE3DU;
+const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+const uint64_t PRIME_MX1 = 0x165667919E3779F9ULL;
+const uint64_t PRIME_MX2 = 0x9FB21C651E98DF25ULL;
+
+const uint32_t STRIPE_SIZE = 64;
+const uint32_t SECRET_SIZE = 192;
+const uint32_t STRIPES_PER_BLOCK = (SECRET_SIZE - STRIPE_SIZE) / 8;     // 16 stripes, 1 KiB
+const uint32_t MIDSIZE_MAX = 240;
+
+alignas(64) const uint8_t default_secret[SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+
+// all multi-byte values are read as little endian
+inline uint32_t read32( const uint8_t* bytes )
+{
+    uint32_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    if constexpr (std::endian::native == std::endian::big) value = __builtin_bswap32(value);
+    return value;
+}
+
+
+inline uint64_t read64( const uint8_t* bytes )
+{
+    uint64_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    if constexpr (std::endian::native == std::endian::big) value = __builtin_bswap64(value);
+    return value;
+}
+
+
+inline uint64_t mul128_fold64( uint64_t lhs, uint64_t rhs )
+{
+    unsigned __int128 product = (unsigned __int128)lhs * rhs;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+
+inline uint64_t XXH64_avalanche( uint64_t h )
+{
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+
+inline uint64_t XXH3_avalanche( uint64_t h )
+{
+    h ^= h >> 37;
+    h *= PRIME_MX1;
+    h ^= h >> 32;
+    return h;
+}
+
+
+inline uint64_t rrmxmx( uint64_t h, uint64_t size )
+{
+    h ^= std::rotl(h, 49) ^ std::rotl(h, 24);
+    h *= PRIME_MX2;
+    h ^= (h >> 35) + size;
+    h *= PRIME_MX2;
+    return h ^ (h >> 28);
+}
+
+
+inline uint64_t mix16B( const uint8_t* data, const uint8_t* secret )
+{
+    return mul128_fold64(read64(data) ^ read64(secret), read64(data + 8) ^ read64(secret + 8));
+}
+
+
+// Hash of up to 240 bytes, which doesn't use stripes at all
+uint64_t hash_short( const uint8_t* data, uint64_t size )
+{
+    const uint8_t* secret = default_secret;
+
+    if (size == 0)
+        return XXH64_avalanche(read64(secret + 56) ^ read64(secret + 64));
+
+    if (size <= 3)
+    {
+        uint32_t combined = ((uint32_t)data[0] << 16) | ((uint32_t)data[size >> 1] << 24) | (uint32_t)data[size - 1] | ((uint32_t)size << 8);
+        uint64_t bitflip = read32(secret) ^ read32(secret + 4);
+        return XXH64_avalanche((uint64_t)combined ^ bitflip);
+    }
+
+    if (size <= 8)
+    {
+        uint64_t bitflip = read64(secret + 8) ^ read64(secret + 16);
+        uint64_t input64 = read32(data + size - 4) + ((uint64_t)read32(data) << 32);
+        return rrmxmx(input64 ^ bitflip, size);
+    }
+
+    if (size <= 16)
+    {
+        uint64_t bitflip1 = read64(secret + 24) ^ read64(secret + 32);
+        uint64_t bitflip2 = read64(secret + 40) ^ read64(secret + 48);
+        uint64_t input_lo = read64(data) ^ bitflip1;
+        uint64_t input_hi = read64(data + size - 8) ^ bitflip2;
+        uint64_t acc = size + __builtin_bswap64(input_lo) + input_hi + mul128_fold64(input_lo, input_hi);
+        return XXH3_avalanche(acc);
+    }
+
+    uint64_t acc = size * PRIME64_1;
+    if (size <= 128)
+    {
+        if (size > 32) {
+            if (size > 64) {
+                if (size > 96) {
+                    acc += mix16B(data + 48, secret + 96);
+                    acc += mix16B(data + size - 64, secret + 112);
+                }
+                acc += mix16B(data + 32, secret + 64);
+                acc += mix16B(data + size - 48, secret + 80);
+            }
+            acc += mix16B(data + 16, secret + 32);
+            acc += mix16B(data + size - 32, secret + 48);
+        }
+        acc += mix16B(data, secret);
+        acc += mix16B(data + size - 16, secret + 16);
+        return XXH3_avalanche(acc);
+    }
+
+    // 129-240 bytes
+    const uint32_t rounds = size / 16;
+    for (uint32_t i = 0; i < 8; ++i) acc += mix16B(data + 16*i, secret + 16*i);
+    acc = XXH3_avalanche(acc);
+    for (uint32_t i = 8; i < rounds; ++i) acc += mix16B(data + 16*i, secret + 16*(i - 8) + 3);
+    acc += mix16B(data + size - 16, secret + 136 - 17);
+    return XXH3_avalanche(acc);
+}
+
+
+// Accumulates stripe_count stripes of 64 bytes, scrambling accumulators after every 16 of them
+using AccumulateFunction = void (*)( uint64_t acc[8], const uint8_t* data, uint64_t stripe_count, uint32_t& stripes_in_block );
+
+
+inline void accumulate_stripe_portable( uint64_t acc[8], const uint8_t* stripe, const uint8_t* secret )
+{
+    for (uint8_t i = 0; i < 8; ++i)
+    {
+        uint64_t data_value = read64(stripe + 8*i);
+        uint64_t data_key = data_value ^ read64(secret + 8*i);
+        acc[i ^ 1] += data_value;
+        acc[i] += (data_key & 0xFFFFFFFF) * (data_key >> 32);
+    }
+}
+
+
+inline void scramble_portable( uint64_t acc[8], const uint8_t* secret )
+{
+    for (uint8_t i = 0; i < 8; ++i)
+    {
+        uint64_t value = acc[i];
+        value ^= value >> 47;
+        value ^= read64(secret + 8*i);
+        value *= PRIME32_1;
+        acc[i] = value;
+    }
+}
+
+
+void accumulate_portable( uint64_t acc[8], const uint8_t* data, uint64_t stripe_count, uint32_t& stripes_in_block )
+{
+    for (uint64_t i = 0; i < stripe_count; ++i, data += STRIPE_SIZE)
+    {
+        accumulate_stripe_portable(acc, data, default_secret + 8*stripes_in_block);
+        if (++stripes_in_block == STRIPES_PER_BLOCK)
+        {
+            scramble_portable(acc, default_secret + SECRET_SIZE - STRIPE_SIZE);
+            stripes_in_block = 0;
+        }
+    }
+}
+
+
+#ifdef XXH3_X86_KERNELS
+__attribute__((target("avx2")))
+void accumulate_AVX2( uint64_t acc[8], const uint8_t* data, uint64_t stripe_count, uint32_t& stripes_in_block )
+{
+    // every stripe is 2 x 256 bits, the same operations as in accumulate_stripe_portable and scramble_portable
+    __m256i acc_vec[2] = { _mm256_loadu_si256((const __m256i*)acc), _mm256_loadu_si256((const __m256i*)(acc + 4)) };
+    const __m256i prime32 = _mm256_set1_epi32((int)PRIME32_1);
+
+    for (uint64_t i = 0; i < stripe_count; ++i, data += STRIPE_SIZE)
+    {
+        const uint8_t* secret = default_secret + 8*stripes_in_block;
+        for (uint8_t j = 0; j < 2; ++j)
+        {
+            __m256i data_vec = _mm256_loadu_si256((const __m256i*)(data + 32*j));
+            __m256i data_key = _mm256_xor_si256(data_vec, _mm256_loadu_si256((const __m256i*)(secret + 32*j)));
+            __m256i data_key_hi = _mm256_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1));
+            __m256i product = _mm256_mul_epu32(data_key, data_key_hi);
+            __m256i data_swap = _mm256_shuffle_epi32(data_vec, _MM_SHUFFLE(1, 0, 3, 2));
+            acc_vec[j] = _mm256_add_epi64(product, _mm256_add_epi64(acc_vec[j], data_swap));
+        }
+
+        if (++stripes_in_block == STRIPES_PER_BLOCK)
+        {
+            const uint8_t* scramble_secret = default_secret + SECRET_SIZE - STRIPE_SIZE;
+            for (uint8_t j = 0; j < 2; ++j)
+            {
+                __m256i value = _mm256_xor_si256(acc_vec[j], _mm256_srli_epi64(acc_vec[j], 47));
+                value = _mm256_xor_si256(value, _mm256_loadu_si256((const __m256i*)(scramble_secret + 32*j)));
+                __m256i value_hi = _mm256_shuffle_epi32(value, _MM_SHUFFLE(0, 3, 0, 1));
+                __m256i product_lo = _mm256_mul_epu32(value, prime32);
+                __m256i product_hi = _mm256_mul_epu32(value_hi, prime32);
+                acc_vec[j] = _mm256_add_epi64(product_lo, _mm256_slli_epi64(product_hi, 32));
+            }
+            stripes_in_block = 0;
+        }
+    }
+
+    _mm256_storeu_si256((__m256i*)acc, acc_vec[0]);
+    _mm256_storeu_si256((__m256i*)(acc + 4), acc_vec[1]);
+}
+#endif
+
+
+void accumulate( uint64_t acc[8], const uint8_t* data, uint64_t stripe_count, uint32_t& stripes_in_block )
+{
+    static const AccumulateFunction implementation = []() -> AccumulateFunction {
+#ifdef XXH3_X86_KERNELS
+        if (__builtin_cpu_supports("avx2")) return &accumulate_AVX2;
+#endif
+        return &accumulate_portable;
+    }();
+    implementation(acc, data, stripe_count, stripes_in_block);
+}
+
+
+void init_accumulators( uint64_t acc[8] )
+{
+    const uint64_t initial[8] = { PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1 };
+    std::memcpy(acc, initial, sizeof(initial));
+}
+
+
+// Accumulates the last stripe (which may overlap with already accumulated data) and merges accumulators into result
+uint64_t finish_long( uint64_t acc[8], const uint8_t* last_stripe, uint64_t total_size )
+{
+    accumulate_stripe_portable(acc, last_stripe, default_secret + SECRET_SIZE - STRIPE_SIZE - 7);
+
+    uint64_t result = total_size * PRIME64_1;
+    for (uint8_t i = 0; i < 4; ++i)
+        result += mul128_fold64(acc[2*i] ^ read64(default_secret + 11 + 16*i), acc[2*i + 1] ^ read64(default_secret + 11 + 16*i + 8));
+    return XXH3_avalanche(result);
+}
+}
+
+
+uint64_t xxh3::XXH3_64( const uint8_t* data, uint64_t data_size )
+{
+    if (data_size <= MIDSIZE_MAX) return hash_short(data, data_size);
+
+    uint64_t acc[8];
+    init_accumulators(acc);
+    uint32_t stripes_in_block = 0;
+
+    // every stripe but the last one, which is always the last 64 bytes
+    accumulate(acc, data, (data_size - 1) / STRIPE_SIZE, stripes_in_block);
+    return finish_long(acc, data + data_size - STRIPE_SIZE, data_size);
+}
+
+
+xxh3::XXH3_64_state::XXH3_64_state()
+{
+    init_accumulators(acc);
+}
+
+
+void xxh3::XXH3_64_state::update( const uint8_t* data, uint64_t data_size )
+{
+    total_size += data_size;
+
+    // data is accumulated only if there's something after it, so at least 1 byte always stays in buffer
+    if (buffer_size + data_size <= sizeof(buffer))
+    {
+        std::memcpy(buffer + buffer_size, data, data_size);
+        buffer_size += data_size;
+        return;
+    }
+
+    if (buffer_size != 0)
+    {
+        uint32_t copied = sizeof(buffer) - buffer_size;
+        std::memcpy(buffer + buffer_size, data, copied);
+        data += copied;
+        data_size -= copied;
+        accumulate(acc, buffer, sizeof(buffer) / STRIPE_SIZE, stripes_in_block);
+        std::memcpy(last_stripe, buffer + sizeof(buffer) - STRIPE_SIZE, STRIPE_SIZE);
+        buffer_size = 0;
+    }
+
+    if (data_size > sizeof(buffer))
+    {
+        uint64_t stripes = (data_size - 1) / STRIPE_SIZE;
+        accumulate(acc, data, stripes, stripes_in_block);
+        data += stripes * STRIPE_SIZE;
+        data_size -= stripes * STRIPE_SIZE;
+        std::memcpy(last_stripe, data - STRIPE_SIZE, STRIPE_SIZE);
+    }
+
+    std::memcpy(buffer, data, data_size);
+    buffer_size = data_size;
+}
+
+
+uint64_t xxh3::XXH3_64_state::digest() const
+{
+    if (total_size <= MIDSIZE_MAX) return hash_short(buffer, total_size);
+
+    uint64_t acc_copy[8];
+    std::memcpy(acc_copy, acc, sizeof(acc_copy));
+    uint32_t stripes_in_block_copy = stripes_in_block;
+
+    if (buffer_size >= STRIPE_SIZE)
+    {
+        accumulate(acc_copy, buffer, (buffer_size - 1) / STRIPE_SIZE, stripes_in_block_copy);
+        return finish_long(acc_copy, buffer + buffer_size - STRIPE_SIZE, total_size);
+    }
+
+    // the last stripe is made of already accumulated data and buffer
+    uint8_t stripe[STRIPE_SIZE];
+    std::memcpy(stripe, last_stripe + buffer_size, STRIPE_SIZE - buffer_size);
+    std::memcpy(stripe + STRIPE_SIZE - buffer_size, buffer, buffer_size);
+    return finish_long(acc_copy, stripe, total_size);
+}
@@ -0,0 +1,36 @@
+#ifndef XXH3_H
+#define XXH3_H
+
+#include <cstdint>
+
+
+// XXH3, 64-bit variant with default secret and seed 0 (the same values as "xxhsum -H3").
+// Non-cryptographic, so it only detects accidental corruption, but it runs at memory bandwidth.
+//
+// Implementation is chosen at runtime: AVX2 if CPU supports it, portable one otherwise.
+namespace xxh3
+{
+    uint64_t XXH3_64( const uint8_t* data, uint64_t data_size );
+
+
+    // The same hash, calculated from data given in consecutive parts
+    class XXH3_64_state
+    {
+    public:
+        XXH3_64_state();
+        void update( const uint8_t* data, uint64_t data_size );
+        uint64_t digest() const;
+
+    private:
+        uint64_t acc[8];
+        uint32_t stripes_in_block = 0;      // stripes accumulated since last scramble
+        uint64_t total_size = 0;
+
+        // last bytes are always kept here, since the last stripe is processed differently
+        uint8_t buffer[256];
+        uint32_t buffer_size = 0;
+        uint8_t last_stripe[64];            // last 64 bytes already accumulated
+    };
+}
+
+#endif // XXH3_H
@@ -152,19 +152,30 @@ uint16_t ProcessingDialog::get_flags() {
     }
 
     switch (ui->comboBox_checksum->currentIndex()) {
-    case 0:     // SHA-1
-        flags[15] = true;
+    case 0:     // CRC-32
+        flags |= get_flags_from_checksum_type(ChecksumType::CRC32);
         break;
 
-    case 1:     // CRC-32
-        flags[14] = true;
+    case 1:     // SHA-1
+        flags |= get_flags_from_checksum_type(ChecksumType::SHA1);
         break;
 
     case 2:     // SHA-256
-        flags[13] = true;
+        flags |= get_flags_from_checksum_type(ChecksumType::SHA256);
+        break;
+
+    case 3:     // CRC-32C
+        flags |= get_flags_from_checksum_type(ChecksumType::CRC32C);
+        break;
+
+    case 4:     // XXH3
+        flags |= get_flags_from_checksum_type(ChecksumType::XXH3);
         break;
     }
 
+    flags[8] = ui->checkBox_block_checksums->isChecked();   // CRC-32C of every block
+    flags[6] = ui->checkBox_solid->isChecked();             // small files share solid blocks, bigger ones are deduplicated
+
 
     return (uint16_t)flags.to_ulong();
 }
@@ -213,67 +224,22 @@ void ProcessingDialog::on_pushButton_abort_clicked()
 
 void ProcessingDialog::correct_duplicate_names(File* target_file, Folder* parent_folder)
 {
-    std::vector<std::string> name_list;
-    if (parent_folder->child_file_ptr == nullptr) return;
-    else {
-        File* file_in_dir = parent_folder->child_file_ptr.get();
-        name_list.push_back(file_in_dir->name);
+    // target_file is already in parent_folder, and with duplicate names find_file returns the first one
+    if (parent_folder->find_file(target_file->name) == target_file) return;
 
-        while (file_in_dir->sibling_ptr != nullptr)
-        {
-            file_in_dir = file_in_dir->sibling_ptr.get();
-            name_list.push_back(file_in_dir->name);
-        }
-        std::string new_name = std::filesystem::path(target_file->name).stem().string() + " (";
-        std::string extension = std::filesystem::path(target_file->name).extension().string();
-        uint64_t duplicate_counter = 0;
-        bool unique_name = false;
-
-        while( !unique_name ) {
-            bool found = false;
-            uint64_t names_like_current = 0;
-            for (auto current_name : name_list)
-            {
-                if (duplicate_counter == 0)
-                {
-                    if (target_file->name == current_name)
-                    {
-                        names_like_current++;
-                        if (names_like_current > 1) {
-                            duplicate_counter++;
-                            found = true;
-                            break;
-                        }
-                    }
-                }
-                else
-                {
-                    if(new_name + std::to_string(duplicate_counter) + ")" + extension == current_name)
-                    {
-                        duplicate_counter++;
-                        found = true;
-                        break;
-                    }
-                }
-            }
-            if (!found) unique_name = true;
-        }
+    std::string new_name = std::filesystem::path(target_file->name).stem().string() + " (";
+    std::string extension = std::filesystem::path(target_file->name).extension().string();
+    uint64_t duplicate_counter = 1;
 
-        if (duplicate_counter > 0)
-        {
-            target_file->name = new_name + std::to_string(duplicate_counter) + ")" + extension;
-            target_file->name_length = target_file->name.length();
-        }
-    }
+    while (parent_folder->find_file(new_name + std::to_string(duplicate_counter) + ")" + extension) != nullptr)
+        duplicate_counter++;
 
+    parent_folder->rename_file(target_file, new_name + std::to_string(duplicate_counter) + ")" + extension);
 }
 
 
 void ProcessingDialog::on_pushButton_compress_clicked()
 {
-    // before we begin, let's create a temp file, on which we will be working
-    std::filesystem::copy_file(parent_mw->archive_ptr->load_path, parent_mw->temp_path, std::filesystem::copy_options::overwrite_existing);
-
     ui->stackedWidget->setCurrentIndex(0);
 
     uint16_t flags = this->get_flags();
@@ -299,7 +265,7 @@ void ProcessingDialog::on_pushButton_compress_clicked()
     else assert(false); // should never happen
 
     progress_step_value = 0;
-    th_compression = new CompressionObject( list_of_files, &progress_step_value, &progressBarStepMax, parent_mw->temp_path );
+    th_compression = new CompressionObject( list_of_files, &progress_step_value, &progressBarStepMax, parent_mw->archive_ptr );
     my_thread = new QThread;
     th_compression->moveToThread(my_thread);
 
@@ -330,25 +296,7 @@ void ProcessingDialog::slot_processing_finished(bool successful) {
     timer_elapsed_time->stop();
 
     if (successful) {
-        if (compression) {
-            if (parent_mw->archive_ptr->archive_file.is_open()) parent_mw->archive_ptr->archive_file.close();
-            // replacing archive with its updated version
-            bool result = std::filesystem::copy_file(parent_mw->temp_path, parent_mw->archive_ptr->load_path, std::filesystem::copy_options::overwrite_existing);
-            assert( result );   // will fail if anything goes wrong
-            // removing temporary file
-            result = std::filesystem::remove(parent_mw->temp_path);
-            assert( result );
-
-            // reopening fstream to archive
-            parent_mw->archive_ptr->archive_file.open( parent_mw->archive_ptr->load_path, std::ios::binary | std::ios::in | std::ios::out );
-        }
         QMessageBox::information(this, QString("Success!"), QString("Processing succeeded!"));
-
-    }
-    else {
-        if (compression) {
-            std::filesystem::remove(parent_mw->temp_path);
-        }
     }
     ui->buttonFinish->setDisabled(false);
     ui->buttonCancel->setDisabled(true);
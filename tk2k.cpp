@@ -0,0 +1,634 @@
+#include "tk2k.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#include "compression.h"
+#include "integrity_validation.h"
+#include "misc/multithreading.h"
+#include "misc/stream_codec.h"
+#include "misc/worker_pool.h"
+
+
+namespace
+{
+    // Block of a stream with everything its worker needs, made once per context and reused by every call
+    struct Slot
+    {
+        Slot( bool& aborting_var, std::atomic<bool>& corrupted_block_found ) :
+                comp(aborting_var)
+                , aborting_var(aborting_var)
+                , corrupted_block_found(corrupted_block_found) {}
+        ~Slot() { delete[] buffer; }
+
+        Compression comp;
+        bool& aborting_var;
+        std::atomic<bool>& corrupted_block_found;
+        multithreading::mode task = multithreading::mode::compress;
+        uint16_t flags = 0;
+        uint32_t original_size = 0;
+        uint32_t block_checksum = 0;
+        uint32_t stored_checksum = 0;   // of stored block, checked before it's decoded
+        uint64_t output_offset = 0;     // in destination of tk2k_decompress()
+        bool finished = false;
+        std::atomic<bool> done = true;
+        uint8_t* buffer = nullptr;      // only for streaming, grows to the biggest block
+        uint64_t buffer_size = 0;
+    };
+
+    void run_slot( void* argument )
+    {
+        auto slot = (Slot*)argument;
+        if (slot->task == multithreading::mode::decompress
+            and calculate_CRC32C(slot->comp.text, slot->comp.size) != slot->stored_checksum)
+        {
+            slot->corrupted_block_found = true;
+        }
+        else
+        {
+            multithreading::processing_worker(slot->task, &slot->comp, slot->flags, slot->aborting_var, &slot->finished,
+                                              nullptr, &slot->block_checksum, &slot->corrupted_block_found);
+        }
+        slot->done = true;
+        slot->done.notify_all();
+    }
+
+    enum class Stream { none, compress, decompress };
+    enum class Part { header, frame, payload, end, done };     // of stream being decompressed
+}
+
+
+struct tk2k_ctx
+{
+    uint16_t flags = 0;
+    uint32_t block_size = 0;
+    tk2k_submit_fn submit = nullptr;
+    void* pool = nullptr;
+    WorkerPool* own_pool = nullptr;
+    std::vector<Slot*> slots;       // ring, blocks in flight are processed (or waiting to be written) in order
+    uint32_t first = 0;
+    uint32_t in_flight = 0;
+    bool aborting_var = false;
+    std::atomic<bool> corrupted_block_found = false;
+
+    // open stream
+    Stream stream = Stream::none;
+    tk2k_write_fn write = nullptr;
+    void* user_data = nullptr;
+    uint16_t stream_flags = 0;
+    uint32_t stream_block_size = 0;
+    uint32_t next_part = 0;
+    uint64_t total_size = 0;
+    Slot* filling = nullptr;        // its buffer is filled by *_write(), it isn't in flight yet
+    Part part = Part::header;
+    uint8_t frame[stream_codec::frame_header_size];
+    stream_codec::Frame current;
+    uint64_t needed = 0;
+    uint64_t filled = 0;
+};
+
+
+namespace
+{
+    Slot* get_next_slot( tk2k_ctx& context )
+    {
+        return context.slots[(context.first + context.in_flight) % context.slots.size()];
+    }
+
+    void start_slot( tk2k_ctx& context, Slot* slot )
+    {
+        slot->done = false;
+        slot->finished = false;
+        context.in_flight++;
+        const bool queued = context.submit != nullptr ? context.submit(context.pool, &run_slot, slot) == 0
+                                                      : context.own_pool->submit(&run_slot, slot);
+        if (!queued) run_slot(slot);
+    }
+
+    Slot* wait_for_first( tk2k_ctx& context )
+    {
+        Slot* slot = context.slots[context.first];
+        slot->done.wait(false);
+        context.first = (context.first + 1) % context.slots.size();
+        context.in_flight--;
+        return slot;
+    }
+
+    // Stops blocks in flight, and closes the stream
+    void cancel( tk2k_ctx& context )
+    {
+        context.aborting_var = true;
+        while (context.in_flight > 0) wait_for_first(context)->comp.free_text();
+        context.aborting_var = false;
+        context.corrupted_block_found = false;
+        context.stream = Stream::none;
+        context.filling = nullptr;
+    }
+
+    void reserve_buffer( Slot* slot, uint64_t size )
+    {
+        if (slot->buffer_size >= size) return;
+        delete[] slot->buffer;
+        slot->buffer = nullptr;
+        slot->buffer = new uint8_t[size];
+        slot->buffer_size = size;
+    }
+
+    // Stored block of a slot, which the given buffer (not owned) is
+    void set_input( Slot* slot, const uint8_t* buffer, uint64_t size )
+    {
+        slot->comp.load_view(buffer, size, 0, size);
+    }
+
+    int compress_buffer( tk2k_ctx& context, const uint8_t* source, uint64_t source_size,
+                         uint8_t* destination, uint64_t capacity, size_t& destination_size )
+    {
+        if (capacity < stream_codec::header_size + stream_codec::end_size) return TK2K_ERROR_DESTINATION_TOO_SMALL;
+        stream_codec::write_header(destination, context.flags);
+        uint64_t position = stream_codec::header_size;
+        int status = TK2K_OK;
+
+        // blocks are written in order, while the ones after them are still compressed
+        auto write_first = [&]() {
+            Slot* slot = wait_for_first(context);
+            if (status == TK2K_OK and position + stream_codec::frame_header_size + slot->comp.size > capacity)
+                status = TK2K_ERROR_DESTINATION_TOO_SMALL;
+            if (status == TK2K_OK)
+            {
+                stream_codec::write_frame(destination + position, stream_codec::Frame{slot->comp.part_id, slot->original_size,
+                                          slot->comp.size, slot->block_checksum, calculate_CRC32C(slot->comp.text, slot->comp.size)});
+                memcpy(destination + position + stream_codec::frame_header_size, slot->comp.text, slot->comp.size);
+                position += stream_codec::frame_header_size + slot->comp.size;
+            }
+            slot->comp.free_text();
+        };
+
+        uint32_t part_id = 0;
+        for (uint64_t offset = 0; offset < source_size and status == TK2K_OK; offset += context.block_size)
+        {
+            if (context.in_flight == context.slots.size()) write_first();
+            if (status != TK2K_OK) break;
+
+            // blocks are read straight from source, the first stage allocates its output
+            Slot* slot = get_next_slot(context);
+            slot->task = multithreading::mode::compress;
+            slot->flags = context.flags;
+            slot->comp.load_view(source, source_size, part_id, context.block_size);
+            slot->comp.part_id = part_id++;
+            slot->original_size = slot->comp.size;
+            start_slot(context, slot);
+        }
+
+        if (status != TK2K_OK) context.aborting_var = true;
+        while (context.in_flight > 0) write_first();
+        context.aborting_var = false;
+
+        if (status == TK2K_OK and position + stream_codec::end_size > capacity) status = TK2K_ERROR_DESTINATION_TOO_SMALL;
+        if (status != TK2K_OK) return status;
+        stream_codec::write_end(destination + position, part_id, source_size);
+        destination_size = position + stream_codec::end_size;
+        return TK2K_OK;
+    }
+
+    int decompress_buffer( tk2k_ctx& context, const uint8_t* source, uint64_t source_size,
+                           uint8_t* destination, uint64_t capacity, size_t& destination_size )
+    {
+        uint16_t flags;
+        uint32_t block_size;
+        if (source_size < stream_codec::header_size or !stream_codec::read_header(source, flags, block_size))
+            return TK2K_ERROR_DAMAGED;
+        uint64_t position = stream_codec::header_size;
+        uint64_t output_size = 0;
+        int status = TK2K_OK;
+
+        // every block knows where it goes, but it's checked before anything is written
+        auto write_first = [&]() {
+            Slot* slot = wait_for_first(context);
+            if (status == TK2K_OK and (context.corrupted_block_found or slot->comp.size != slot->original_size))
+                status = TK2K_ERROR_DAMAGED;
+            if (status == TK2K_OK) memcpy(destination + slot->output_offset, slot->comp.text, slot->comp.size);
+            slot->comp.free_text();
+        };
+
+        uint32_t part_id = 0;
+        bool end_found = false;
+        while (status == TK2K_OK and !end_found)
+        {
+            if (position + stream_codec::frame_header_size > source_size)
+            {
+                status = TK2K_ERROR_DAMAGED;
+                break;
+            }
+            const stream_codec::Frame frame = stream_codec::read_frame(source + position);
+            position += stream_codec::frame_header_size;
+
+            if (stream_codec::is_end(frame, part_id))
+            {
+                if (position + 8 != source_size or stream_codec::read_total_size(source + position) != output_size)
+                    status = TK2K_ERROR_DAMAGED;
+                position += 8;
+                end_found = true;
+                break;
+            }
+            if (!stream_codec::is_valid(frame, part_id, block_size) or position + frame.stored_size > source_size)
+                status = TK2K_ERROR_DAMAGED;
+            else if (output_size + frame.original_size > capacity)
+                status = TK2K_ERROR_DESTINATION_TOO_SMALL;
+            else if (context.in_flight == context.slots.size())
+                write_first();
+            if (status != TK2K_OK) break;
+
+            // stored blocks are decoded straight from source
+            Slot* slot = get_next_slot(context);
+            slot->task = multithreading::mode::decompress;
+            slot->flags = flags;
+            set_input(slot, source + position, frame.stored_size);
+            slot->comp.part_id = part_id++;
+            slot->comp.block_checksum = frame.block_checksum;
+            slot->stored_checksum = frame.stored_checksum;
+            slot->original_size = frame.original_size;
+            slot->output_offset = output_size;
+            output_size += frame.original_size;
+            position += frame.stored_size;
+            start_slot(context, slot);
+        }
+
+        if (status != TK2K_OK) context.aborting_var = true;
+        while (context.in_flight > 0) write_first();
+        context.aborting_var = false;
+        context.corrupted_block_found = false;
+
+        if (status != TK2K_OK) return status;
+        destination_size = output_size;
+        return TK2K_OK;
+    }
+
+    // Writes the oldest compressed block of the stream
+    int write_compressed_block( tk2k_ctx& context )
+    {
+        Slot* slot = wait_for_first(context);
+        uint8_t frame[stream_codec::frame_header_size];
+        stream_codec::write_frame(frame, stream_codec::Frame{slot->comp.part_id, slot->original_size, slot->comp.size,
+                                  slot->block_checksum, calculate_CRC32C(slot->comp.text, slot->comp.size)});
+        const bool written = context.write(context.user_data, frame, sizeof(frame)) == 0
+                             and context.write(context.user_data, slot->comp.text, slot->comp.size) == 0;
+        slot->comp.free_text();
+        return written ? TK2K_OK : TK2K_ERROR_WRITE;
+    }
+
+    void start_compressed_block( tk2k_ctx& context )
+    {
+        Slot* slot = context.filling;
+        slot->task = multithreading::mode::compress;
+        slot->flags = context.flags;
+        set_input(slot, slot->buffer, context.filled);
+        slot->comp.part_id = context.next_part++;
+        slot->original_size = context.filled;
+        context.total_size += context.filled;
+        context.filling = nullptr;
+        context.filled = 0;
+        start_slot(context, slot);
+    }
+
+    // Writes the oldest decoded block of the stream, after it was checked
+    int write_decoded_block( tk2k_ctx& context )
+    {
+        Slot* slot = wait_for_first(context);
+        int status = TK2K_OK;
+        if (context.corrupted_block_found or slot->comp.size != slot->original_size) status = TK2K_ERROR_DAMAGED;
+        else if (context.write(context.user_data, slot->comp.text, slot->comp.size) != 0) status = TK2K_ERROR_WRITE;
+        slot->comp.free_text();
+        return status;
+    }
+
+    // Called when the whole header, frame, block or end of stream was written to context
+    int handle_part( tk2k_ctx& context )
+    {
+        context.filled = 0;
+        if (context.part == Part::header)
+        {
+            if (!stream_codec::read_header(context.frame, context.stream_flags, context.stream_block_size)) return TK2K_ERROR_DAMAGED;
+            context.part = Part::frame;
+            context.needed = stream_codec::frame_header_size;
+        }
+        else if (context.part == Part::frame)
+        {
+            context.current = stream_codec::read_frame(context.frame);
+            if (stream_codec::is_end(context.current, context.next_part))
+            {
+                context.part = Part::end;
+                context.needed = 8;
+                return TK2K_OK;
+            }
+            if (!stream_codec::is_valid(context.current, context.next_part, context.stream_block_size)) return TK2K_ERROR_DAMAGED;
+
+            if (context.in_flight == context.slots.size())
+            {
+                const int status = write_decoded_block(context);
+                if (status != TK2K_OK) return status;
+            }
+            context.filling = get_next_slot(context);
+            reserve_buffer(context.filling, context.current.stored_size);
+            context.part = Part::payload;
+            context.needed = context.current.stored_size;
+        }
+        else if (context.part == Part::payload)
+        {
+            Slot* slot = context.filling;
+            slot->task = multithreading::mode::decompress;
+            slot->flags = context.stream_flags;
+            set_input(slot, slot->buffer, context.current.stored_size);
+            slot->comp.part_id = context.next_part++;
+            slot->comp.block_checksum = context.current.block_checksum;
+            slot->stored_checksum = context.current.stored_checksum;
+            slot->original_size = context.current.original_size;
+            context.total_size += context.current.original_size;
+            context.filling = nullptr;
+            start_slot(context, slot);
+
+            context.part = Part::frame;
+            context.needed = stream_codec::frame_header_size;
+        }
+        else if (context.part == Part::end)
+        {
+            if (stream_codec::read_total_size(context.frame) != context.total_size) return TK2K_ERROR_DAMAGED;
+            while (context.in_flight > 0)
+            {
+                const int status = write_decoded_block(context);
+                if (status != TK2K_OK) return status;
+            }
+            context.part = Part::done;
+            context.needed = 0;
+        }
+        return TK2K_OK;
+    }
+
+    int begin_stream( tk2k_ctx* context, Stream stream, tk2k_write_fn write, void* user_data )
+    {
+        if (context == nullptr or write == nullptr or context->stream != Stream::none) return TK2K_ERROR_ARGUMENT;
+        context->stream = stream;
+        context->write = write;
+        context->user_data = user_data;
+        context->next_part = 0;
+        context->total_size = 0;
+        context->filling = nullptr;
+        context->filled = 0;
+        context->part = Part::header;
+        context->needed = stream_codec::header_size;
+        return TK2K_OK;
+    }
+
+    // Closes the stream if call failed
+    int finish_call( tk2k_ctx& context, int status )
+    {
+        if (status != TK2K_OK) cancel(context);
+        return status;
+    }
+}
+
+
+void tk2k_default_options( tk2k_options* options )
+{
+    if (options == nullptr) return;
+    options->flags = (1u << 7u) | (1u << 1u) | (1u << 2u) | (1u << 4u);
+    options->thread_count = 0;
+    options->blocks_in_flight = 0;
+    options->submit = nullptr;
+    options->pool = nullptr;
+}
+
+
+tk2k_ctx* tk2k_create( const tk2k_options* options )
+{
+    tk2k_options default_options;
+    tk2k_default_options(&default_options);
+    if (options == nullptr) options = &default_options;
+
+    tk2k_ctx* context = nullptr;
+    try
+    {
+        context = new tk2k_ctx;
+        context->flags = stream_codec::get_stream_flags(options->flags);
+        context->block_size = stream_codec::get_block_size(context->flags);
+        context->submit = options->submit;
+        context->pool = options->pool;
+
+        uint32_t thread_count = options->thread_count;
+        if (thread_count == 0) thread_count = std::thread::hardware_concurrency();
+        if (thread_count == 0) thread_count = 2;
+        const uint32_t slot_count = options->blocks_in_flight != 0 ? options->blocks_in_flight : thread_count * 2;
+
+        if (context->submit == nullptr) context->own_pool = new WorkerPool(thread_count, slot_count);
+        context->slots.reserve(slot_count);
+        for (uint32_t i=0; i < slot_count; ++i)
+            context->slots.push_back(new Slot(context->aborting_var, context->corrupted_block_found));
+        return context;
+    }
+    catch (...)
+    {
+        tk2k_free(context);
+        return nullptr;
+    }
+}
+
+
+void tk2k_free( tk2k_ctx* context )
+{
+    if (context == nullptr) return;
+    cancel(*context);
+    delete context->own_pool;
+    for (Slot* slot : context->slots) delete slot;
+    delete context;
+}
+
+
+const char* tk2k_status_name( int status )
+{
+    switch (status)
+    {
+        case TK2K_OK: return "ok";
+        case TK2K_ERROR_ARGUMENT: return "wrong argument";
+        case TK2K_ERROR_DESTINATION_TOO_SMALL: return "destination is too small";
+        case TK2K_ERROR_DAMAGED: return "stream is damaged";
+        case TK2K_ERROR_WRITE: return "output couldn't be written";
+        case TK2K_ERROR_INTERNAL: return "internal error";
+        default: return "unknown status";
+    }
+}
+
+
+size_t tk2k_compress_bound( const tk2k_ctx* context, size_t source_size )
+{
+    if (context == nullptr) return 0;
+    const uint64_t full_blocks = source_size / context->block_size;
+    const uint64_t last_block = source_size % context->block_size;
+    uint64_t bound = stream_codec::header_size + stream_codec::end_size
+                   + full_blocks * (stream_codec::frame_header_size + stream_codec::get_max_stored_size(context->block_size));
+    if (last_block != 0) bound += stream_codec::frame_header_size + stream_codec::get_max_stored_size(last_block);
+    return bound;
+}
+
+
+int tk2k_compress( tk2k_ctx* context, const void* source, size_t source_size,
+                   void* destination, size_t capacity, size_t* destination_size )
+{
+    if (context == nullptr or (source == nullptr and source_size != 0) or destination == nullptr or destination_size == nullptr
+        or context->stream != Stream::none) return TK2K_ERROR_ARGUMENT;
+    *destination_size = 0;
+    try
+    {
+        return compress_buffer(*context, (const uint8_t*)source, source_size, (uint8_t*)destination, capacity, *destination_size);
+    }
+    catch (...)
+    {
+        cancel(*context);
+        return TK2K_ERROR_INTERNAL;
+    }
+}
+
+
+int tk2k_decompressed_size( const void* source, size_t source_size, uint64_t* size )
+{
+    if (source == nullptr or size == nullptr) return TK2K_ERROR_ARGUMENT;
+    uint16_t flags;
+    uint32_t block_size;
+    if (source_size < stream_codec::header_size + stream_codec::end_size
+        or !stream_codec::read_header((const uint8_t*)source, flags, block_size)) return TK2K_ERROR_DAMAGED;
+    *size = stream_codec::read_total_size((const uint8_t*)source + source_size - 8);
+    return TK2K_OK;
+}
+
+
+int tk2k_decompress( tk2k_ctx* context, const void* source, size_t source_size,
+                     void* destination, size_t capacity, size_t* destination_size )
+{
+    if (context == nullptr or source == nullptr or (destination == nullptr and capacity != 0) or destination_size == nullptr
+        or context->stream != Stream::none) return TK2K_ERROR_ARGUMENT;
+    *destination_size = 0;
+    try
+    {
+        return decompress_buffer(*context, (const uint8_t*)source, source_size, (uint8_t*)destination, capacity, *destination_size);
+    }
+    catch (...)
+    {
+        cancel(*context);
+        return TK2K_ERROR_INTERNAL;
+    }
+}
+
+
+int tk2k_compress_begin( tk2k_ctx* context, tk2k_write_fn write, void* user_data )
+{
+    const int status = begin_stream(context, Stream::compress, write, user_data);
+    if (status != TK2K_OK) return status;
+
+    uint8_t header[stream_codec::header_size];
+    stream_codec::write_header(header, context->flags);
+    return finish_call(*context, write(user_data, header, sizeof(header)) == 0 ? TK2K_OK : TK2K_ERROR_WRITE);
+}
+
+
+int tk2k_compress_write( tk2k_ctx* context, const void* data, size_t size )
+{
+    if (context == nullptr or context->stream != Stream::compress or (data == nullptr and size != 0)) return TK2K_ERROR_ARGUMENT;
+    try
+    {
+        auto input = (const uint8_t*)data;
+        while (size > 0)
+        {
+            if (context->filling == nullptr)
+            {
+                if (context->in_flight == context->slots.size())
+                {
+                    const int status = write_compressed_block(*context);
+                    if (status != TK2K_OK) return finish_call(*context, status);
+                }
+                context->filling = get_next_slot(*context);
+                reserve_buffer(context->filling, context->block_size);
+            }
+
+            const uint64_t piece = std::min<uint64_t>(size, context->block_size - context->filled);
+            memcpy(context->filling->buffer + context->filled, input, piece);
+            context->filled += piece;
+            input += piece;
+            size -= piece;
+            if (context->filled == context->block_size) start_compressed_block(*context);
+        }
+        return TK2K_OK;
+    }
+    catch (...)
+    {
+        return finish_call(*context, TK2K_ERROR_INTERNAL);
+    }
+}
+
+
+int tk2k_compress_end( tk2k_ctx* context )
+{
+    if (context == nullptr or context->stream != Stream::compress) return TK2K_ERROR_ARGUMENT;
+    try
+    {
+        if (context->filled > 0) start_compressed_block(*context);
+        context->filling = nullptr;
+        while (context->in_flight > 0)
+        {
+            const int status = write_compressed_block(*context);
+            if (status != TK2K_OK) return finish_call(*context, status);
+        }
+
+        uint8_t end[stream_codec::end_size];
+        stream_codec::write_end(end, context->next_part, context->total_size);
+        context->stream = Stream::none;
+        return finish_call(*context, context->write(context->user_data, end, sizeof(end)) == 0 ? TK2K_OK : TK2K_ERROR_WRITE);
+    }
+    catch (...)
+    {
+        return finish_call(*context, TK2K_ERROR_INTERNAL);
+    }
+}
+
+
+int tk2k_decompress_begin( tk2k_ctx* context, tk2k_write_fn write, void* user_data )
+{
+    return begin_stream(context, Stream::decompress, write, user_data);
+}
+
+
+int tk2k_decompress_write( tk2k_ctx* context, const void* data, size_t size )
+{
+    if (context == nullptr or context->stream != Stream::decompress or (data == nullptr and size != 0)) return TK2K_ERROR_ARGUMENT;
+    try
+    {
+        auto input = (const uint8_t*)data;
+        while (size > 0 and context->part != Part::done)
+        {
+            uint8_t* destination = context->part == Part::payload ? context->filling->buffer : context->frame;
+            const uint64_t piece = std::min<uint64_t>(size, context->needed - context->filled);
+            memcpy(destination + context->filled, input, piece);
+            context->filled += piece;
+            input += piece;
+            size -= piece;
+            if (context->filled == context->needed)
+            {
+                const int status = handle_part(*context);
+                if (status != TK2K_OK) return finish_call(*context, status);
+            }
+        }
+        return finish_call(*context, size == 0 ? TK2K_OK : TK2K_ERROR_DAMAGED);
+    }
+    catch (...)
+    {
+        return finish_call(*context, TK2K_ERROR_INTERNAL);
+    }
+}
+
+
+int tk2k_decompress_end( tk2k_ctx* context )
+{
+    if (context == nullptr or context->stream != Stream::decompress) return TK2K_ERROR_ARGUMENT;
+    const int status = context->part == Part::done ? TK2K_OK : TK2K_ERROR_DAMAGED;
+    context->stream = Stream::none;
+    return finish_call(*context, status);
+}
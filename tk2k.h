@@ -0,0 +1,91 @@
+#ifndef TK2K_H
+#define TK2K_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// C interface of the codec, for programs in other languages (Go, Rust...), linked with tk2k_core.
+// Data is compressed into the stream format of misc/stream_codec.h, so it can be decoded by "tk2k --archive=-" too.
+//
+// Everything goes through a context, which keeps its threads, its blocks and their buffers between calls,
+// so compressing many messages doesn't start threads or allocate buffers each time. Buffers of streaming
+// functions are allocated when the first stream needs them, and reused after that. Algorithms (BWT, MTF,
+// RLE, AC) still allocate their own working memory for every block.
+//
+// A context can be used by one thread at a time, many contexts can be used at once.
+// Nothing is printed, every failure comes back as a status.
+// Blocks of a context are processed either on its own threads, or on caller's pool (see tk2k_submit_fn).
+
+#define TK2K_VERSION 1
+
+enum tk2k_status
+{
+    TK2K_OK = 0,
+    TK2K_ERROR_ARGUMENT = -1,               // null pointer, or a call which doesn't fit what context is doing
+    TK2K_ERROR_DESTINATION_TOO_SMALL = -2,
+    TK2K_ERROR_DAMAGED = -3,                // input isn't a complete, undamaged stream
+    TK2K_ERROR_WRITE = -4,                  // tk2k_write_fn failed
+    TK2K_ERROR_INTERNAL = -5                // e.g. out of memory
+};
+
+typedef struct tk2k_ctx tk2k_ctx;
+
+typedef void (*tk2k_task_fn)( void* argument );
+
+// Should run task(argument) once, on any thread of caller's pool, and return 0.
+// If it returns anything else, the task is run right away, on the calling thread.
+typedef int (*tk2k_submit_fn)( void* pool, tk2k_task_fn task, void* argument );
+
+// Gets output of streaming functions, in order. Should return 0 if it was written.
+typedef int (*tk2k_write_fn)( void* user_data, const void* data, size_t size );
+
+typedef struct tk2k_options
+{
+    uint16_t flags;             // algorithms (0-4, 7) and block size (9-12), the same as flags of files in archive
+    uint32_t thread_count;      // threads of the context, 0 - number of cores (without submit)
+    uint32_t blocks_in_flight;  // blocks processed at once, 0 - twice the number of threads
+    tk2k_submit_fn submit;      // caller's pool, used instead of threads of the context if it isn't NULL
+    void* pool;                 // given to submit
+} tk2k_options;
+
+void tk2k_default_options( tk2k_options* options );     // BWT (divsufsort), MTF, RLE, AC2, 16 MiB blocks
+
+tk2k_ctx* tk2k_create( const tk2k_options* options );   // options can be NULL, returns NULL if it failed
+void tk2k_free( tk2k_ctx* context );                     // waits for blocks still processed on caller's pool
+
+const char* tk2k_status_name( int status );
+
+// The biggest output of tk2k_compress() for source_size bytes
+size_t tk2k_compress_bound( const tk2k_ctx* context, size_t source_size );
+
+int tk2k_compress( tk2k_ctx* context, const void* source, size_t source_size,
+                   void* destination, size_t capacity, size_t* destination_size );
+
+// Size stored at the end of stream, so destination can be allocated before decompression. It isn't checked here.
+int tk2k_decompressed_size( const void* source, size_t source_size, uint64_t* size );
+
+// source has to be exactly one stream
+int tk2k_decompress( tk2k_ctx* context, const void* source, size_t source_size,
+                     void* destination, size_t capacity, size_t* destination_size );
+
+// Streaming, data is given in pieces of any size, and output goes to write. Only one stream of a context
+// can be open at once. If any call fails, the stream is closed.
+int tk2k_compress_begin( tk2k_ctx* context, tk2k_write_fn write, void* user_data );
+int tk2k_compress_write( tk2k_ctx* context, const void* data, size_t size );
+int tk2k_compress_end( tk2k_ctx* context );
+
+int tk2k_decompress_begin( tk2k_ctx* context, tk2k_write_fn write, void* user_data );
+int tk2k_decompress_write( tk2k_ctx* context, const void* data, size_t size );     // data after the end is damaged
+int tk2k_decompress_end( tk2k_ctx* context );      // damaged, if the stream isn't complete
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TK2K_H
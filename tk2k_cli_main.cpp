@@ -0,0 +1,8 @@
+#include "cli.hpp"
+
+
+// Command line only build, without Qt, so it starts fast and runs where there's no GUI libraries
+int main(int argc, char *argv[])
+{
+    cli::handleArgs(argc, argv);
+}